@@ -38,21 +38,45 @@ SAMP_BOOLEAN TestCmdLine(int A_argc, const char* A_argv[], STORAGE_OPTIONS* A_op
     A_options->RemotePort = -1;
 
     A_options->ListenPort = 1115;
+    A_options->MemoryBudgetMB = 0;
+    A_options->SpillThresholdMB = 0;
+    A_options->StreamThresholdMB = 0;
+    A_options->ReadAheadFiles = -1;
+    A_options->ReadAheadMB = -1;
+    A_options->DirectThresholdMB = 0;
+    A_options->ScratchPath[0] = '\0';
     A_options->ResponseRequested = SAMP_FALSE;
     A_options->Username[0] = '\0';
     A_options->Password[0] = '\0';
 
     A_options->UseFileList = SAMP_FALSE;
     A_options->FileList[0] = '\0';
+    A_options->UseDirectory = SAMP_FALSE;
+    A_options->CrawlPath[0] = '\0';
+    A_options->UseDicomDir = SAMP_FALSE;
+    A_options->DicomDir[0] = '\0';
+    A_options->UseWatch = SAMP_FALSE;
+    A_options->WatchPath[0] = '\0';
+    A_options->GroupStudies = SAMP_FALSE;
+    A_options->StudyQuietSeconds = 0;
+    A_options->StudyContexts = SAMP_FALSE;
+    A_options->Transcode = SAMP_FALSE;
+    A_options->RleOnly = SAMP_FALSE;
+    A_options->ValidatePercent = 0;
+    A_options->TuneDeflate = SAMP_FALSE;
+    A_options->Associations = 1;
+    A_options->ScpPool[0] = '\0';
+    A_options->NegotiationCache[0] = '\0';
 
     /*
      * Loop through each argument
      */
     OptionHandling(A_argc, A_argv, A_options);
     RemoteManagement(A_options);
+    ValidationManagement(A_options);
     if (A_options->StopImage < A_options->StartImage)
     {
-        printf("Image stop number must be greater than or equal to image start number.\n");
+        LogMessage(LOG_LEVEL_WARNING, "Image stop number must be greater than or equal to image start number.\n");
         PrintCmdLine();
         return SAMP_FALSE;
     }
@@ -75,6 +99,20 @@ void RemoteManagement(STORAGE_OPTIONS* A_options)
         strcpy(A_options->ServiceList, "Storage_SCU_Service_List");
     }
 }
+void ValidationManagement(STORAGE_OPTIONS* A_options)
+{
+    /*
+        * The files are validated by the workers reading ahead of the
+        * sender, which do not run with parallel associations or an SCP
+        * pool, so -z would check nothing.
+        */
+
+    if (A_options->ValidatePercent > 0 && (A_options->Associations > 1 || A_options->ScpPool[0]))
+    {
+        LogMessage(LOG_LEVEL_WARNING, "-z has no effect with -j or -e, no instance will be validated.\n");
+        A_options->ValidatePercent = 0;
+    }
+}
 bool CheckHostandPort(STORAGE_OPTIONS* A_options)
 {
     if (A_options->RemoteHostname[0] && (A_options->RemotePort != -1))
@@ -111,7 +149,7 @@ void OptionHandling(int A_argc, const char* A_argv[], STORAGE_OPTIONS* A_options
     {
         if (CheckOptions(i, A_argv, A_options) == false)
         {
-            printf("Unkown option: %s\n", A_argv[i]);
+            LogMessage(LOG_LEVEL_WARNING, "Unkown option: %s\n", A_argv[i]);
         }
     }
 }
@@ -127,22 +165,13 @@ bool ExtraOptions(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
 {
     static int argCount = 0;
     argCount++;
-    bool f = false;
-    typedef void (*Fnptr2)(int, const char* [], STORAGE_OPTIONS*);
-    map<int, Fnptr2> extraoptions;
-    extraoptions[1] = RemoteAE;
-    extraoptions[2] = StartImage;
-    extraoptions[3] = StopImage;
-    map<int, Fnptr2>::iterator itr;
-    for (itr = extraoptions.begin(); itr != extraoptions.end(); ++itr)
+    OptionHandler handler = LookupPositional(argCount);
+    if (handler == NULL)
     {
-        if (argCount == itr->first)
-        {
-            f = true;
-            extraoptions[argCount](i, A_argv, A_options);
-        }
+        return false;
     }
-    return f;
+    handler(i, A_argv, A_options);
+    return true;
 
 }
 void RemoteAE(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
@@ -160,27 +189,13 @@ void StopImage(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
 
 bool MapOptions(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
 {
-    bool f = false;
-    typedef void (*Fnptr1)(int, const char* [], STORAGE_OPTIONS*);
-    map<string, Fnptr1> optionmap;
-    optionmap["-a"] = LocalAE;
-    optionmap["-b"] = LocalPort;
-    optionmap["-f"] = Filename;
-    optionmap["-l"] = ServiceList;
-    optionmap["-n"] = RemoteHost;
-    optionmap["-p"] = RemotePort;
-    map<string, Fnptr1>::iterator itr;
-    string str(A_argv[i]);
-    transform(str.begin(), str.end(), str.begin(), ::tolower);
-    for (itr = optionmap.begin(); itr != optionmap.end(); ++itr)
+    OptionHandler handler = LookupSwitch(A_argv[i]);
+    if (handler == NULL)
     {
-        if (str == itr->first)
-        {
-            f = true;
-            optionmap[str](i, A_argv, A_options);
-        }
+        return false;
     }
-    return f;
+    handler(i, A_argv, A_options);
+    return true;
 }
 void LocalAE(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
 {
@@ -198,6 +213,66 @@ void Filename(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
     A_options->UseFileList = SAMP_TRUE;
     strcpy(A_options->FileList, A_argv[i]);
 }
+void Directory(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->UseDirectory = SAMP_TRUE;
+    strcpy(A_options->CrawlPath, A_argv[i]);
+}
+void DicomDir(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->UseDicomDir = SAMP_TRUE;
+    strcpy(A_options->DicomDir, A_argv[i]);
+}
+void WatchDirectory(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->UseWatch = SAMP_TRUE;
+    strcpy(A_options->WatchPath, A_argv[i]);
+}
+void GroupStudies(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->GroupStudies = SAMP_TRUE;
+    A_options->StudyQuietSeconds = atoi(A_argv[i]);
+}
+void StudyContexts(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    A_options->StudyContexts = SAMP_TRUE;
+}
+void ParallelAssociations(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->Associations = std::min(std::max(atoi(A_argv[i]), 1), MAX_PARALLEL_ASSOCIATIONS);
+}
+void EndpointPool(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    strcpy(A_options->ScpPool, A_argv[i]);
+}
+void SmallestSyntax(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    A_options->Transcode = SAMP_TRUE;
+}
+void RleSyntax(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    A_options->RleOnly = SAMP_TRUE;
+}
+void ValidationRate(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->ValidatePercent = std::min(std::max(atoi(A_argv[i]), 0), 100);
+}
+void DeflateLevels(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    A_options->TuneDeflate = SAMP_TRUE;
+}
+void NegotiationCacheFile(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    strcpy(A_options->NegotiationCache, A_argv[i]);
+}
 void ServiceList(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
 {
     i++;
@@ -213,6 +288,43 @@ void RemotePort(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
     i++;
     A_options->RemotePort = atoi(A_argv[i]);
 }
+void VerboseMode(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    A_options->Verbose = SAMP_TRUE;
+}
+void MemoryLimit(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->MemoryBudgetMB = atoi(A_argv[i]);
+}
+void SpillThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->SpillThresholdMB = atoi(A_argv[i]);
+}
+void ScratchPath(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    strcpy(A_options->ScratchPath, A_argv[i]);
+}
+void StreamThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->StreamThresholdMB = atoi(A_argv[i]);
+}
+void ReadAhead(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    const char* budget = strchr(A_argv[i], ',');
+
+    A_options->ReadAheadFiles = atoi(A_argv[i]);
+    A_options->ReadAheadMB = budget ? atoi(budget + 1) : -1;
+}
+void DirectThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
+{
+    i++;
+    A_options->DirectThresholdMB = atoi(A_argv[i]);
+}
 
 /********************************************************************
  *
@@ -227,19 +339,38 @@ void RemotePort(int i, const char* A_argv[], STORAGE_OPTIONS* A_options)
  ********************************************************************/
 void PrintCmdLine(void)
 {
-    printf("\nUsage SCU remote_ae start stop -f filename -a local_ae -b local_port -n remote_host -p remote_port -l service_list -v \n");
+    printf("\nUsage SCU remote_ae start stop -f filename -d directory -i dicomdir -w directory -g quiet_sec -c -j associations -e scp_list -k cache_file -u -y -q -z percent -a local_ae -b local_port -n remote_host -p remote_port -l service_list -m memory_mb -o direct_mb -r files[,mb] -s spill_mb -t scratch_dir -x stream_mb -v \n");
     printf("\n");
     printf("\t remote_ae       name of remote Application Entity Title to connect with\n");
-    printf("\t start           start image number (not required if -f specified)\n");
-    printf("\t stop            stop image number (not required if -f specified)\n");
+    printf("\t start           start image number (not required if -f, -d, -i or -w specified)\n");
+    printf("\t stop            stop image number (not required if -f, -d, -i or -w specified)\n");
     printf("\t -f filename     (optional) specify a file containing a list of images to transfer\n");
+    printf("\t -d directory    (optional) send the DICOM Part 10 files found anywhere below a directory\n");
+    printf("\t -i dicomdir     (optional) send the files referenced by a DICOMDIR, in patient/study/series order\n");
+    printf("\t -w directory    (optional) keep running and send each DICOM Part 10 file as soon as it is written to a directory\n");
+    printf("\t -g quiet_sec    (optional) send a study at a time over its own association, once no file of it has arrived for quiet_sec seconds\n");
+    printf("\t -c              (optional) with -g, propose only the SOP Classes of the study being sent\n");
+    printf("\t -j associations (optional) share the files out by size between this many associations, at most %d (default: 1)\n", MAX_PARALLEL_ASSOCIATIONS);
+    printf("\t -e scp_list     (optional) host:port,host:port,... of up to %d SCPs behind remote_ae to spread the associations over and fail over between\n", MAX_POOL_ENDPOINTS);
+    printf("\t -u              (optional) send uncompressed files in the smallest lossless syntax remote_ae accepted: JPEG-LS, RLE or deflate\n");
+    printf("\t -y              (optional) send uncompressed images in RLE when remote_ae accepted it, unless it saves too little\n");
+    printf("\t -q              (optional) tune the deflate level for remote_ae from the rate deflated files are sent at\n");
+    printf("\t -z percent      (optional) validate this percent of the instances ahead of sending and hold back those with errors\n");
+    printf("\t -k cache_file   (optional) keep what remote_ae accepted in this file and propose only that for %d hours\n", NEGOTIATION_CACHE_HOURS);
     printf("\t -a local_ae     (optional) specify the local Application Title (default: MERGE_STORE_SCU)\n");
     printf("\t -b local_port   (optional) specify the local TCP listen port for commitment (default: found in the mergecom.pro file)\n");
     printf("\t -n remote_host  (optional) specify the remote hostname (default: found in the mergecom.app file for remote_ae)\n");
     printf("\t -p remote_port  (optional) specify the remote TCP listen port (default: found in the mergecom.app file for remote_ae)\n");
     printf("\t -l service_list (optional) specify the service list to use when negotiating (default: Storage_SCU_Service_List)\n");
+    printf("\t -m memory_mb    (optional) cap on memory held by messages read and not yet freed (default: %d)\n", DEFAULT_MEMORY_BUDGET_MB);
+    printf("\t -o direct_mb    (optional) objects of this size are read without the system's file cache (default: off)\n");
+    printf("\t -r files[,mb]   (optional) number of upcoming files the system is asked to read ahead, 0 for none, and at most mb of them (default: %d,%d)\n", DEFAULT_READ_AHEAD_FILES, DEFAULT_READ_AHEAD_MB);
+    printf("\t -s spill_mb     (optional) objects of this size keep pixel data in temporary files (default: %d)\n", DEFAULT_SPILL_THRESHOLD_MB);
+    printf("\t -t scratch_dir  (optional) directory for temporary files (default: TEMP_FILE_DIRECTORY in mergecom.pro)\n");
+    printf("\t -x stream_mb    (optional) objects of this size send pixel data straight from the file (default: off)\n");
+    printf("\t -v              (optional) verbose output, including debug messages\n");
     printf("\n");
-    printf("\tImage files must be in the current directory if -f is not used.\n");
-    printf("\tImage files must be named 0.img, 1.img, 2.img, etc if -f is not used.\n");
+    printf("\tImage files must be in the current directory if -f, -d, -i or -w is not used.\n");
+    printf("\tImage files must be named 0.img, 1.img, 2.img, etc if -f, -d, -i or -w is not used.\n");
 
 } /* end PrintCmdLine() */
\ No newline at end of file
@@ -0,0 +1,321 @@
+#include "Definitions.h"
+#include <string>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#endif
+
+/****************************************************************************
+ *
+ *  Connection racing
+ *
+ *  When the remote host and port are given, the TCP connection of an
+ *  association is made here and handed to MC_Open_Association_With_Socket
+ *  rather than left to the toolkit, which tries a single address and waits
+ *  the whole CONNECT_TIMEOUT of mergecom.pro on it.
+ *
+ *  Every address of the host is tried, IPv6 and IPv4 taken in turn (as in
+ *  RFC 8305, "Happy Eyeballs").  A connection is started to the first; if
+ *  it has not completed within RACE_ATTEMPT_DELAY_MS one is started to the
+ *  next as well, and so on.  The first connection to complete is kept and
+ *  the others closed, so a dead first address costs RACE_ATTEMPT_DELAY_MS
+ *  instead of the connect timeout.
+ *
+ *  The addresses of a host are kept for RACE_DNS_CACHE_SECONDS, so the
+ *  associations that follow the first (-j, -g, retries, the SCP pool) do
+ *  not wait on a slow name server again.  The look up itself is not
+ *  raced: getaddrinfo blocks for as long as the name server takes.
+ *
+ ****************************************************************************/
+
+/*
+ * Addresses of a host, as resolved
+ */
+typedef struct resolved_host
+{
+    std::chrono::steady_clock::time_point   resolved;   /* time of the look up */
+    std::vector<struct sockaddr_storage>    addresses;  /* IPv6 and IPv4 taken in turn */
+    std::vector<socklen_t>                  lengths;    /* length of each address */
+} ResolvedHost;
+
+#ifdef _WIN32
+typedef WSAPOLLFD RacePoll;
+
+static void SetBlocking(MC_SOCKET A_socket, bool A_blocking)
+{
+    u_long nonBlocking = A_blocking ? 0 : 1;
+    ioctlsocket(A_socket, FIONBIO, &nonBlocking);
+}
+
+static void CloseSocket(MC_SOCKET A_socket)
+{
+    closesocket(A_socket);
+}
+
+static int PollSockets(std::vector<RacePoll>& A_polls, int A_timeoutMs)
+{
+    return WSAPoll(&A_polls[0], (ULONG)A_polls.size(), A_timeoutMs);
+}
+
+static bool ConnectStarted(int A_result)
+{
+    return A_result == 0 || WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+typedef struct pollfd RacePoll;
+
+static void SetBlocking(MC_SOCKET A_socket, bool A_blocking)
+{
+    int flags = fcntl(A_socket, F_GETFL, 0);
+    fcntl(A_socket, F_SETFL, A_blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+}
+
+static void CloseSocket(MC_SOCKET A_socket)
+{
+    close(A_socket);
+}
+
+static int PollSockets(std::vector<RacePoll>& A_polls, int A_timeoutMs)
+{
+    return poll(&A_polls[0], (nfds_t)A_polls.size(), A_timeoutMs);
+}
+
+static bool ConnectStarted(int A_result)
+{
+    return A_result == 0 || errno == EINPROGRESS;
+}
+#endif
+
+static std::map<std::string, ResolvedHost> ResolvedHosts;
+static std::mutex                          ResolvedLock;
+
+static bool IsFresh(const ResolvedHost& A_host)
+{
+    return std::chrono::steady_clock::now() - A_host.resolved < std::chrono::seconds(RACE_DNS_CACHE_SECONDS);
+}
+
+static void AddAddress(ResolvedHost& A_host, const struct addrinfo* A_info)
+{
+    struct sockaddr_storage address;
+
+    memset(&address, 0, sizeof(address));
+    memcpy(&address, A_info->ai_addr, A_info->ai_addrlen);
+    A_host.addresses.push_back(address);
+    A_host.lengths.push_back((socklen_t)A_info->ai_addrlen);
+}
+
+static void AddInTurn(ResolvedHost& A_host, const std::vector<const struct addrinfo*>& A_first, const std::vector<const struct addrinfo*>& A_other, size_t A_index)
+{
+    if (A_index < A_first.size())
+        AddAddress(A_host, A_first[A_index]);
+    if (A_index < A_other.size())
+        AddAddress(A_host, A_other[A_index]);
+}
+
+/*
+ * Takes the addresses of each family in turn, starting with the family
+ * of the first address returned
+ */
+static void InterleaveFamilies(ResolvedHost& A_host, const struct addrinfo* A_list)
+{
+    std::vector<const struct addrinfo*> first;
+    std::vector<const struct addrinfo*> other;
+
+    for (const struct addrinfo* info = A_list; info; info = info->ai_next)
+        (info->ai_family == A_list->ai_family ? first : other).push_back(info);
+    for (size_t i = 0; i < std::max(first.size(), other.size()); i++)
+        AddInTurn(A_host, first, other, i);
+}
+
+static bool LookUpHost(const char* A_host, int A_port, ResolvedHost& A_resolved)
+{
+    struct addrinfo  hints;
+    struct addrinfo* list = NULL;
+    char             service[16];
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    sprintf(service, "%d", A_port);
+    if (getaddrinfo(A_host, service, &hints, &list) != 0)
+        return false;
+    InterleaveFamilies(A_resolved, list);
+    freeaddrinfo(list);
+    A_resolved.resolved = std::chrono::steady_clock::now();
+    return !A_resolved.addresses.empty();
+}
+
+static bool FindResolved(const std::string& A_key, ResolvedHost& A_resolved)
+{
+    std::lock_guard<std::mutex>                   lock(ResolvedLock);
+    std::map<std::string, ResolvedHost>::iterator cached = ResolvedHosts.find(A_key);
+
+    if (cached == ResolvedHosts.end() || !IsFresh(cached->second))
+        return false;
+    A_resolved = cached->second;
+    return true;
+}
+
+static bool ResolveHost(const char* A_host, int A_port, ResolvedHost& A_resolved)
+{
+    std::string key = std::string(A_host) + ":" + std::to_string(A_port);
+
+    if (FindResolved(key, A_resolved))
+        return true;
+    if (!LookUpHost(A_host, A_port, A_resolved))
+        return false;
+    std::lock_guard<std::mutex> lock(ResolvedLock);
+    ResolvedHosts[key] = A_resolved;
+    return true;
+}
+
+static void StartAttempt(const ResolvedHost& A_host, size_t A_index, std::vector<RacePoll>& A_polls)
+{
+    const struct sockaddr* address = (const struct sockaddr*)&A_host.addresses[A_index];
+    MC_SOCKET              fd = socket(address->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    RacePoll               attempt = { fd, POLLOUT, 0 };
+
+    if (fd == NO_SOCKET)
+        return;
+    SetBlocking(fd, false);
+    if (ConnectStarted(connect(fd, address, A_host.lengths[A_index])))
+        A_polls.push_back(attempt);
+    else
+        CloseSocket(fd);
+}
+
+static bool Connected(MC_SOCKET A_socket)
+{
+    int       error = 0;
+    socklen_t length = sizeof(error);
+
+    return getsockopt(A_socket, SOL_SOCKET, SO_ERROR, (char*)&error, &length) == 0 && error == 0;
+}
+
+/*
+ * The attempt is over; its socket is kept if it connected and is the
+ * first to
+ */
+static MC_SOCKET EndAttempt(std::vector<RacePoll>& A_polls, size_t A_index, MC_SOCKET A_winner)
+{
+    MC_SOCKET fd = A_polls[A_index].fd;
+
+    A_polls.erase(A_polls.begin() + A_index);
+    if (A_winner == NO_SOCKET && Connected(fd))
+        return fd;
+    CloseSocket(fd);
+    return A_winner;
+}
+
+/*
+ * Returns the socket connected, NO_SOCKET if none is yet
+ */
+static MC_SOCKET TakeConnected(std::vector<RacePoll>& A_polls)
+{
+    MC_SOCKET winner = NO_SOCKET;
+
+    for (size_t i = A_polls.size(); i-- > 0; )
+    {
+        if (A_polls[i].revents != 0)
+            winner = EndAttempt(A_polls, i, winner);
+    }
+    return winner;
+}
+
+static int RemainingMs(std::chrono::steady_clock::time_point A_deadline)
+{
+    long long left = std::chrono::duration_cast<std::chrono::milliseconds>(A_deadline - std::chrono::steady_clock::now()).count();
+
+    return (int)std::max(left, 0LL);
+}
+
+/*
+ * The next address is tried once the attempts started have had
+ * RACE_ATTEMPT_DELAY_MS, or at once when they have all failed
+ */
+static int AttemptWaitMs(const std::vector<RacePoll>& A_polls, bool A_moreAddresses, std::chrono::steady_clock::time_point A_deadline)
+{
+    if (!A_moreAddresses)
+        return RemainingMs(A_deadline);
+    return A_polls.empty() ? 0 : std::min(RACE_ATTEMPT_DELAY_MS, RemainingMs(A_deadline));
+}
+
+static MC_SOCKET WaitForConnection(std::vector<RacePoll>& A_polls, int A_timeoutMs)
+{
+    if (A_polls.empty() || PollSockets(A_polls, A_timeoutMs) <= 0)
+        return NO_SOCKET;
+    return TakeConnected(A_polls);
+}
+
+static bool RaceGoesOn(const std::vector<RacePoll>& A_polls, bool A_moreAddresses, std::chrono::steady_clock::time_point A_deadline)
+{
+    return (A_moreAddresses || !A_polls.empty()) && RemainingMs(A_deadline) > 0;
+}
+
+static void StartNextAttempt(const ResolvedHost& A_host, size_t& A_next, std::vector<RacePoll>& A_polls)
+{
+    if (A_next < A_host.addresses.size())
+        StartAttempt(A_host, A_next++, A_polls);
+}
+
+static void CloseAttempts(std::vector<RacePoll>& A_polls)
+{
+    for (size_t i = 0; i < A_polls.size(); i++)
+        CloseSocket(A_polls[i].fd);
+}
+
+static MC_SOCKET Race(const ResolvedHost& A_host)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(RACE_CONNECT_TIMEOUT_MS);
+    std::vector<RacePoll>                 polls;
+    MC_SOCKET                             winner = NO_SOCKET;
+    size_t                                next = 0;
+
+    while (winner == NO_SOCKET && RaceGoesOn(polls, next < A_host.addresses.size(), deadline))
+    {
+        StartNextAttempt(A_host, next, polls);
+        winner = WaitForConnection(polls, AttemptWaitMs(polls, next < A_host.addresses.size(), deadline));
+    }
+    CloseAttempts(polls);
+    return winner;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   RaceConnect
+ *
+ *  Parameters  :   A_host     - Name or address of the remote host
+ *                  A_port     - TCP listen port of the remote host
+ *
+ *  Returns     :   A connected socket, in blocking mode
+ *                  NO_SOCKET if the host cannot be resolved or no address
+ *                  accepted the connection within RACE_CONNECT_TIMEOUT_MS
+ *
+ *  Description :   Connect to every address of the host in turn, without
+ *                  waiting for the previous attempt to fail, and keep the
+ *                  first connection made.
+ *
+ ****************************************************************************/
+MC_SOCKET RaceConnect(const char* A_host, int A_port)
+{
+    ResolvedHost resolved;
+
+    if (!ResolveHost(A_host, A_port, resolved))
+    {
+        LogMessage(LOG_LEVEL_ERROR, "Unable to resolve host %s\n", A_host);
+        return NO_SOCKET;
+    }
+    MC_SOCKET winner = Race(resolved);
+    if (winner == NO_SOCKET)
+    {
+        LogMessage(LOG_LEVEL_ERROR, "Unable to connect to any of %d addresses of %s:%d\n", (int)resolved.addresses.size(), A_host, A_port);
+        return NO_SOCKET;
+    }
+    SetBlocking(winner, true);
+    return winner;
+}
@@ -2,19 +2,40 @@
  * Standard OS Includes
  */
 #define _CRT_SECURE_NO_DEPRECATE
+#ifndef NOMINMAX
+#define NOMINMAX    /* windows.h, included by the toolkit, would hide std::min and std::max */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
 #include <iostream>
 #include <algorithm>
 #include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <map>
+#include <vector>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 using namespace std;
 
 #ifdef _WIN32
 #include <fcntl.h>
+#include <direct.h>
+#include <process.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
 #endif
 
 /*
@@ -30,6 +51,8 @@ using namespace std;
 
 #include "mc3inc/general_util.h"
 
+#include "HeaderScan.h"
+
 /* DICOM VR Lengths */
 #define AE_LENGTH 16
 #define UI_LENGTH 64
@@ -39,6 +62,49 @@ using namespace std;
 
 #define TIME_OUT 30
 
+#define MAX_STORE_RETRIES 3 /* passes over instances that asked to be sent again */
+#define RETRY_DELAY 5       /* seconds to wait before a retry pass */
+
+#define DEFAULT_MEMORY_BUDGET_MB 1024 /* cap on memory held by read messages, see MemoryBudget.cpp */
+#define DEFAULT_SPILL_THRESHOLD_MB 256 /* objects this large keep large attributes in temporary files */
+#define SPILL_PRESSURE_PERCENT 75     /* memory budget use above which every object spills */
+#define MAX_PIXEL_STREAMS 16          /* messages whose pixel data is streamed at the same time */
+#define STREAM_CHUNK_SIZE (1024*1024) /* bytes of streamed pixel data supplied per callback */
+#define READ_BUFFER_ALIGNMENT 4096    /* alignment of the per thread read buffers */
+#define MAX_RECYCLED_MESSAGES 16      /* emptied messages kept for the next files */
+#define DEFAULT_READ_AHEAD_FILES 8    /* upcoming files the kernel is asked to read */
+#define DEFAULT_READ_AHEAD_MB 64      /* bytes of upcoming files the kernel is asked to read */
+#define PROBE_THREADS 4               /* threads checking the format of upcoming files */
+#define PROBE_BATCH 16                /* files a probe thread takes at a time */
+#define PROBE_AHEAD 256               /* files the probe threads may be in front of the sender */
+#define DIRECT_READ_SIZE (4*1024*1024) /* bytes read at a time with O_DIRECT, a multiple of READ_BUFFER_ALIGNMENT */
+#define MIN_READ_CHUNK (64*1024)      /* smallest read of a file, a multiple of READ_BUFFER_ALIGNMENT */
+#define MAX_READ_CHUNK (8*1024*1024)  /* largest read of a file */
+#define READ_CHUNK_TARGET_MS 20       /* time a read should take at the measured throughput */
+#define CRAWL_THREADS 8               /* threads walking the directory tree given with -d */
+#define CRAWL_QUEUE_FILES 4096        /* files found by the crawl waiting for the sender */
+#define WATCH_SETTLE_MS 50            /* time a file must be left closed before it is sent */
+#define WATCH_BATCH_MS 20             /* time more arrivals are gathered once a file is ready */
+#define WATCH_BATCH_FILES 256         /* most files sent in one batch */
+#define WATCH_POLL_MS 5               /* interval at which files waiting to settle are checked */
+#define WATCH_IDLE_SECONDS 30         /* idle time after which the association is closed */
+#define STUDY_HEADER_CHUNK (16*1024)  /* bytes read at a time looking for the Study Instance UID */
+#define MAX_PARALLEL_ASSOCIATIONS 16  /* most associations given with -j */
+#define MAX_POOL_ENDPOINTS 8          /* most SCPs given with -e */
+#define POOL_ECHO_SECONDS 10          /* time between C-ECHOs to an SCP of the pool that is down */
+#define POOL_ECHO_MAX_SECONDS 160     /* longest time between C-ECHOs to an idle SCP of the pool that is up */
+#define POOL_ECHO_TIMEOUT 10          /* seconds to wait for a C-ECHO response */
+#define RACE_ATTEMPT_DELAY_MS 250     /* time given a connection before the next address is tried as well */
+#define RACE_CONNECT_TIMEOUT_MS 15000 /* time to connect to any address of the remote host */
+#define RACE_DNS_CACHE_SECONDS 60     /* time the addresses of a host are kept */
+#define NEGOTIATION_CACHE_HOURS 24    /* age after which a negotiation kept with -k is learned again */
+#define TRANSCODE_THREADS 2           /* threads reading and encoding upcoming files; with -y one per core, and at least this many */
+#define TRANSCODE_AHEAD 4             /* least files the transcoding threads may be in front of the sender */
+#define RLE_SAMPLE_FILES 8            /* files RLE encoded before deciding if it is worth it */
+#define RLE_MAX_PERCENT 85            /* RLE is turned off when the sample is not below this percent of its size */
+#define DEFLATE_TUNE_MB 16            /* deflated bytes sent at a level before it is moved with -q */
+#define DEFLATE_TUNE_HOLD_WINDOWS 32  /* windows the fastest level found is kept before it is probed again */
+
 #if defined(_WIN32)
 #define BINARY_READ "rb"
 #define BINARY_WRITE "wb"
@@ -47,6 +113,7 @@ using namespace std;
 #define BINARY_CREATE "w+b"
 #define TEXT_READ "r"
 #define TEXT_WRITE "w"
+#define NO_SOCKET INVALID_SOCKET
 #else
 #define BINARY_READ "r"
 #define BINARY_WRITE "w"
@@ -55,6 +122,7 @@ using namespace std;
 #define BINARY_CREATE "w+"
 #define TEXT_READ "r"
 #define TEXT_WRITE "w"
+#define NO_SOCKET (-1)
 #endif
 
 /*
@@ -78,6 +146,10 @@ typedef struct CALLBACKINFO
     size_t  bufferLength;
 
     char* buffer;
+    unsigned long reads; /* number of reads of the file */
+    double  readSeconds; /* time spent in those reads */
+    int     fd;         /* descriptor of the file read with O_DIRECT */
+    SAMP_BOOLEAN direct; /* Bool saying if fd is open */
 } CBinfo;
 
 /*
@@ -89,16 +161,39 @@ typedef struct stor_scu_options
     int     StopImage;
     int     ListenPort; /* for StorageCommit */
     int     RemotePort;
+    int     MemoryBudgetMB; /* cap on memory held by read messages, 0 for the default */
+    int     SpillThresholdMB; /* object size that always uses temporary files, 0 for the default */
+    int     StreamThresholdMB; /* object size whose pixel data is streamed, 0 for never */
+    int     ReadAheadFiles; /* upcoming files to read ahead, -1 for the default */
+    int     ReadAheadMB;    /* bytes of upcoming files to read ahead, -1 for the default */
+    int     DirectThresholdMB; /* object size read with O_DIRECT, 0 for never */
+    int     ValidatePercent; /* percent of the instances validated before they are sent, 0 for none */
 
     char    RemoteAE[AE_LENGTH + 2];
     char    LocalAE[AE_LENGTH + 2];
     char    RemoteHostname[STR_LENGTH];
     char    ServiceList[SVC_LENGTH + 2];
     char    FileList[1024];
+    char    CrawlPath[1024]; /* root of the directory tree to send */
+    char    DicomDir[1024]; /* DICOMDIR whose referenced files are sent */
+    char    WatchPath[1024]; /* directory whose new files are sent as they arrive */
+    int     StudyQuietSeconds; /* time without new files after which a study is sent */
+    int     Associations;   /* associations the files are shared out between */
+    char    ScpPool[1024];  /* host:port of each SCP behind RemoteAE, comma separated */
+    char    NegotiationCache[1024]; /* file the negotiation with each remote AE is kept in */
+    char    ScratchPath[1024]; /* directory for temporary files of large attributes */
     char    Username[STR_LENGTH];
     char    Password[STR_LENGTH];
 
     SAMP_BOOLEAN UseFileList;
+    SAMP_BOOLEAN UseDirectory;
+    SAMP_BOOLEAN UseDicomDir;
+    SAMP_BOOLEAN UseWatch;
+    SAMP_BOOLEAN GroupStudies;
+    SAMP_BOOLEAN StudyContexts;
+    SAMP_BOOLEAN Transcode;
+    SAMP_BOOLEAN RleOnly;
+    SAMP_BOOLEAN TuneDeflate;
     SAMP_BOOLEAN Verbose;
     SAMP_BOOLEAN StorageCommit;
     SAMP_BOOLEAN ResponseRequested;
@@ -118,6 +213,54 @@ typedef enum
 } FORMAT_ENUM;
 
 
+/*
+ * Entry of the constant transfer syntax table, see LookupTables.cpp
+ */
+typedef struct syntax_entry
+{
+    TRANSFER_SYNTAX syntax;             /* Toolkit enumeration value */
+    const char*     description;        /* Text used for display purposes */
+    bool            supported;          /* Bool saying if images in this syntax may be sent */
+} SyntaxEntry;
+
+/*
+ * Broad class of a C-STORE response status
+ */
+typedef enum
+{
+    STATUS_CLASS_SUCCESS = 0,
+    STATUS_CLASS_WARNING,
+    STATUS_CLASS_FAILURE,
+    STATUS_CLASS_UNKNOWN
+} STORE_STATUS_CLASS;
+
+/*
+ * What the SCU does with an instance after its C-STORE response
+ */
+typedef enum
+{
+    STORE_ACTION_CONTINUE = 0,          /* Stored, nothing more to do */
+    STORE_ACTION_RETRY_LATER,           /* Send again on this association after RETRY_DELAY */
+    STORE_ACTION_RETRY_NEW_ASSOCIATION, /* Send again after opening a new association */
+    STORE_ACTION_FAIL_INSTANCE,         /* Give up on this instance, continue with the others */
+    STORE_ACTION_ABORT                  /* Abort the association */
+} STORE_ACTION;
+
+/*
+ * Entry of the constant C-STORE response status table, see LookupTables.cpp
+ */
+typedef struct store_status_entry
+{
+    unsigned int       mask;            /* Bits of the status compared with value */
+    unsigned int       value;           /* Status, or status range, of this entry */
+    const char*        code;            /* Printable status, 'x' for masked digits */
+    STORE_STATUS_CLASS statusClass;     /* Success, warning or failure */
+    STORE_ACTION       action;          /* What to do with the instance */
+    const char*        meaning;         /* Textual meaning of the status */
+} StoreStatusEntry;
+
+#define NUM_STORE_STATUS_ENTRIES 21
+
 /*
  * Structure to maintain list of instances sent & to be sent.
  * The structure keeps track of all instances and is used
@@ -139,10 +282,63 @@ typedef struct instance_node
     SAMP_BOOLEAN failedResponse;        /* Bool saying if a failure response message was received */
     SAMP_BOOLEAN imageSent;             /* Bool saying if the image has been sent over the association yet */
     SAMP_BOOLEAN mediaFormat;           /* Bool saying if the image was originally in media format (Part 10) */
+    STORE_ACTION action;                /* What to do with the instance after its response */
+    int          retryCount;            /* Number of times the instance was sent again */
+    size_t       reservedBytes;         /* Bytes reserved in the memory budget for the message */
+    SAMP_BOOLEAN largeDataInFile;       /* Bool saying if large attributes are kept in temporary files */
+    SAMP_BOOLEAN streamPixelData;       /* Bool saying if pixel data is read from the file while sending */
+    SAMP_BOOLEAN readAheadIssued;       /* Bool saying if the kernel was asked to read the file ahead */
+    size_t       readAheadBytes;        /* size of the file when it was read ahead */
+    size_t       fileBytes;             /* size of the file when it was added to the list */
+    FORMAT_ENUM  format;                /* format of the file, valid once formatChecked is set */
+    SAMP_BOOLEAN formatChecked;         /* Bool saying if the file probe has checked the format */
+    SAMP_BOOLEAN transcoded;            /* Bool saying if the message was put in another transfer syntax */
+    SAMP_BOOLEAN quarantined;           /* Bool saying if validation found errors in the dataset, so it is not sent */
+    char   studyUID[UI_LENGTH + 2];     /* Study Instance UID of the file, read when sending by study */
     struct instance_node* Next;         /* Pointer to next node in list */
 
 } InstanceNode;
 
+/*
+ * Pixel data of a message supplied from its file while sending,
+ * see PixelStream.cpp
+ */
+typedef struct pixel_stream
+{
+    bool          inUse;                /* Slot belongs to a message */
+    int           msgID;                /* Message whose pixel data this is */
+    char          fname[1024];          /* File the pixel data is read from */
+    long          valueOffset;          /* Position of the pixel data value in the file */
+    unsigned long length;               /* Length of the pixel data value */
+    unsigned long remaining;            /* Bytes not yet supplied to the toolkit */
+    FILE*         fp;                   /* Open while the message is sent, when the file is not mapped */
+    char*         buffer;               /* STREAM_CHUNK_SIZE bytes */
+    void*         view;                 /* Mapping of the pixel data, NULL when it is read with fp */
+    size_t        viewLength;           /* Length of the mapping */
+    char*         mapped;               /* Start of the pixel data value in the mapping */
+} PixelStream;
+
+/*
+ * Level of a log message, see Logger.cpp
+ */
+typedef enum
+{
+    LOG_LEVEL_ERROR = 0,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_DEBUG
+} LOG_LEVEL;
+
+/*
+ * Handler for a command line switch or positional argument
+ */
+typedef void (*OptionHandler)(int, const char* [], STORAGE_OPTIONS*);
+
+/*
+ * Callback reading a file for MC_Open_File
+ */
+typedef MC_STATUS (NOEXP_FUNC *FileReadCallback)(char*, void*, int*, void**, int, int*);
+
 //Global Function Declarations
 
 int main(int argc, const char* argv[]);
@@ -150,6 +346,7 @@ int main(int argc, const char* argv[]);
 //Command Line and Input Related Functions
 SAMP_BOOLEAN TestCmdLine(int A_argc, const char* A_argv[], STORAGE_OPTIONS* A_options);
 void RemoteManagement(STORAGE_OPTIONS* A_options);
+void ValidationManagement(STORAGE_OPTIONS* A_options);
 bool CheckHostandPort(STORAGE_OPTIONS* A_options);
 SAMP_BOOLEAN PrintHelp(int A_argc, const char* A_argv[]);
 bool CheckIfHelp(const string& str, int A_argc);
@@ -166,25 +363,228 @@ void Filename(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
 void ServiceList(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
 void RemoteHost(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
 void RemotePort(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void VerboseMode(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void MemoryLimit(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void SpillThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void ScratchPath(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void StreamThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void ReadAhead(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void DirectThreshold(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void Directory(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void DicomDir(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void WatchDirectory(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void GroupStudies(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void StudyContexts(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void ParallelAssociations(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void EndpointPool(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void NegotiationCacheFile(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void SmallestSyntax(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void RleSyntax(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void ValidationRate(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
+void DeflateLevels(int i, const char* A_argv[], STORAGE_OPTIONS* A_options);
 void PrintCmdLine(void);
 
+//Logging
+
+void LogStart(LOG_LEVEL A_level);
+void LogStop(void);
+void LogMessage(LOG_LEVEL A_level, const char* A_format, ...);
+
+//Memory budget for read messages
+
+void MemoryBudgetConfigure(size_t A_limitBytes, size_t A_largeDataSize);
+void MemoryBudgetInit(int A_limitMB);
+size_t EstimateMessageBytes(size_t A_fileBytes, bool A_inFile);
+void MemoryBudgetAcquire(size_t A_bytes);
+bool MemoryBudgetTryAcquire(size_t A_bytes);
+void MemoryBudgetRelease(size_t A_bytes);
+size_t MemoryBudgetLimit(void);
+size_t MemoryBudgetInUse(void);
+size_t MemoryBudgetPeak(void);
+void ReserveNodeMemory(InstanceNode* A_node);
+bool TryReserveNodeMemory(InstanceNode* A_node);
+void ReleaseNodeMemory(InstanceNode* A_node);
+
+//Large data store policy
+
+void LargeDataStoreInit(const char* A_scratchPath, int A_thresholdMB);
+bool ShouldSpillToFile(size_t A_fileBytes);
+void ApplyLargeDataStore(bool A_inFile);
+void LargeDataStoreBeginRead(void);
+void LargeDataStoreEndRead(void);
+void LargeDataStoreCleanup(void);
+
+//Streaming pixel data
+
+void PixelStreamInit(int A_thresholdMB);
+bool ShouldStreamPixelData(size_t A_fileBytes);
+void ApplyPixelStreaming(bool A_stream);
+MC_STATUS OpenFileObject(int A_appID, int A_msgID, char* A_filename, CBinfo& A_callbackInfo);
+MC_STATUS NOEXP_FUNC PixelDataCallback(int A_msgID, unsigned long A_tag, void* A_userInfo, CALLBACK_TYPE A_type,
+    unsigned long* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast);
+void ReleasePixelStream(int A_msgID);
+
+//Read buffer and message pools
+
+char* GetReadBuffer(size_t A_length);
+MC_STATUS CreateFileObject(int* A_msgID, const char* A_filename);
+MC_STATUS FreeNodeMessage(InstanceNode* A_node);
+void FreeRecycledMessages(void);
+
+//Read-ahead hints
+
+void ReadAheadInit(int A_files, int A_budgetMB);
+bool ReadAheadNext(InstanceNode* A_node, int* A_files, size_t* A_bytes);
+void ReadAheadFrom(InstanceNode* A_current);
+void DropFromPageCache(InstanceNode* A_node);
+
+//File probe
+
+void ProbeStart(InstanceNode* A_list);
+void ProbeWait(void);
+void ProbeStop(void);
+FORMAT_ENUM GetNodeFormat(InstanceNode* A_node);
+
+//Direct reads
+
+void DirectReadInit(int A_thresholdMB);
+bool ShouldReadDirect(size_t A_fileBytes);
+void ApplyDirectRead(bool A_direct);
+FileReadCallback GetFileReadCallback(void);
+void CloseDirectRead(CBinfo& A_callbackInfo);
+MC_STATUS NOEXP_FUNC DirectToFileObj(char* A_filename, void* A_userInfo, int* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast);
+
+//Read chunk size
+
+void ReadChunkInit(void);
+size_t ChooseReadChunkSize(size_t A_fileBytes);
+void ApplyReadChunkSize(size_t A_fileBytes);
+size_t NextReadChunkSize(void);
+void RecordFileRead(const CBinfo* A_info);
+void PrintReadChunkStats(void);
+
+//Directory crawl
+
+void CrawlStart(const char* A_path);
+void CrawlStop(void);
+int CrawlAppendFiles(InstanceNode** A_list);
+
+//DICOMDIR input
+
+bool ReadDicomDir(InstanceNode** A_list, const char* A_path);
+
+//Directory watch
+
+bool WatchStart(const char* A_path);
+void WatchStop(void);
+bool WatchRunning(void);
+int WatchCollect(InstanceNode** A_list, int A_waitMs);
+void WatchRequeue(InstanceNode* A_list);
+
+//Study batches
+
+void HoldStudies(int A_appID, InstanceNode* A_list);
+bool StudiesHeld(void);
+int NextStudyDueMs(int A_quietSeconds);
+InstanceNode* TakeQuietStudy(int A_quietSeconds);
+void ProposeStudyServices(InstanceNode* A_study);
+char* StudyServiceList(char* A_configured);
+void EndStudyServices(void);
+
+//Parallel associations
+
+void ParallelPlan(InstanceNode* A_list, int A_queues);
+InstanceNode* ParallelTake(int A_queue);
+void ParallelReadAhead(int A_queue);
+long ParallelFinish(InstanceNode** A_list);
+
+//SCP pool
+
+bool PoolParse(const char* A_spec);
+bool PoolStart(const char* A_spec, int A_appID, const char* A_remoteAE, const char* A_serviceList);
+void PoolStop(void);
+bool PoolConfigured(void);
+int PoolAcquire(void);
+void PoolRelease(int A_endpoint, bool A_failed);
+void PoolAddInFlight(int A_endpoint, long long A_bytes);
+void PoolEndpointAddress(int A_endpoint, char* A_host, int* A_port);
+
+//Connection racing
+
+MC_SOCKET RaceConnect(const char* A_host, int A_port);
+
+//Transcoding
+
+void TranscodeInit(bool A_enabled, bool A_rleOnly);
+void TranscodeRleSample(unsigned long A_original, unsigned long A_encoded);
+void TranscodeAccepted(int A_associationID, const char* A_service, TRANSFER_SYNTAX A_syntax);
+void TranscodeLearn(int A_associationID);
+TRANSFER_SYNTAX TranscodeChoose(int A_associationID, const char* A_service, TRANSFER_SYNTAX A_source, bool A_pixelData);
+void TranscodeOnSend(int A_associationID, InstanceNode* A_node);
+void TranscodeStart(STORAGE_OPTIONS* A_options, int A_appID, int A_associationID, InstanceNode* A_list);
+bool TranscodeTake(InstanceNode* A_node, SAMP_BOOLEAN* A_read);
+void TranscodeListGrown(void);
+void TranscodeStop(void);
+
+//Validation
+
+void ValidateInit(int A_percent);
+bool ValidateEnabled(void);
+bool ValidateSampled(void);
+void ValidateQuarantine(InstanceNode* A_node, VAL_ERR* A_error);
+void ValidateNode(InstanceNode* A_node);
+
+//Deflate level tuning
+
+void DeflateTuneInit(bool A_enabled);
+void DeflateTuneRecord(const char* A_destination, size_t A_bytes, double A_seconds);
+int DeflateTuneLevel(const char* A_destination);
+MC_STATUS DeflateTunedSend(const char* A_destination, int A_associationID, InstanceNode* A_node);
+
+//Negotiation cache
+
+void NegotiationCacheLoad(const char* A_path);
+char* NegotiatedServiceList(const char* A_remoteAE, char* A_configured);
+void NegotiationCacheRecord(const char* A_remoteAE, const char* A_configured, int A_associationID, const AssocInfo* A_info);
+void NegotiationCacheSave(void);
+
+//Constant lookup tables
+
+const SyntaxEntry& LookupSyntax(int A_syntax);
+int LookupStoreStatusIndex(unsigned int A_status);
+const StoreStatusEntry& StoreStatusAt(int A_index);
+STORE_STATUS_CLASS ClassifyStoreStatus(unsigned int A_status);
+bool IsFatalSendStatus(MC_STATUS A_status);
+OptionHandler LookupSwitch(const char* A_arg);
+OptionHandler LookupPositional(int A_position);
+
 //List Update related functions
 
 SAMP_BOOLEAN AddFileToList(InstanceNode** A_list, char* A_fname);
 void list_updation(InstanceNode** A_list, InstanceNode* newNode);
+InstanceNode* GetListTail(InstanceNode* A_list);
+void ResetListTail(void);
 SAMP_BOOLEAN UpdateNode(InstanceNode* A_node);
 void FreeList(InstanceNode** A_list);
 int GetNumNodes(InstanceNode* A_list);
 int GetNumOutstandingRequests(InstanceNode* A_list);
+int GetNumRetryRequests(InstanceNode* A_list);
+bool NeedsNewAssociation(InstanceNode* A_list);
+void PrepareNodeForRetry(InstanceNode* A_node);
+int RequeueUnacknowledged(InstanceNode* A_list);
 
 //Image Read and Send related functions
 
 SAMP_BOOLEAN ReadResponseMessages(STORAGE_OPTIONS* A_options, int A_associationID, int A_timeout, InstanceNode** A_list, InstanceNode* A_node);
-SAMP_BOOLEAN CheckResponseMessage(int A_responseMsgID, unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength);
+SAMP_BOOLEAN CheckResponseMessage(int A_responseMsgID, unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength, STORE_ACTION* A_action);
+unsigned long GetStoreStatusCount(unsigned int A_status);
+void PrintStoreStatusCounts(void);
+
 FORMAT_ENUM CheckFileFormat(char* A_filename);
 SAMP_BOOLEAN ReadImage(STORAGE_OPTIONS* A_options, int A_appID, InstanceNode* A_node);
 void ValidImageCheck(InstanceNode* A_node);
 MC_STATUS CreateEmptyFileAndStoreIt(int& A_appID, int*& A_msgID, char*& A_filename, CBinfo& callbackInfo);
+void CloseCallBackInfo(CBinfo& callbackInfo);
 SAMP_BOOLEAN SendImage(STORAGE_OPTIONS* A_options, int A_associationID, InstanceNode* A_node);
 MC_STATUS NOEXP_FUNC MediaToFileObj(char* Afilename, void* AuserInfo, int* AdataSize, void** AdataBuffer, int AisFirst, int* AisLast);
 bool Transfer_Syntax_Encoding(MC_STATUS mcStatus, int*& A_msgID, TRANSFER_SYNTAX*& A_syntax);
@@ -217,6 +617,7 @@ public:
     STORAGE_OPTIONS         options;
     MC_STATUS               mcStatus;
     int                     applicationID, associationID, imageCurrent;
+    int                     endpoint;   /* SCP of the pool the association is with, -1 if none */
     int                     imagesSent, totalImages, fstatus;
     char* fname;
     ServiceInfo             servInfo;
@@ -224,28 +625,77 @@ public:
     InstanceNode* instanceList, * node;
     FILE* fp;
 
-    explicit mainclass(char* filename) : sampBool(SAMP_TRUE), mcStatus(MC_NORMAL_COMPLETION), applicationID(-1), associationID(-1), imageCurrent(0), imagesSent(0L), totalImages(0L), fstatus(0), fname(filename), totalBytesRead(0L), instanceList(NULL), node(NULL), fp(NULL), servInfo({0}), options({0}) {}
+    explicit mainclass(char* filename) : sampBool(SAMP_TRUE), mcStatus(MC_NORMAL_COMPLETION), applicationID(-1), associationID(-1), imageCurrent(0), imagesSent(0L), totalImages(0L), fstatus(0), fname(filename), totalBytesRead(0L), instanceList(NULL), node(NULL), fp(NULL), servInfo({0}), options({0}), endpoint(-1) {}
 
     bool InitializeApplication();
     bool InitializeList();
+    bool FillList();
+    bool FillListFromArguments();
+    bool OpenFileList();
+    bool CrawlDirectory();
+    bool RegisterApplication();
+    void AdvanceNode();
     void ReadFileByFILENAME();
     void ReadEachLineInFile();
     void ReadFileFromStartStopPosition();
 
     bool CreateAssociation();
+    bool ConnectAssociation();
+    void GetAssociationInfo();
+    bool StartPool();
+    void LoadNegotiations();
+    bool ConnectPool();
+    bool SelectEndpoint();
+    void ReleaseEndpoint(bool A_failed);
+    bool FailOver();
+    void SkipRequeuedNode();
     char* checkRemoteHostName(char* RemoteHostName);
     char* checkServiceList(char* ServiceList);
     MC_STATUS OpenAssociation();
+    MC_STATUS OpenRacedAssociation(char* A_host, char* A_serviceList);
 
+    void SendImages();
     void StartSendImage();
+    void SendList();
+    void StartTranscoding();
+    void SendParallel();
+    mainclass* NewWorker(int A_index);
+    void StartWorkers(std::vector<mainclass*>& A_workers, std::vector<std::thread*>& A_threads);
+    void JoinWorkers(std::vector<mainclass*>& A_workers, std::vector<std::thread*>& A_threads);
+    void CollectWorker(mainclass* A_worker, int A_index);
+    void SendAssigned(int A_index);
+    bool SendTaken(int A_index);
+    void SendByStudy();
+    void DrainCrawl();
+    void SendQuietStudies(int A_quietSeconds);
+    void SendStudy();
+    void UseStudyServices();
+    void WatchAndSend();
+    int WatchWaitMs();
+    void SendWatchBatch(int A_files);
+    void SendWatchStudies(int A_files);
+    bool EnsureAssociation();
+    void RequeueFailedBatch();
+    bool SendNextImage();
+    bool SendAllImages();
+    void RetryImages();
+    bool RetryPass();
+    bool PrepareRetryAssociation();
+    bool RetryNextImage();
+    bool RetryNextNode();
+    bool ReopenAssociation();
+    void AbortAssociation();
     bool ImageTransfer();
+    void HoldBackQuarantined();
+    SAMP_BOOLEAN ReadNextImage();
     bool SendImageAndUpdateNode();
     bool ResponseMessages();
     void WaitforResponse();
     bool SendAndResponse();
-    void checkResponseMsg();
+    bool checkResponseMsg();
     void UpdateImageSentCount();
 
+    void CloseOrAbortAssociation();
     void CloseAssociation();
     void ReleaseApplication();
 
@@ -0,0 +1,252 @@
+#include "Definitions.h"
+#include <string>
+
+/****************************************************************************
+ *
+ *  Deflate level tuning
+ *
+ *  The toolkit deflates a message sent in Deflated Explicit VR Little
+ *  Endian as it writes it to the network, at the DEFLATE_COMPRESSION_LEVEL
+ *  of mergecom.pro.  Which level sends fastest depends on the link and on
+ *  the processor: a slow link wants the smallest messages, a fast one
+ *  wants the level the processor keeps up with.
+ *
+ *  With -q the level is tuned for each remote AE while the files are sent.
+ *  The time taken to send the deflated files is measured over windows of
+ *  DEFLATE_TUNE_MB.  After each window the level is moved one step;
+ *  if the bytes sent per second fell, the next step goes the other way.
+ *  The level starts from the one configured and stays between 1 and 9.
+ *
+ *  Once the level has turned back twice, the fastest level has been
+ *  passed on both sides, so it is held there.  It is held for
+ *  DEFLATE_TUNE_HOLD_WINDOWS windows, then probed again from the same
+ *  level, as the link or the load may have changed.
+ *
+ *  The time measured is that of MC_Send_Request_Message, which deflates
+ *  and writes the message; the wait for the response is not in it.
+ *
+ ****************************************************************************/
+
+/*
+ * Tuning of the level for one remote AE
+ */
+typedef struct deflate_tuning
+{
+    int    level;           /* level the files are deflated at */
+    int    step;            /* +1 or -1, the way the level is being moved */
+    int    turns;           /* times the level turned back since it was last probed from */
+    int    heldWindows;     /* windows the level is still held for, 0 while probing */
+    int    bestLevel;       /* level of the fastest window since then */
+    double bestRate;        /* its bytes per second */
+    double lastRate;        /* bytes per second of the last window, 0 before the first */
+    size_t windowBytes;     /* bytes sent at the level so far */
+    double windowSeconds;   /* time spent sending them */
+} DeflateTuning;
+
+static bool                                 DeflateTuneEnabled = false;
+static std::map<std::string, DeflateTuning> DeflateTunings;
+static std::mutex                           DeflateLock;
+static int                                  DeflateLevelSet = -1;   /* level last given to the toolkit */
+
+/****************************************************************************
+ *
+ *  Function    :   DeflateTuneInit
+ *
+ *  Parameters  :   A_enabled  - Tune the deflate level (-q)
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void DeflateTuneInit(bool A_enabled)
+{
+    std::lock_guard<std::mutex> lock(DeflateLock);
+    DeflateTuneEnabled = A_enabled;
+    DeflateTunings.clear();
+    DeflateLevelSet = -1;
+}
+
+static int ConfiguredLevel()
+{
+    int level = 6;
+
+    MC_Get_Int_Config_Value(DEFLATE_COMPRESSION_LEVEL, &level);
+    return std::min(std::max(level, 1), 9);
+}
+
+/*
+ * Called holding DeflateLock
+ */
+static DeflateTuning& TuningFor(const char* A_destination)
+{
+    std::map<std::string, DeflateTuning>::iterator tuning = DeflateTunings.find(A_destination);
+
+    if (tuning != DeflateTunings.end())
+        return tuning->second;
+    DeflateTuning& added = DeflateTunings[A_destination];
+    added.level = ConfiguredLevel();
+    added.step = 1;
+    added.turns = 0;
+    added.heldWindows = 0;
+    added.bestLevel = added.level;
+    added.bestRate = 0;
+    added.lastRate = 0;
+    added.windowBytes = 0;
+    added.windowSeconds = 0;
+    return added;
+}
+
+/*
+ * The toolkit's level is shared by every association, so it is only
+ * changed when the remote AE being sent to needs another one
+ */
+static void ApplyLevel(const char* A_destination)
+{
+    int level = DeflateTuneLevel(A_destination);
+
+    std::lock_guard<std::mutex> lock(DeflateLock);
+    if (level != DeflateLevelSet)
+        MC_Set_Int_Config_Value(DEFLATE_COMPRESSION_LEVEL, level);
+    DeflateLevelSet = level;
+}
+
+static void TurnBack(DeflateTuning& A_tuning)
+{
+    A_tuning.step = -A_tuning.step;
+    A_tuning.turns++;
+}
+
+/*
+ * Levels 1 and 9 turn the level back as a slower level would
+ */
+static int NextLevel(DeflateTuning& A_tuning)
+{
+    if (A_tuning.level + A_tuning.step < 1 || A_tuning.level + A_tuning.step > 9)
+        TurnBack(A_tuning);
+    return A_tuning.level + A_tuning.step;
+}
+
+static void NoteBest(DeflateTuning& A_tuning, double A_rate)
+{
+    if (A_rate <= A_tuning.bestRate)
+        return;
+    A_tuning.bestRate = A_rate;
+    A_tuning.bestLevel = A_tuning.level;
+}
+
+static void Probe(const char* A_destination, DeflateTuning& A_tuning, double A_rate)
+{
+    NoteBest(A_tuning, A_rate);
+    if (A_tuning.lastRate > 0 && A_rate < A_tuning.lastRate)
+        TurnBack(A_tuning);
+    A_tuning.lastRate = A_rate;
+    A_tuning.level = NextLevel(A_tuning);
+    if (A_tuning.turns < 2)
+        return;
+    A_tuning.level = A_tuning.bestLevel;
+    A_tuning.heldWindows = DEFLATE_TUNE_HOLD_WINDOWS;
+    LogMessage(LOG_LEVEL_DEBUG, "Deflate level %d held for %s\n", A_tuning.level, A_destination);
+}
+
+/*
+ * The first window after the hold measures the held level again
+ */
+static void Hold(DeflateTuning& A_tuning)
+{
+    if (--A_tuning.heldWindows > 0)
+        return;
+    A_tuning.turns = 0;
+    A_tuning.bestRate = 0;
+    A_tuning.lastRate = 0;
+}
+
+static void EndWindow(const char* A_destination, DeflateTuning& A_tuning)
+{
+    double rate = A_tuning.windowBytes / std::max(A_tuning.windowSeconds, 1e-6);
+
+    LogMessage(LOG_LEVEL_DEBUG, "Deflate level %d sent %.0f bytes/s to %s\n", A_tuning.level, rate, A_destination);
+    if (A_tuning.heldWindows > 0)
+        Hold(A_tuning);
+    else
+        Probe(A_destination, A_tuning, rate);
+    A_tuning.windowBytes = 0;
+    A_tuning.windowSeconds = 0;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   DeflateTuneRecord
+ *
+ *  Parameters  :   A_destination - AE title of the remote system
+ *                  A_bytes       - Size of the message sent
+ *                  A_seconds     - Time taken to send it
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Count a deflated message sent, moving the level once a
+ *                  window of DEFLATE_TUNE_MB has been sent.
+ *
+ ****************************************************************************/
+void DeflateTuneRecord(const char* A_destination, size_t A_bytes, double A_seconds)
+{
+    std::lock_guard<std::mutex> lock(DeflateLock);
+    DeflateTuning&              tuning = TuningFor(A_destination);
+
+    tuning.windowBytes += A_bytes;
+    tuning.windowSeconds += A_seconds;
+    if (tuning.windowBytes >= (size_t)DEFLATE_TUNE_MB * 1024 * 1024)
+        EndWindow(A_destination, tuning);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   DeflateTuneLevel
+ *
+ *  Parameters  :   A_destination - AE title of the remote system
+ *
+ *  Returns     :   The level the next file to the remote AE is deflated at
+ *
+ ****************************************************************************/
+int DeflateTuneLevel(const char* A_destination)
+{
+    std::lock_guard<std::mutex> lock(DeflateLock);
+    return TuningFor(A_destination).level;
+}
+
+static bool IsDeflated(const InstanceNode* A_node)
+{
+    return A_node->transferSyntax == DEFLATED_EXPLICIT_LITTLE_ENDIAN;
+}
+
+static MC_STATUS TimedSend(const char* A_destination, int A_associationID, InstanceNode* A_node)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    MC_STATUS                             mcStatus = MC_Send_Request_Message(A_associationID, A_node->msgID);
+    std::chrono::duration<double>         taken = std::chrono::steady_clock::now() - start;
+
+    if (mcStatus == MC_NORMAL_COMPLETION)
+        DeflateTuneRecord(A_destination, A_node->imageBytes, taken.count());
+    return mcStatus;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   DeflateTunedSend
+ *
+ *  Parameters  :   A_destination   - AE title of the remote system
+ *                  A_associationID - Association the file is sent over
+ *                  A_node          - The node whose message is sent
+ *
+ *  Returns     :   The status of MC_Send_Request_Message
+ *
+ *  Description :   Send the node's message, at the level tuned for the
+ *                  remote AE when it is deflated and -q is given.
+ *
+ ****************************************************************************/
+MC_STATUS DeflateTunedSend(const char* A_destination, int A_associationID, InstanceNode* A_node)
+{
+    if (!DeflateTuneEnabled || !IsDeflated(A_node))
+        return MC_Send_Request_Message(A_associationID, A_node->msgID);
+
+    ApplyLevel(A_destination);
+    return TimedSend(A_destination, A_associationID, A_node);
+}
@@ -0,0 +1,162 @@
+#include "Definitions.h"
+#include <string>
+
+/****************************************************************************
+ *
+ *  DICOMDIR input
+ *
+ *  With -i the files to send are taken from the records of a DICOMDIR, in
+ *  the patient/study/series order of the directory, instead of from a list
+ *  or a directory tree.  The files are known to be in the Part 10 format,
+ *  so their format is not checked, and the SOP Class UID of each file and
+ *  the Study Instance UID of its study record are taken from the
+ *  directory, so sending by study (-g) does not read their headers either.
+ *  The files are then not opened until they are sent, which on slow
+ *  removable media saves reading the header of every file twice.
+ *
+ *  The Referenced File ID of a record is relative to the directory holding
+ *  the DICOMDIR.
+ *
+ ****************************************************************************/
+
+/*
+ * State of a traversal of the DICOMDIR records
+ */
+typedef struct dicomdir_walk
+{
+    InstanceNode** list;        /* List the referenced files are added to */
+    std::string    base;        /* Directory holding the DICOMDIR */
+    int            added;       /* Number of files added */
+} DicomDirWalk;
+
+static std::string DirectoryOf(const char* A_path)
+{
+    std::string path(A_path);
+    size_t      slash = path.find_last_of("/\\");
+
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+static void AppendFileIDComponents(int A_recordID, std::string& A_path)
+{
+    char component[STR_LENGTH];
+
+    while (MC_Get_Next_Value_To_String(A_recordID, MC_ATT_REFERENCED_FILE_ID, sizeof(component), component) == MC_NORMAL_COMPLETION)
+    {
+        A_path += "/";
+        A_path += component;
+    }
+}
+
+/*
+ * Only records of instances carry a Referenced File ID
+ */
+static bool GetReferencedFile(int A_recordID, const std::string& A_base, std::string& A_path)
+{
+    char component[STR_LENGTH];
+
+    if (MC_Get_Value_To_String(A_recordID, MC_ATT_REFERENCED_FILE_ID, sizeof(component), component) != MC_NORMAL_COMPLETION)
+        return false;
+
+    A_path = A_base + "/" + component;
+    AppendFileIDComponents(A_recordID, A_path);
+    return A_path.size() < sizeof(((InstanceNode*)0)->fname);
+}
+
+static bool IsStudyRecord(int A_recordID)
+{
+    MC_DIR_RECORD_TYPE recordType;
+
+    return MC_DDH_Get_Record_Type(A_recordID, &recordType) == MC_NORMAL_COMPLETION && recordType == MC_REC_TYPE_STUDY;
+}
+
+/*
+ * The study record is above the series record of the instance
+ */
+static int StudyRecordOf(int A_recordID)
+{
+    int recordID = A_recordID;
+
+    while (!IsStudyRecord(recordID))
+    {
+        if (MC_DDH_Get_Parent_Record(recordID, &recordID) != MC_NORMAL_COMPLETION)
+            return -1;
+    }
+    return recordID;
+}
+
+static void PrefillStudy(int A_recordID, InstanceNode* A_node)
+{
+    int studyID = StudyRecordOf(A_recordID);
+
+    if (studyID == -1 || MC_Get_Value_To_String(studyID, MC_ATT_STUDY_INSTANCE_UID, sizeof(A_node->studyUID), A_node->studyUID) != MC_NORMAL_COMPLETION)
+        A_node->studyUID[0] = '\0';
+}
+
+/*
+ * The SOP Instance UID and transfer syntax are read with the file, so
+ * only what is wanted before it is read is taken from the records
+ */
+static void PrefillNode(int A_recordID, InstanceNode* A_node)
+{
+    if (MC_Get_Value_To_String(A_recordID, MC_ATT_REFERENCED_SOP_CLASS_UID_IN_FILE, sizeof(A_node->SOPClassUID), A_node->SOPClassUID) != MC_NORMAL_COMPLETION)
+        A_node->SOPClassUID[0] = '\0';
+    PrefillStudy(A_recordID, A_node);
+
+    /*
+     * Files referenced by a DICOMDIR are Part 10 files
+     */
+    A_node->format = MEDIA_FORMAT;
+    A_node->formatChecked = SAMP_TRUE;
+}
+
+static MC_TRAVERSAL_STATUS NOEXP_FUNC AddDirectoryRecord(int A_recordID, void* A_userData)
+{
+    DicomDirWalk* walk = (DicomDirWalk*)A_userData;
+    std::string   path;
+
+    if (GetReferencedFile(A_recordID, walk->base, path) && AddFileToList(walk->list, &path[0]))
+    {
+        PrefillNode(A_recordID, GetListTail(*walk->list));
+        walk->added++;
+    }
+    return MC_TS_CONTINUE;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReadDicomDir
+ *
+ *  Parameters  :   A_list     - List of nodes to add the files to
+ *                  A_path     - Name of the DICOMDIR file
+ *
+ *  Returns     :   true if the DICOMDIR was read
+ *                  false if it could not be opened or read
+ *
+ *  Description :   Add the files referenced by the DICOMDIR to the list in
+ *                  the order of its records.  Files that cannot be found
+ *                  are left out with a warning.
+ *
+ ****************************************************************************/
+bool ReadDicomDir(InstanceNode** A_list, const char* A_path)
+{
+    int          dirID = -1;
+    DicomDirWalk walk = { A_list, DirectoryOf(A_path), 0 };
+    MC_STATUS    mcStatus;
+
+    mcStatus = MC_DDH_Open(A_path, &dirID);
+    if (mcStatus != MC_NORMAL_COMPLETION)
+    {
+        PrintError("Unable to open DICOMDIR", mcStatus);
+        return false;
+    }
+
+    mcStatus = MC_DDH_Traverse_Records(dirID, &walk, AddDirectoryRecord);
+    if (mcStatus != MC_NORMAL_COMPLETION)
+    {
+        PrintError("Unable to read the DICOMDIR records", mcStatus);
+    }
+    MC_Free_File(&dirID);
+    LogMessage(LOG_LEVEL_INFO, "%d files referenced by %s\n", walk.added, A_path);
+    return mcStatus == MC_NORMAL_COMPLETION;
+}
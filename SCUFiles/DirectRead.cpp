@@ -0,0 +1,232 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Direct reads
+ *
+ *  Objects of at least the direct read threshold (-o) are read with
+ *  O_DIRECT into the thread's aligned read buffer, DIRECT_READ_SIZE bytes
+ *  at a time, so that a migration of many large objects does not push the
+ *  rest of the page cache out on a shared server.
+ *
+ *  DirectToFileObj is used in place of MediaToFileObj for these objects.
+ *  When the file system does not accept O_DIRECT, either when the file is
+ *  opened or on its first read, the file is read through MediaToFileObj
+ *  instead.  Where O_DIRECT is not available every file is read that way.
+ *
+ ****************************************************************************/
+
+static size_t DirectThresholdBytes = 0;    /* 0 when direct reads are off */
+static thread_local bool DirectNextFile = false;
+
+#if defined(_WIN32) || !defined(O_DIRECT)
+static int OpenDirect(const char* A_filename)
+{
+    return -1;
+}
+
+static long ReadDirect(int A_fd, char* A_buffer, size_t A_length)
+{
+    return -1;
+}
+
+static void CloseDirect(int A_fd)
+{
+}
+#else
+static int OpenDirect(const char* A_filename)
+{
+    return open(A_filename, O_RDONLY | O_DIRECT);
+}
+
+static long ReadDirect(int A_fd, char* A_buffer, size_t A_length)
+{
+    return (long)read(A_fd, A_buffer, A_length);
+}
+
+static void CloseDirect(int A_fd)
+{
+    close(A_fd);
+}
+#endif
+
+/****************************************************************************
+ *
+ *  Function    :   DirectReadInit
+ *
+ *  Parameters  :   A_thresholdMB - Objects of at least this size are read
+ *                                  with O_DIRECT, 0 to never do so
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void DirectReadInit(int A_thresholdMB)
+{
+    DirectThresholdBytes = A_thresholdMB > 0 ? (size_t)A_thresholdMB * 1024 * 1024 : 0;
+}
+
+bool ShouldReadDirect(size_t A_fileBytes)
+{
+    return DirectThresholdBytes > 0 && A_fileBytes >= DirectThresholdBytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ApplyDirectRead
+ *
+ *  Parameters  :   A_direct   - true to read the next file opened with
+ *                               OpenFileObject with O_DIRECT
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void ApplyDirectRead(bool A_direct)
+{
+    DirectNextFile = A_direct;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   GetFileReadCallback
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   The MC_Open_File callback for the next file
+ *
+ ****************************************************************************/
+FileReadCallback GetFileReadCallback(void)
+{
+    return DirectNextFile ? DirectToFileObj : MediaToFileObj;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   CloseDirectRead
+ *
+ *  Parameters  :   A_callbackInfo - Read state used by DirectToFileObj
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Close the file if it is being read with O_DIRECT.
+ *                  Safe to call more than once.
+ *
+ ****************************************************************************/
+void CloseDirectRead(CBinfo& A_callbackInfo)
+{
+    if (A_callbackInfo.direct)
+        CloseDirect(A_callbackInfo.fd);
+    A_callbackInfo.direct = SAMP_FALSE;
+}
+
+static bool OpenDirectFile(const char* A_filename, CBinfo* A_info)
+{
+    A_info->buffer = GetReadBuffer(DIRECT_READ_SIZE);
+    if (!A_info->buffer)
+        return false;
+    A_info->fd = OpenDirect(A_filename);
+    if (A_info->fd < 0)
+        return false;
+    A_info->bufferLength = DIRECT_READ_SIZE;
+    return true;
+}
+
+static void StartDirectRead(const char* A_filename, CBinfo* A_info)
+{
+    if (!A_info)
+        return;
+    A_info->bytesRead = 0;
+    A_info->reads = 0;
+    A_info->readSeconds = 0;
+    A_info->direct = (SAMP_BOOLEAN)OpenDirectFile(A_filename, A_info);
+    if (!A_info->direct)
+        LogMessage(LOG_LEVEL_DEBUG, "O_DIRECT not available for %s, reading through the page cache\n", A_filename);
+}
+
+static bool ReadingDirect(const CBinfo* A_info)
+{
+    return A_info && A_info->direct;
+}
+
+/*
+ * Some file systems accept O_DIRECT when the file is opened and reject
+ * the reads, in which case the file is read from the start with
+ * MediaToFileObj.
+ */
+static MC_STATUS ReadBuffered(char* A_filename, CBinfo* A_info, int* A_dataSize, void** A_dataBuffer, int* A_isLast)
+{
+    CloseDirectRead(*A_info);
+    LogMessage(LOG_LEVEL_DEBUG, "O_DIRECT read rejected for %s, reading through the page cache\n", A_filename);
+    return MediaToFileObj(A_filename, A_info, A_dataSize, A_dataBuffer, 1, A_isLast);
+}
+
+/*
+ * Every read but the last fills the buffer, so the file offset stays
+ * aligned as O_DIRECT requires and a short read marks the end of the file.
+ */
+static MC_STATUS DeliverDirectChunk(CBinfo* A_info, long A_bytes, int* A_dataSize, void** A_dataBuffer, int* A_isLast)
+{
+    if (A_bytes < 0)
+    {
+        CloseDirectRead(*A_info);
+        return MC_CANNOT_COMPLY;
+    }
+    A_info->bytesRead += (size_t)A_bytes;
+    *A_isLast = (size_t)A_bytes < A_info->bufferLength;
+    if (*A_isLast)
+    {
+        CloseDirectRead(*A_info);
+        RecordFileRead(A_info);
+    }
+
+    *A_dataBuffer = A_info->buffer;
+    *A_dataSize = (int)A_bytes;
+    return MC_NORMAL_COMPLETION;
+}
+
+static MC_STATUS ReadDirectChunk(char* A_filename, CBinfo* A_info, int* A_dataSize, void** A_dataBuffer, int* A_isLast)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long bytes = ReadDirect(A_info->fd, A_info->buffer, A_info->bufferLength);
+    A_info->readSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    A_info->reads++;
+
+    if (bytes < 0 && A_info->bytesRead == 0)
+        return ReadBuffered(A_filename, A_info, A_dataSize, A_dataBuffer, A_isLast);
+    return DeliverDirectChunk(A_info, bytes, A_dataSize, A_dataBuffer, A_isLast);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   DirectToFileObj
+ *
+ *  Parameters  :   A_fileName   - Filename to open for reading
+ *                  A_userInfo   - CBinfo of the file being read
+ *                  A_dataSize   - Number of bytes read
+ *                  A_dataBuffer - Pointer to buffer of data read
+ *                  A_isFirst    - Set to non-zero value on first call
+ *                  A_isLast     - Set to 1 when file has been completely
+ *                                 read
+ *
+ *  Returns     :   MC_NORMAL_COMPLETION on success
+ *                  any other MC_STATUS value on failure.
+ *
+ *  Description :   Callback function used by MC_Open_File to read a file
+ *                  in the DICOM Part 10 (media) format with O_DIRECT,
+ *                  falling back to MediaToFileObj.
+ *
+ ****************************************************************************/
+MC_STATUS NOEXP_FUNC DirectToFileObj(char* A_filename,
+    void* A_userInfo,
+    int* A_dataSize,
+    void** A_dataBuffer,
+    int       A_isFirst,
+    int* A_isLast)
+{
+    CBinfo* callbackInfo = (CBinfo*)A_userInfo;
+
+    if (A_isFirst)
+        StartDirectRead(A_filename, callbackInfo);
+    if (!ReadingDirect(callbackInfo))
+        return MediaToFileObj(A_filename, A_userInfo, A_dataSize, A_dataBuffer, A_isFirst, A_isLast);
+    return ReadDirectChunk(A_filename, callbackInfo, A_dataSize, A_dataBuffer, A_isLast);
+} /* DirectToFileObj() */
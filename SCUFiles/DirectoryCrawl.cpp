@@ -0,0 +1,419 @@
+#include "Definitions.h"
+#include <deque>
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ *
+ *  Directory crawl
+ *
+ *  With -d the files to send are found by walking a directory tree on
+ *  CRAWL_THREADS threads.  Each thread keeps its own queue of directories
+ *  still to be read; it takes the newest directory from its own queue and,
+ *  once that is empty, steals the oldest one from another thread, so a
+ *  deep patient/study/series tree keeps every thread busy.
+ *
+ *  Each directory is read in a single pass and the entry type it returns
+ *  is used where available, so only files are opened.  Files with the
+ *  DICM signature are queued for the sender, which adds them to the
+ *  instance list when it reaches the end of the list, so sending starts
+ *  while the crawl goes on.  At most CRAWL_QUEUE_FILES files wait in the
+ *  queue; the threads wait for the sender beyond that.
+ *
+ *  Links to directories are not followed, so a link cannot make the crawl
+ *  loop.
+ *
+ ****************************************************************************/
+
+typedef enum
+{
+    CRAWL_SKIP,
+    CRAWL_FILE,
+    CRAWL_DIRECTORY
+} CRAWL_ENTRY;
+
+/*
+ * Directories still to be read by one thread
+ */
+typedef struct crawl_queue
+{
+    std::mutex              lock;
+    std::deque<std::string> directories;
+} CrawlQueue;
+
+static CrawlQueue               CrawlQueues[CRAWL_THREADS];
+static std::thread*             CrawlThreads[CRAWL_THREADS];
+static std::atomic<long>        CrawlPending(0);        /* directories queued or being read */
+static std::atomic<long>        CrawlQueued(0);         /* directories queued */
+static std::atomic<bool>        CrawlRunning(false);
+static std::mutex               CrawlLock;
+static std::condition_variable  CrawlFound;             /* files queued or crawl finished */
+static std::condition_variable  CrawlRoom;              /* the sender took the queued files */
+static std::condition_variable  CrawlWork;              /* directory queued or crawl finished */
+static std::vector<std::string> CrawlFiles;             /* found, not yet in the instance list */
+
+static bool IsDotEntry(const char* A_name)
+{
+    return strcmp(A_name, ".") == 0 || strcmp(A_name, "..") == 0;
+}
+
+static void PushDirectory(int A_index, const std::string& A_path)
+{
+    CrawlPending++;
+    {
+        std::lock_guard<std::mutex> lock(CrawlQueues[A_index].lock);
+        CrawlQueues[A_index].directories.push_back(A_path);
+    }
+    CrawlQueued++;
+    std::lock_guard<std::mutex> lock(CrawlLock);
+    CrawlWork.notify_one();
+}
+
+static bool PopOwnDirectory(int A_index, std::string& A_path)
+{
+    std::lock_guard<std::mutex> lock(CrawlQueues[A_index].lock);
+    if (CrawlQueues[A_index].directories.empty())
+        return false;
+    A_path = CrawlQueues[A_index].directories.back();
+    CrawlQueues[A_index].directories.pop_back();
+    CrawlQueued--;
+    return true;
+}
+
+static bool StealFrom(int A_index, std::string& A_path)
+{
+    std::lock_guard<std::mutex> lock(CrawlQueues[A_index].lock);
+    if (CrawlQueues[A_index].directories.empty())
+        return false;
+    A_path = CrawlQueues[A_index].directories.front();
+    CrawlQueues[A_index].directories.pop_front();
+    CrawlQueued--;
+    return true;
+}
+
+static bool StealDirectory(int A_index, std::string& A_path)
+{
+    for (int i = 1; i < CRAWL_THREADS; i++)
+    {
+        if (StealFrom((A_index + i) % CRAWL_THREADS, A_path))
+            return true;
+    }
+    return false;
+}
+
+static bool CrawlHasWork()
+{
+    return CrawlRunning && CrawlPending > 0;
+}
+
+static bool DirectoryQueued()
+{
+    return CrawlQueued > 0 || !CrawlHasWork();
+}
+
+static bool PopAnyDirectory(int A_index, std::string& A_path)
+{
+    return PopOwnDirectory(A_index, A_path) || StealDirectory(A_index, A_path);
+}
+
+/*
+ * A thread with nothing to do waits while other threads are still reading
+ * directories that may contain more.
+ */
+static bool TakeDirectory(int A_index, std::string& A_path)
+{
+    while (CrawlHasWork())
+    {
+        if (PopAnyDirectory(A_index, A_path))
+            return true;
+        std::unique_lock<std::mutex> lock(CrawlLock);
+        CrawlWork.wait(lock, DirectoryQueued);
+    }
+    return false;
+}
+
+static void FinishDirectory()
+{
+    if (--CrawlPending == 0)
+    {
+        std::lock_guard<std::mutex> lock(CrawlLock);
+        CrawlFound.notify_all();
+        CrawlWork.notify_all();
+    }
+}
+
+static bool QueueHasRoom()
+{
+    return !CrawlRunning || CrawlFiles.size() < CRAWL_QUEUE_FILES;
+}
+
+static void QueueFile(const std::string& A_path)
+{
+    std::unique_lock<std::mutex> lock(CrawlLock);
+    CrawlRoom.wait(lock, QueueHasRoom);
+    CrawlFiles.push_back(A_path);
+    CrawlFound.notify_one();
+}
+
+static void AddFoundFile(const std::string& A_path)
+{
+    char fname[sizeof(((InstanceNode*)0)->fname)];
+
+    if (A_path.size() >= sizeof(fname))
+    {
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Path too long, file will not be sent [%s]\n", A_path.c_str());
+        return;
+    }
+    strcpy(fname, A_path.c_str());
+    if (CheckFileFormat(fname) == MEDIA_FORMAT)
+        QueueFile(A_path);
+}
+
+static void AddEntry(int A_index, const std::string& A_path, CRAWL_ENTRY A_kind)
+{
+    if (A_kind == CRAWL_DIRECTORY)
+        PushDirectory(A_index, A_path);
+    else if (A_kind == CRAWL_FILE)
+        AddFoundFile(A_path);
+}
+
+#ifdef _WIN32
+static CRAWL_ENTRY EntryKind(const struct _finddata_t& A_entry)
+{
+    return (A_entry.attrib & _A_SUBDIR) ? CRAWL_DIRECTORY : CRAWL_FILE;
+}
+
+static bool MoreEntries(int A_status)
+{
+    return A_status == 0 && CrawlRunning;
+}
+
+static void ReadDirectory(int A_index, const std::string& A_path)
+{
+    struct _finddata_t entry;
+    intptr_t           handle = _findfirst((A_path + "/*").c_str(), &entry);
+    int                status = handle == -1 ? -1 : 0;
+
+    for (; MoreEntries(status); status = _findnext(handle, &entry))
+    {
+        if (!IsDotEntry(entry.name))
+            AddEntry(A_index, A_path + "/" + entry.name, EntryKind(entry));
+    }
+    if (handle != -1)
+        _findclose(handle);
+}
+#else
+static CRAWL_ENTRY KindOfMode(mode_t A_mode)
+{
+    if (S_ISDIR(A_mode))
+        return CRAWL_DIRECTORY;
+    return S_ISREG(A_mode) ? CRAWL_FILE : CRAWL_SKIP;
+}
+
+static CRAWL_ENTRY LinkKind(const std::string& A_path)
+{
+    struct stat info;
+
+    return (stat(A_path.c_str(), &info) == 0 && S_ISREG(info.st_mode)) ? CRAWL_FILE : CRAWL_SKIP;
+}
+
+static CRAWL_ENTRY UnknownKind(const std::string& A_path)
+{
+    struct stat info;
+
+    if (lstat(A_path.c_str(), &info) != 0)
+        return CRAWL_SKIP;
+    return KindOfMode(info.st_mode);
+}
+
+/*
+ * The type returned with the entry saves a stat() on file systems that
+ * fill it in
+ */
+static CRAWL_ENTRY EntryKind(const struct dirent* A_entry, const std::string& A_path)
+{
+    if (A_entry->d_type == DT_UNKNOWN)
+        return UnknownKind(A_path);
+    if (A_entry->d_type == DT_LNK)
+        return LinkKind(A_path);
+    return KindOfMode(DTTOIF(A_entry->d_type));
+}
+
+static void AddDirectoryEntry(int A_index, const std::string& A_path, const struct dirent* A_entry)
+{
+    std::string path = A_path + "/" + A_entry->d_name;
+
+    if (!IsDotEntry(A_entry->d_name))
+        AddEntry(A_index, path, EntryKind(A_entry, path));
+}
+
+static void ReadEntries(int A_index, const std::string& A_path, DIR* A_dir)
+{
+    for (struct dirent* entry = readdir(A_dir); entry && CrawlRunning; entry = readdir(A_dir))
+        AddDirectoryEntry(A_index, A_path, entry);
+}
+
+static void ReadDirectory(int A_index, const std::string& A_path)
+{
+    DIR* dir = opendir(A_path.c_str());
+
+    if (!dir)
+    {
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Cannot read directory: %s\n", A_path.c_str());
+        return;
+    }
+    ReadEntries(A_index, A_path, dir);
+    closedir(dir);
+}
+#endif
+
+static void CrawlWorker(int A_index)
+{
+    std::string path;
+
+    while (TakeDirectory(A_index, path))
+    {
+        ReadDirectory(A_index, path);
+        FinishDirectory();
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   CrawlStart
+ *
+ *  Parameters  :   A_path     - Root of the directory tree to send
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Start the crawl threads.  Files found are added to the
+ *                  instance list by CrawlAppendFiles.
+ *
+ ****************************************************************************/
+void CrawlStart(const char* A_path)
+{
+    CrawlRunning = true;
+    PushDirectory(0, A_path);
+    for (int i = 0; i < CRAWL_THREADS; i++)
+    {
+        CrawlThreads[i] = new std::thread(CrawlWorker, i);
+    }
+}
+
+/*
+ * Called once every thread has ended
+ */
+static void ClearCrawlQueues()
+{
+    for (int i = 0; i < CRAWL_THREADS; i++)
+    {
+        CrawlQueues[i].directories.clear();
+    }
+    CrawlPending = 0;
+    CrawlQueued = 0;
+    CrawlFiles.clear();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   CrawlStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Stop the crawl threads, whether or not the crawl has
+ *                  finished.  Safe to call when no crawl was started.
+ *
+ ****************************************************************************/
+void CrawlStop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(CrawlLock);
+        CrawlRunning = false;
+    }
+    CrawlRoom.notify_all();
+    CrawlFound.notify_all();
+    CrawlWork.notify_all();
+    for (int i = 0; i < CRAWL_THREADS; i++)
+    {
+        if (CrawlThreads[i])
+            CrawlThreads[i]->join();
+        delete CrawlThreads[i];
+        CrawlThreads[i] = NULL;
+    }
+    ClearCrawlQueues();
+}
+
+static bool CrawlHasFiles()
+{
+    return !CrawlFiles.empty() || !CrawlHasWork();
+}
+
+/*
+ * The crawl checked the signature of every file it queued, so the sender
+ * does not open it again for its format, see GetNodeFormat()
+ */
+static void MarkMediaFormat(InstanceNode* A_node)
+{
+    A_node->format = MEDIA_FORMAT;
+    A_node->formatChecked = SAMP_TRUE;
+}
+
+static int AddCrawledFiles(InstanceNode** A_list, std::vector<std::string>& A_files)
+{
+    int count = 0;
+
+    for (size_t i = 0; i < A_files.size(); i++)
+    {
+        if (AddFileToList(A_list, &A_files[i][0]))
+        {
+            MarkMediaFormat(GetListTail(*A_list));
+            count++;
+        }
+    }
+    return count;
+}
+
+/*
+ * Returns false once the crawl has finished and every file found has
+ * been taken
+ */
+static bool TakeCrawledFiles(std::vector<std::string>& A_files)
+{
+    {
+        std::unique_lock<std::mutex> lock(CrawlLock);
+        CrawlFound.wait(lock, CrawlHasFiles);
+        A_files.clear();
+        A_files.swap(CrawlFiles);
+    }
+    CrawlRoom.notify_all();
+    return !A_files.empty();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   CrawlAppendFiles
+ *
+ *  Parameters  :   A_list     - List of nodes to add the files to
+ *
+ *  Returns     :   Number of files added, 0 once the crawl has finished
+ *                  and every file found has been added
+ *
+ *  Description :   Wait until the crawl has found more files and add them
+ *                  to the end of the list.
+ *
+ ****************************************************************************/
+int CrawlAppendFiles(InstanceNode** A_list)
+{
+    std::vector<std::string> files;
+    int                      count = 0;
+
+    do
+    {
+        if (!TakeCrawledFiles(files))
+            return 0;
+        count = AddCrawledFiles(A_list, files);
+    } while (count == 0);
+    return count;
+}
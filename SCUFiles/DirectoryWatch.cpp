@@ -0,0 +1,289 @@
+#include "Definitions.h"
+#include <signal.h>
+#include <string>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+/****************************************************************************
+ *
+ *  Directory watch
+ *
+ *  With -w the SCU keeps running and sends the files written to a
+ *  directory as they arrive, instead of a list made once at start up.
+ *  The kernel reports each file closed after writing (IN_CLOSE_WRITE) or
+ *  renamed into the directory (IN_MOVED_TO).  A file is ready once it has
+ *  been left closed for WATCH_SETTLE_MS; a write to it in that time
+ *  (IN_MODIFY) holds it back until it is closed again, so a file written
+ *  in several passes is not sent half written.
+ *
+ *  Once a file is ready, the files that become ready in the next
+ *  WATCH_BATCH_MS are sent with it, up to WATCH_BATCH_FILES, over the
+ *  association left open by the previous batch.
+ *
+ *  Only files with the DICM signature are sent.  Files already in the
+ *  directory when the watch starts and files in its subdirectories are
+ *  not.  The watch needs inotify; elsewhere WatchStart fails.
+ *
+ ****************************************************************************/
+
+/*
+ * A file the kernel reported, waiting to settle
+ */
+typedef struct watch_file
+{
+    std::chrono::steady_clock::time_point lastEvent; /* time of the last event for the file */
+    bool                                  closed;    /* closed by the writer since that event */
+} WatchFile;
+
+static std::map<std::string, WatchFile> WatchPending;
+static std::string                      WatchedPath;
+static int                              WatchFd = -1;
+static volatile sig_atomic_t            WatchInterrupted = 0;
+
+static void InterruptWatch(int A_signal)
+{
+    WatchInterrupted = 1;
+}
+
+static void NoteFile(const std::string& A_path, bool A_closed)
+{
+    WatchFile file = { std::chrono::steady_clock::now(), A_closed };
+    WatchPending[A_path] = file;
+}
+
+#if defined(__linux__)
+static int OpenWatch(const char* A_path)
+{
+    int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+
+    if (fd >= 0 && inotify_add_watch(fd, A_path, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void CloseWatch(int A_fd)
+{
+    close(A_fd);
+}
+
+/*
+ * Returns the size of the event
+ */
+static size_t NoteEvent(const struct inotify_event* A_event)
+{
+    if (A_event->mask & IN_Q_OVERFLOW)
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Too many files arrived at once in %s, some will not be sent\n", WatchedPath.c_str());
+    else if (A_event->len > 0)
+        NoteFile(WatchedPath + "/" + A_event->name, (A_event->mask & IN_MODIFY) == 0);
+    return sizeof(struct inotify_event) + A_event->len;
+}
+
+static bool WaitForEvents(int A_timeoutMs)
+{
+    struct pollfd poller = { WatchFd, POLLIN, 0 };
+
+    return poll(&poller, 1, A_timeoutMs) > 0;
+}
+
+static void ReadWatchEvents(int A_timeoutMs)
+{
+    alignas(struct inotify_event) char buffer[64 * 1024];
+
+    if (!WaitForEvents(A_timeoutMs))
+        return;
+    ssize_t length = read(WatchFd, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < length; )
+        offset += (ssize_t)NoteEvent((const struct inotify_event*)(buffer + offset));
+}
+#else
+static int OpenWatch(const char* A_path)
+{
+    LogMessage(LOG_LEVEL_ERROR, "Watching a directory is not supported on this platform\n");
+    return -1;
+}
+
+static void CloseWatch(int A_fd)
+{
+}
+
+static void ReadWatchEvents(int A_timeoutMs)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(A_timeoutMs));
+}
+#endif
+
+/****************************************************************************
+ *
+ *  Function    :   WatchStart
+ *
+ *  Parameters  :   A_path     - Directory to watch
+ *
+ *  Returns     :   true if the directory is watched
+ *                  false if it cannot be
+ *
+ *  Description :   Start collecting the files written to the directory.
+ *                  An interrupt or termination signal ends the watch.
+ *
+ ****************************************************************************/
+bool WatchStart(const char* A_path)
+{
+    WatchedPath = A_path;
+    WatchFd = OpenWatch(A_path);
+    if (WatchFd < 0)
+    {
+        LogMessage(LOG_LEVEL_ERROR, "ERROR: Unable to watch %s.\n", A_path);
+        return false;
+    }
+    WatchInterrupted = 0;
+    signal(SIGINT, InterruptWatch);
+    signal(SIGTERM, InterruptWatch);
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   WatchStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Stop the watch.  Files not yet collected are dropped.
+ *                  Safe to call when no watch was started.
+ *
+ ****************************************************************************/
+void WatchStop(void)
+{
+    if (WatchFd >= 0)
+        CloseWatch(WatchFd);
+    WatchFd = -1;
+    WatchPending.clear();
+}
+
+bool WatchRunning(void)
+{
+    return WatchFd >= 0 && !WatchInterrupted;
+}
+
+static bool IsSettled(const WatchFile& A_file)
+{
+    return A_file.closed && std::chrono::steady_clock::now() - A_file.lastEvent >= std::chrono::milliseconds(WATCH_SETTLE_MS);
+}
+
+/*
+ * Temporary files renamed before they settle are gone by now; files
+ * without the DICM signature are left alone.
+ */
+static bool IsWatchedDicomFile(std::string& A_path)
+{
+    return A_path.size() < sizeof(((InstanceNode*)0)->fname) && CheckFileFormat(&A_path[0]) == MEDIA_FORMAT;
+}
+
+static int AddWatchedFile(InstanceNode** A_list, std::string A_path)
+{
+    if (!IsWatchedDicomFile(A_path))
+        return 0;
+    return AddFileToList(A_list, &A_path[0]) ? 1 : 0;
+}
+
+static std::map<std::string, WatchFile>::iterator AddIfSettled(InstanceNode** A_list, std::map<std::string, WatchFile>::iterator A_file, int& A_count)
+{
+    if (!IsSettled(A_file->second))
+        return ++A_file;
+    A_count += AddWatchedFile(A_list, A_file->first);
+    return WatchPending.erase(A_file);
+}
+
+static int AddSettledFiles(InstanceNode** A_list)
+{
+    int count = 0;
+
+    for (std::map<std::string, WatchFile>::iterator file = WatchPending.begin(); file != WatchPending.end(); )
+        file = AddIfSettled(A_list, file, count);
+    return count;
+}
+
+static bool BatchFull(int A_added)
+{
+    return A_added >= WATCH_BATCH_FILES || WatchInterrupted;
+}
+
+static bool KeepCollecting(int A_added, std::chrono::steady_clock::time_point A_deadline)
+{
+    return !BatchFull(A_added) && std::chrono::steady_clock::now() < A_deadline;
+}
+
+/*
+ * Files waiting to settle are checked every WATCH_POLL_MS; otherwise the
+ * kernel is waited on until the deadline
+ */
+static int PollTimeout(std::chrono::steady_clock::time_point A_deadline)
+{
+    long long left = std::chrono::duration_cast<std::chrono::milliseconds>(A_deadline - std::chrono::steady_clock::now()).count();
+
+    left = std::max(left, 0LL);
+    return (int)(WatchPending.empty() ? left : std::min(left, (long long)WATCH_POLL_MS));
+}
+
+static void StartBatchWindow(int A_added, int A_found, std::chrono::steady_clock::time_point& A_deadline)
+{
+    if (A_added == 0 && A_found > 0)
+        A_deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(WATCH_BATCH_MS);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   WatchCollect
+ *
+ *  Parameters  :   A_list     - List of nodes to add the files to
+ *                  A_waitMs   - Longest time to wait for the first file
+ *
+ *  Returns     :   Number of files added, 0 if none was ready in time or
+ *                  the watch was interrupted
+ *
+ *  Description :   Wait for a file to be ready and add it to the end of
+ *                  the list together with the files that become ready in
+ *                  the following WATCH_BATCH_MS.
+ *
+ ****************************************************************************/
+int WatchCollect(InstanceNode** A_list, int A_waitMs)
+{
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(A_waitMs);
+    int                                   added = 0;
+
+    while (KeepCollecting(added, deadline))
+    {
+        ReadWatchEvents(PollTimeout(deadline));
+        int found = AddSettledFiles(A_list);
+        StartBatchWindow(added, found, deadline);
+        added += found;
+    }
+    return added;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   WatchRequeue
+ *
+ *  Parameters  :   A_list     - Batch whose association failed
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Collect the files of the batch that were not
+ *                  acknowledged again, so they go with a later batch.
+ *
+ ****************************************************************************/
+void WatchRequeue(InstanceNode* A_list)
+{
+    for (InstanceNode* node = A_list; node; node = node->Next)
+    {
+        if (!node->responseReceived)
+            NoteFile(node->fname, true);
+    }
+}
@@ -0,0 +1,201 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  File probe
+ *
+ *  Worker threads check the format of the upcoming files of the instance
+ *  list (the DICM signature after the preamble) while earlier files are
+ *  sent, so ReadImage() finds the format already known instead of waiting
+ *  on the check on the send path.  This is a prefetch, not a saving: each
+ *  file is still opened and its first 132 bytes read once, only on
+ *  another thread.  A worker takes PROBE_BATCH files at a time so that it
+ *  takes the lock once per batch rather than once per file.
+ *
+ *  The workers stay at most PROBE_AHEAD files in front of the sender, so
+ *  that on spinning disks they do not compete with the files being sent.
+ *
+ ****************************************************************************/
+
+static std::mutex              ProbeLock;
+static std::condition_variable ProbeWindowOpen;
+static std::condition_variable ProbeBatchDone;
+static InstanceNode*           ProbeCursor = NULL;
+static bool                    ProbeRunning = false;
+static unsigned long           ProbeTaken = 0;      /* files handed to workers */
+static unsigned long           ProbeConsumed = 0;   /* formats asked for by the sender */
+static int                     ProbeInFlight = 0;   /* files taken and not yet checked */
+static std::thread*            ProbeThreads[PROBE_THREADS];
+
+static bool ProbeMayContinue()
+{
+    return !ProbeRunning || ProbeTaken < ProbeConsumed + PROBE_AHEAD;
+}
+
+/*
+ * Called with ProbeLock held
+ */
+static int FillProbeBatch(InstanceNode** A_batch)
+{
+    int count = 0;
+
+    while (ProbeCursor && count < PROBE_BATCH)
+    {
+        A_batch[count++] = ProbeCursor;
+        ProbeCursor = ProbeCursor->Next;
+    }
+    ProbeTaken += count;
+    ProbeInFlight += count;
+    return count;
+}
+
+/*
+ * A_done is the size of the batch the worker has just checked
+ */
+static int TakeProbeBatch(InstanceNode** A_batch, int A_done)
+{
+    std::unique_lock<std::mutex> lock(ProbeLock);
+    ProbeInFlight -= A_done;
+    ProbeBatchDone.notify_all();
+    ProbeWindowOpen.wait(lock, ProbeMayContinue);
+    return ProbeRunning ? FillProbeBatch(A_batch) : 0;
+}
+
+static void StoreProbeResult(InstanceNode* A_node, FORMAT_ENUM A_format)
+{
+    std::lock_guard<std::mutex> lock(ProbeLock);
+    A_node->format = A_format;
+    A_node->formatChecked = SAMP_TRUE;
+}
+
+/*
+ * Nodes whose format is already known, e.g. from a DICOMDIR, are skipped
+ */
+static void ProbeNode(InstanceNode* A_node)
+{
+    if (A_node->formatChecked)
+        return;
+    StoreProbeResult(A_node, CheckFileFormat(A_node->fname));
+}
+
+static void ProbeWorker()
+{
+    InstanceNode* batch[PROBE_BATCH];
+    int           count = TakeProbeBatch(batch, 0);
+
+    while (count > 0)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            ProbeNode(batch[i]);
+        }
+        count = TakeProbeBatch(batch, count);
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ProbeStart
+ *
+ *  Parameters  :   A_list     - Head of the instance list
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Start the workers, beginning with the first file.
+ *
+ ****************************************************************************/
+void ProbeStart(InstanceNode* A_list)
+{
+    {
+        std::lock_guard<std::mutex> lock(ProbeLock);
+        ProbeCursor = A_list;
+        ProbeRunning = true;
+        ProbeTaken = ProbeConsumed = 0;
+        ProbeInFlight = 0;
+    }
+    for (int i = 0; i < PROBE_THREADS; i++)
+    {
+        ProbeThreads[i] = new std::thread(ProbeWorker);
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ProbeStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Stop the workers once their current batch is done.
+ *                  Must be called before the instance list is freed.
+ *
+ ****************************************************************************/
+void ProbeStop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(ProbeLock);
+        ProbeRunning = false;
+    }
+    ProbeWindowOpen.notify_all();
+    for (int i = 0; i < PROBE_THREADS; i++)
+    {
+        if (ProbeThreads[i])
+            ProbeThreads[i]->join();
+        delete ProbeThreads[i];
+        ProbeThreads[i] = NULL;
+    }
+}
+
+/*
+ * Called holding ProbeLock
+ */
+static bool ProbeCaughtUp()
+{
+    bool canTakeMore = ProbeRunning && ProbeCursor && ProbeMayContinue();
+
+    return ProbeInFlight == 0 && !canTakeMore;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ProbeWait
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Wait until the workers have checked every file they
+ *                  may take, up to the end of the list or PROBE_AHEAD
+ *                  files in front of the sender.
+ *
+ ****************************************************************************/
+void ProbeWait(void)
+{
+    std::unique_lock<std::mutex> lock(ProbeLock);
+    ProbeBatchDone.wait(lock, ProbeCaughtUp);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   GetNodeFormat
+ *
+ *  Parameters  :   A_node     - The node about to be read
+ *
+ *  Returns     :   FORMAT_ENUM of the node's file
+ *
+ *  Description :   Return the format found by the workers, or check the
+ *                  file now if they have not reached it yet.
+ *
+ ****************************************************************************/
+FORMAT_ENUM GetNodeFormat(InstanceNode* A_node)
+{
+    {
+        std::lock_guard<std::mutex> lock(ProbeLock);
+        ProbeConsumed++;
+        ProbeWindowOpen.notify_all();
+        if (A_node->formatChecked)
+            return A_node->format;
+    }
+    return CheckFileFormat(A_node->fname);
+}
@@ -0,0 +1,439 @@
+#include "HeaderScan.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+/****************************************************************************
+ *
+ *  Part 10 header scanner
+ *
+ *  Reads the UIDs of a DICOM Part 10 file, and where its pixel data is,
+ *  without the toolkit making a file object of it.  The preamble and the
+ *  meta group are read, then the element headers of the dataset are walked
+ *  in explicit or implicit VR little endian up to the pixel data: only the
+ *  values kept are read, the others are stepped over in the read buffer or
+ *  with a seek, and sequences of undefined length are walked item by item
+ *  to their delimiter.  So the cost of a file is its number of elements,
+ *  not its size.
+ *
+ *  A dataset in big endian or deflated is not walked; only the meta group
+ *  of those files is read.  Nothing here uses the toolkit, so the scanner
+ *  builds and runs without it.
+ *
+ ****************************************************************************/
+
+#define SCAN_BUFFER_BYTES (64 * 1024)   /* bytes read from the file at once */
+#define SCAN_MAX_DEPTH 32               /* sequences nested deeper are taken as a damaged file */
+
+/*
+ * A file being walked
+ */
+typedef struct scan_reader
+{
+    FILE*                      fp;        /* The file */
+    std::vector<unsigned char> buffer;    /* bytes read ahead */
+    size_t                     start;     /* first byte of the buffer not walked yet */
+    size_t                     end;       /* end of the bytes read into the buffer */
+    long long                  offset;    /* file offset of the start of the buffer */
+    long long                  size;      /* size of the file */
+    bool                       damaged;   /* a value ran past the end of the file or its sequence */
+} ScanReader;
+
+/*
+ * An attribute kept, and where it is kept
+ */
+typedef struct scan_field
+{
+    unsigned long tag;      /* group << 16 | element */
+    size_t        offset;   /* offset of the field in Part10Header */
+} ScanField;
+
+static const ScanField ScanFields[] =
+{
+    { 0x00020002UL, offsetof(Part10Header, sopClassUID) },
+    { 0x00020003UL, offsetof(Part10Header, sopInstanceUID) },
+    { 0x00020010UL, offsetof(Part10Header, transferSyntaxUID) },
+    { 0x00080016UL, offsetof(Part10Header, sopClassUID) },
+    { 0x00080018UL, offsetof(Part10Header, sopInstanceUID) },
+    { 0x0020000DUL, offsetof(Part10Header, studyUID) },
+    { 0x0020000EUL, offsetof(Part10Header, seriesUID) },
+};
+
+static const unsigned long ScanPixelDataTag = 0x7FE00010UL;
+static const unsigned long ScanItemTag = 0xFFFEE000UL;
+static const unsigned long ScanItemDelimiterTag = 0xFFFEE00DUL;
+static const unsigned long ScanSequenceDelimiterTag = 0xFFFEE0DDUL;
+
+static const char         ImplicitLittleEndianUID[] = "1.2.840.10008.1.2";
+static const char* const  UnscannedSyntaxUIDs[] =
+{
+    "1.2.840.10008.1.2.2",      /* Explicit VR Big Endian */
+    "1.2.840.10008.1.2.1.99",   /* Deflated Explicit VR Little Endian */
+};
+
+/*
+ * VRs whose length takes 4 bytes after 2 reserved ones
+ */
+static const char LongLengthVRs[] = "OBODOFOLOVOWSQSVUCUNURUTUV";
+
+static unsigned Read16(const unsigned char* A_bytes)
+{
+    return A_bytes[0] | (A_bytes[1] << 8);
+}
+
+static unsigned long Read32(const unsigned char* A_bytes)
+{
+    return (unsigned long)A_bytes[0] | ((unsigned long)A_bytes[1] << 8) | ((unsigned long)A_bytes[2] << 16) | ((unsigned long)A_bytes[3] << 24);
+}
+
+static size_t Available(const ScanReader& A_reader)
+{
+    return A_reader.end - A_reader.start;
+}
+
+static long long Position(const ScanReader& A_reader)
+{
+    return A_reader.offset + (long long)A_reader.start;
+}
+
+static const unsigned char* Current(const ScanReader& A_reader)
+{
+    return &A_reader.buffer[A_reader.start];
+}
+
+/*
+ * Makes A_bytes (at most SCAN_BUFFER_BYTES) available from the current
+ * position, moving what is left to the front of the buffer
+ */
+static bool Fill(ScanReader& A_reader, size_t A_bytes)
+{
+    if (Available(A_reader) >= A_bytes)
+        return true;
+    memmove(&A_reader.buffer[0], Current(A_reader), Available(A_reader));
+    A_reader.offset += (long long)A_reader.start;
+    A_reader.end -= A_reader.start;
+    A_reader.start = 0;
+    A_reader.end += fread(&A_reader.buffer[A_reader.end], 1, A_reader.buffer.size() - A_reader.end, A_reader.fp);
+    return Available(A_reader) >= A_bytes;
+}
+
+static bool SeekTo(FILE* A_fp, long long A_offset)
+{
+#ifdef _WIN32
+    return _fseeki64(A_fp, A_offset, SEEK_SET) == 0;
+#else
+    return fseeko(A_fp, (off_t)A_offset, SEEK_SET) == 0;
+#endif
+}
+
+static long long FileSize(FILE* A_fp)
+{
+#ifdef _WIN32
+    long long size = _fseeki64(A_fp, 0, SEEK_END) == 0 ? _ftelli64(A_fp) : -1;
+#else
+    long long size = fseeko(A_fp, 0, SEEK_END) == 0 ? (long long)ftello(A_fp) : -1;
+#endif
+    rewind(A_fp);
+    return size;
+}
+
+/*
+ * Always returns false, for the reads that fail because of the damage
+ */
+static bool Damaged(ScanReader& A_reader)
+{
+    A_reader.damaged = true;
+    return false;
+}
+
+/*
+ * A seek past the end of the file succeeds, so the length of a value
+ * running past it is checked against the size of the file
+ */
+static bool Skip(ScanReader& A_reader, unsigned long A_bytes)
+{
+    if (A_bytes <= Available(A_reader))
+    {
+        A_reader.start += A_bytes;
+        return true;
+    }
+    long long target = Position(A_reader) + (long long)A_bytes;
+    if (target > A_reader.size)
+        return Damaged(A_reader);
+    A_reader.offset = target;
+    A_reader.start = A_reader.end = 0;
+    return SeekTo(A_reader.fp, target);
+}
+
+static bool HasLongLength(const unsigned char* A_vr)
+{
+    for (size_t i = 0; LongLengthVRs[i]; i += 2)
+    {
+        if (A_vr[0] == LongLengthVRs[i] && A_vr[1] == LongLengthVRs[i + 1])
+            return true;
+    }
+    return false;
+}
+
+/*
+ * The item and delimiter tags have no VR in any syntax
+ */
+static bool HasVR(bool A_explicit, unsigned long A_tag)
+{
+    return A_explicit && (A_tag >> 16) != 0xFFFE;
+}
+
+static bool ReadExplicitLength(ScanReader& A_reader, unsigned long* A_length)
+{
+    if (!HasLongLength(Current(A_reader) + 4))
+    {
+        *A_length = Read16(Current(A_reader) + 6);
+        A_reader.start += 8;
+        return true;
+    }
+    if (!Fill(A_reader, 12))
+        return false;
+    *A_length = Read32(Current(A_reader) + 8);
+    A_reader.start += 12;
+    return true;
+}
+
+/*
+ * Reads the header of the next element, leaving the reader on its value
+ */
+static bool ReadElement(ScanReader& A_reader, bool A_explicit, unsigned long* A_tag, unsigned long* A_length)
+{
+    if (!Fill(A_reader, 8))
+        return false;
+    *A_tag = ((unsigned long)Read16(Current(A_reader)) << 16) | Read16(Current(A_reader) + 2);
+    if (HasVR(A_explicit, *A_tag))
+        return ReadExplicitLength(A_reader, A_length);
+    *A_length = Read32(Current(A_reader) + 4);
+    A_reader.start += 8;
+    return true;
+}
+
+static bool SkipUntil(ScanReader& A_reader, bool A_explicit, unsigned long A_delimiter, int A_depth);
+
+static unsigned long ClosingTag(unsigned long A_tag)
+{
+    return A_tag == ScanItemTag ? ScanItemDelimiterTag : ScanSequenceDelimiterTag;
+}
+
+/*
+ * A value of undefined length is a sequence, an item or encapsulated pixel
+ * data, and ends with the matching delimiter
+ */
+static bool SkipValue(ScanReader& A_reader, bool A_explicit, unsigned long A_tag, unsigned long A_length, int A_depth)
+{
+    if (A_length != SCAN_UNDEFINED_LENGTH)
+        return Skip(A_reader, A_length);
+    if (A_depth >= SCAN_MAX_DEPTH)
+        return Damaged(A_reader);
+    return SkipUntil(A_reader, A_explicit, ClosingTag(A_tag), A_depth + 1);
+}
+
+static bool NextElement(ScanReader& A_reader, bool A_explicit, unsigned long* A_tag, unsigned long* A_length, unsigned long A_delimiter)
+{
+    return ReadElement(A_reader, A_explicit, A_tag, A_length) && *A_tag != A_delimiter;
+}
+
+static bool SkipUntil(ScanReader& A_reader, bool A_explicit, unsigned long A_delimiter, int A_depth)
+{
+    unsigned long tag = 0;
+    unsigned long length = 0;
+
+    while (NextElement(A_reader, A_explicit, &tag, &length, A_delimiter))
+    {
+        if (!SkipValue(A_reader, A_explicit, tag, length, A_depth))
+            return false;
+    }
+    return tag == A_delimiter || Damaged(A_reader);
+}
+
+static char* FieldFor(Part10Header* A_header, unsigned long A_tag)
+{
+    for (size_t i = 0; i < sizeof(ScanFields) / sizeof(ScanFields[0]); i++)
+    {
+        if (ScanFields[i].tag == A_tag)
+            return (char*)A_header + ScanFields[i].offset;
+    }
+    return NULL;
+}
+
+/*
+ * A field already set, from the meta group, is kept
+ */
+static bool WantValue(const char* A_field, unsigned long A_length)
+{
+    return A_field && !A_field[0] && A_length <= SCAN_UID_LENGTH;
+}
+
+static void TrimValue(char* A_value)
+{
+    size_t length = strlen(A_value);
+
+    while (length > 0 && A_value[length - 1] == ' ')
+        A_value[--length] = '\0';
+}
+
+static bool ReadValue(ScanReader& A_reader, unsigned long A_length, char* A_field)
+{
+    if (!Fill(A_reader, A_length))
+        return Damaged(A_reader);
+    memcpy(A_field, Current(A_reader), A_length);
+    A_field[A_length] = '\0';
+    TrimValue(A_field);
+    A_reader.start += A_length;
+    return true;
+}
+
+static bool TakeValue(ScanReader& A_reader, Part10Header* A_header, bool A_explicit, unsigned long A_tag, unsigned long A_length)
+{
+    char* field = FieldFor(A_header, A_tag);
+
+    if (WantValue(field, A_length))
+        return ReadValue(A_reader, A_length, field);
+    return SkipValue(A_reader, A_explicit, A_tag, A_length, 0);
+}
+
+static bool ReadPreamble(ScanReader& A_reader)
+{
+    if (!Fill(A_reader, 132) || memcmp(Current(A_reader) + 128, "DICM", 4) != 0)
+        return false;
+    A_reader.start += 132;
+    return true;
+}
+
+static bool InMetaGroup(ScanReader& A_reader)
+{
+    return Fill(A_reader, 2) && Read16(Current(A_reader)) == 0x0002;
+}
+
+static bool MetaElement(ScanReader& A_reader, Part10Header* A_header)
+{
+    unsigned long tag;
+    unsigned long length;
+
+    return ReadElement(A_reader, true, &tag, &length) && TakeValue(A_reader, A_header, true, tag, length);
+}
+
+/*
+ * The meta group is always explicit VR little endian
+ */
+static bool WalkMeta(ScanReader& A_reader, Part10Header* A_header)
+{
+    while (InMetaGroup(A_reader))
+    {
+        if (!MetaElement(A_reader, A_header))
+            return false;
+    }
+    return A_header->transferSyntaxUID[0] != '\0';
+}
+
+static bool ReadMeta(ScanReader& A_reader, Part10Header* A_header)
+{
+    return ReadPreamble(A_reader) && WalkMeta(A_reader, A_header);
+}
+
+static bool DatasetScannable(const char* A_syntaxUID)
+{
+    for (size_t i = 0; i < sizeof(UnscannedSyntaxUIDs) / sizeof(UnscannedSyntaxUIDs[0]); i++)
+    {
+        if (strcmp(A_syntaxUID, UnscannedSyntaxUIDs[i]) == 0)
+            return false;
+    }
+    return true;
+}
+
+/*
+ * Encapsulated pixel data is not walked, so only its fragments can be cut
+ * short unseen
+ */
+static void CheckPixelData(ScanReader& A_reader, unsigned long A_length)
+{
+    if (A_length != SCAN_UNDEFINED_LENGTH && Position(A_reader) + (long long)A_length > A_reader.size)
+        Damaged(A_reader);
+}
+
+/*
+ * Returns false once the walk is over: at the pixel data, the end of the
+ * file or an element that cannot be read
+ */
+static bool DatasetElement(ScanReader& A_reader, Part10Header* A_header, bool A_explicit)
+{
+    unsigned long tag;
+    unsigned long length;
+
+    if (!ReadElement(A_reader, A_explicit, &tag, &length))
+        return false;
+    if (tag == ScanPixelDataTag)
+    {
+        A_header->pixelDataOffset = Position(A_reader);
+        A_header->pixelDataLength = length;
+        CheckPixelData(A_reader, length);
+        return false;
+    }
+    return TakeValue(A_reader, A_header, A_explicit, tag, length);
+}
+
+static bool AtEnd(ScanReader& A_reader)
+{
+    return Available(A_reader) == 0 && feof(A_reader.fp);
+}
+
+static void WalkDataset(ScanReader& A_reader, Part10Header* A_header)
+{
+    bool isExplicit = strcmp(A_header->transferSyntaxUID, ImplicitLittleEndianUID) != 0;
+
+    while (DatasetElement(A_reader, A_header, isExplicit))
+        ;
+    A_header->datasetScanned = !A_reader.damaged && (A_header->pixelDataOffset != SCAN_NO_PIXEL_DATA || AtEnd(A_reader));
+}
+
+static bool ScanFile(ScanReader& A_reader, Part10Header* A_header)
+{
+    if (!ReadMeta(A_reader, A_header))
+        return false;
+    if (DatasetScannable(A_header->transferSyntaxUID))
+        WalkDataset(A_reader, A_header);
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ScanPart10Header
+ *
+ *  Parameters  :   A_filename - File to scan
+ *                  A_header   - Set to what was read of the file
+ *
+ *  Returns     :   true if the file is in the Part 10 format and its meta
+ *                  group was read
+ *                  false if it cannot be opened, has no DICM signature or
+ *                  no transfer syntax
+ *
+ *  Description :   Read the meta group and the key UIDs of the file, and
+ *                  where its pixel data is.  datasetScanned is set when
+ *                  the dataset was walked to the pixel data or its end; a
+ *                  dataset cut short, where a value runs past the end of
+ *                  the file, leaves it unset with the UIDs found before.
+ *
+ ****************************************************************************/
+bool ScanPart10Header(const char* A_filename, Part10Header* A_header)
+{
+    ScanReader reader;
+
+    memset(A_header, 0, sizeof(*A_header));
+    A_header->pixelDataOffset = SCAN_NO_PIXEL_DATA;
+    reader.fp = fopen(A_filename, "rb");
+    if (!reader.fp)
+        return false;
+    reader.buffer.resize(SCAN_BUFFER_BYTES);
+    reader.start = reader.end = 0;
+    reader.offset = 0;
+    reader.size = FileSize(reader.fp);
+    reader.damaged = false;
+    bool scanned = ScanFile(reader, A_header);
+    fclose(reader.fp);
+    return scanned;
+}
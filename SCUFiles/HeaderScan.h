@@ -0,0 +1,32 @@
+#ifndef HEADER_SCAN_H
+#define HEADER_SCAN_H
+
+/*
+ * Native Part 10 header scanner, see HeaderScan.cpp.  Uses neither the
+ * toolkit nor Definitions.h, so it builds and is tested on its own.
+ */
+#include <stddef.h>
+
+#define SCAN_UID_LENGTH 64              /* longest UID kept */
+#define SCAN_NO_PIXEL_DATA (-1LL)       /* pixelDataOffset when the dataset has none */
+#define SCAN_UNDEFINED_LENGTH 0xFFFFFFFFUL
+
+/*
+ * What is read of a DICOM Part 10 file without opening it with the toolkit.
+ * The UIDs of the meta group are kept over those of the dataset.
+ */
+typedef struct part10_header
+{
+    char          transferSyntaxUID[SCAN_UID_LENGTH + 1];  /* (0002,0010) */
+    char          sopClassUID[SCAN_UID_LENGTH + 1];        /* (0002,0002), else (0008,0016) */
+    char          sopInstanceUID[SCAN_UID_LENGTH + 1];     /* (0002,0003), else (0008,0018) */
+    char          studyUID[SCAN_UID_LENGTH + 1];           /* (0020,000D) */
+    char          seriesUID[SCAN_UID_LENGTH + 1];          /* (0020,000E) */
+    bool          datasetScanned;                          /* false when only the meta group could be read */
+    long long     pixelDataOffset;                         /* file offset of the pixel data value, SCAN_NO_PIXEL_DATA if none */
+    unsigned long pixelDataLength;                         /* its length, SCAN_UNDEFINED_LENGTH when encapsulated */
+} Part10Header;
+
+bool ScanPart10Header(const char* A_filename, Part10Header* A_header);
+
+#endif
@@ -0,0 +1,282 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Large data store policy
+ *
+ *  The toolkit keeps attributes larger than LARGE_DATA_SIZE either in
+ *  memory or in temporary files (LARGE_DATA_STORE = MEM | FILE).  Instead
+ *  of one setting for the whole run, the store is chosen for each message
+ *  before it is read: large objects, and any object read while the memory
+ *  budget is under pressure, are spilled to temporary files.  The store
+ *  is a setting of the toolkit, while files are read on several threads
+ *  (-j, and the workers of -u and -z), so each read holds the store it
+ *  chose from LargeDataStoreBeginRead to LargeDataStoreEndRead.  Reads
+ *  wanting the same store run together; the store is only changed once
+ *  the reads using the other one have finished.
+ *
+ *  Temporary files go to a directory of their own below the scratch path
+ *  (-t), which is emptied and removed when the application ends.
+ *
+ ****************************************************************************/
+
+static size_t SpillThresholdBytes = (size_t)DEFAULT_SPILL_THRESHOLD_MB * 1024 * 1024;
+static bool   SpillAlways = false;      /* mergecom.pro asks for FILE */
+static int    CurrentStoreInFile = -1;  /* last value given to the toolkit */
+static int    StoreReaders = 0;         /* files being read with CurrentStoreInFile */
+static int    StoreWaiters[2] = { 0 };  /* reads waiting, by store wanted */
+static std::mutex              StoreLock;   /* the three above */
+static std::condition_variable StoreFree;
+static thread_local bool       StoreNextInFile = false;
+static char   SpillDirectory[1024] = { 0 };
+
+static bool LargeDataStoredInFile()
+{
+    char store[STR_LENGTH] = { 0 };
+
+    if (MC_Get_String_Config_Value(LARGE_DATA_STORE, sizeof(store), store) != MC_NORMAL_COMPLETION)
+        return false;
+    return strcmp(store, "FILE") == 0;
+}
+
+#ifdef _WIN32
+static int MakeDirectory(const char* A_path)
+{
+    return _mkdir(A_path);
+}
+
+static int RemoveEmptyDirectory(const char* A_path)
+{
+    return _rmdir(A_path);
+}
+
+static int GetProcessId()
+{
+    return _getpid();
+}
+
+static void RemoveDirectoryFiles(const char* A_path)
+{
+    char                pattern[1100];
+    char                path[1400];
+    struct _finddata_t  entry;
+    intptr_t            handle;
+
+    sprintf(pattern, "%s\\*", A_path);
+    handle = _findfirst(pattern, &entry);
+    if (handle == -1)
+        return;
+    do
+    {
+        sprintf(path, "%s\\%s", A_path, entry.name);
+        remove(path);
+    } while (_findnext(handle, &entry) == 0);
+    _findclose(handle);
+}
+#else
+static int MakeDirectory(const char* A_path)
+{
+    return mkdir(A_path, 0700);
+}
+
+static int RemoveEmptyDirectory(const char* A_path)
+{
+    return rmdir(A_path);
+}
+
+static int GetProcessId()
+{
+    return (int)getpid();
+}
+
+static void RemoveDirectoryEntries(DIR* A_dir, const char* A_path)
+{
+    char            path[1400];
+    struct dirent*  entry;
+
+    for (entry = readdir(A_dir); entry; entry = readdir(A_dir))
+    {
+        snprintf(path, sizeof(path), "%s/%s", A_path, entry->d_name);
+        remove(path);
+    }
+}
+
+static void RemoveDirectoryFiles(const char* A_path)
+{
+    DIR* dir = opendir(A_path);
+    if (!dir)
+        return;
+    RemoveDirectoryEntries(dir, A_path);
+    closedir(dir);
+}
+#endif
+
+static bool CreateSpillDirectory(const char* A_scratchPath)
+{
+    snprintf(SpillDirectory, sizeof(SpillDirectory), "%s/scu_%d", A_scratchPath, GetProcessId());
+    if (MakeDirectory(SpillDirectory) != 0)
+    {
+        LogMessage(LOG_LEVEL_WARNING, "Warning: unable to create temporary file directory %s\n", SpillDirectory);
+        SpillDirectory[0] = '\0';
+        return false;
+    }
+    return true;
+}
+
+static void UseScratchPath(const char* A_scratchPath)
+{
+    if (A_scratchPath[0] && CreateSpillDirectory(A_scratchPath))
+    {
+        MC_Set_String_Config_Value(TEMP_FILE_DIRECTORY, SpillDirectory);
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LargeDataStoreInit
+ *
+ *  Parameters  :   A_scratchPath - Directory for temporary files, empty
+ *                                  to keep TEMP_FILE_DIRECTORY
+ *                  A_thresholdMB - Objects of at least this size always
+ *                                  use temporary files, 0 for the default
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Read the configured LARGE_DATA_STORE and point
+ *                  TEMP_FILE_DIRECTORY to a directory of this run.  Must
+ *                  be called after MC_Library_Initialization.
+ *
+ ****************************************************************************/
+void LargeDataStoreInit(const char* A_scratchPath, int A_thresholdMB)
+{
+    size_t thresholdMB = A_thresholdMB > 0 ? (size_t)A_thresholdMB : DEFAULT_SPILL_THRESHOLD_MB;
+
+    SpillThresholdBytes = thresholdMB * 1024 * 1024;
+    SpillAlways = LargeDataStoredInFile();
+    CurrentStoreInFile = (int)SpillAlways;
+    UseScratchPath(A_scratchPath);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ShouldSpillToFile
+ *
+ *  Parameters  :   A_fileBytes - Size of the file about to be read
+ *
+ *  Returns     :   true if the large attributes of the object should be
+ *                  kept in temporary files
+ *
+ *  Description :   An object is spilled when it is at least the spill
+ *                  threshold, or when reading it into memory would take the
+ *                  memory budget above SPILL_PRESSURE_PERCENT.
+ *
+ ****************************************************************************/
+bool ShouldSpillToFile(size_t A_fileBytes)
+{
+    size_t pressureLimit = MemoryBudgetLimit() / 100 * SPILL_PRESSURE_PERCENT;
+
+    if (SpillAlways || A_fileBytes >= SpillThresholdBytes)
+        return true;
+    return MemoryBudgetInUse() + A_fileBytes > pressureLimit;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ApplyLargeDataStore
+ *
+ *  Parameters  :   A_inFile   - true to keep large attributes in files
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Select the store of the next message read on this
+ *                  thread.  It is given to the toolkit by
+ *                  LargeDataStoreBeginRead.
+ *
+ ****************************************************************************/
+void ApplyLargeDataStore(bool A_inFile)
+{
+    StoreNextInFile = A_inFile;
+}
+
+// Called holding StoreLock
+static void SetStore(bool A_inFile)
+{
+    if (CurrentStoreInFile == (int)A_inFile)
+        return;
+
+    MC_STATUS mcStatus = MC_Set_String_Config_Value(LARGE_DATA_STORE, (char*)(A_inFile ? "FILE" : "MEM"));
+    CheckIfMCStatusNotOk(mcStatus, "Unable to set LARGE_DATA_STORE");
+    CurrentStoreInFile = (int)A_inFile;
+}
+
+/*
+ * A read of the store in use waits while another waits to change it, so
+ * a steady stream of reads cannot keep the other store out
+ */
+// Called holding StoreLock
+static bool StoreUsable(bool A_inFile)
+{
+    if (StoreReaders == 0)
+        return true;
+    return CurrentStoreInFile == (int)A_inFile && StoreWaiters[!A_inFile] == 0;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LargeDataStoreBeginRead
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Set LARGE_DATA_STORE to the store selected on this
+ *                  thread with ApplyLargeDataStore, waiting for the reads
+ *                  using the other store to finish, and keep it until
+ *                  LargeDataStoreEndRead.  Called around the MC_Open_File
+ *                  of each message.
+ *
+ ****************************************************************************/
+void LargeDataStoreBeginRead(void)
+{
+    std::unique_lock<std::mutex> lock(StoreLock);
+    bool                         inFile = StoreNextInFile;
+
+    StoreWaiters[inFile]++;
+    StoreFree.wait(lock, [inFile] { return StoreUsable(inFile); });
+    StoreWaiters[inFile]--;
+    SetStore(inFile);
+    StoreReaders++;
+}
+
+void LargeDataStoreEndRead(void)
+{
+    std::lock_guard<std::mutex> lock(StoreLock);
+
+    StoreReaders--;
+    StoreFree.notify_all();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LargeDataStoreCleanup
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Remove temporary files left behind and the directory of
+ *                  this run.  Called after every message has been freed.
+ *
+ ****************************************************************************/
+void LargeDataStoreCleanup(void)
+{
+    if (!SpillDirectory[0])
+        return;
+
+    RemoveDirectoryFiles(SpillDirectory);
+    if (RemoveEmptyDirectory(SpillDirectory) != 0)
+    {
+        LogMessage(LOG_LEVEL_WARNING, "Warning: unable to remove temporary file directory %s\n", SpillDirectory);
+    }
+    SpillDirectory[0] = '\0';
+}
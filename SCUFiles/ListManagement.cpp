@@ -19,11 +19,11 @@
 SAMP_BOOLEAN AddFileToList(InstanceNode** A_list, char* A_fname)
 {
     InstanceNode* newNode;
+    struct stat   fileInfo;
 
-    ifstream fin(A_fname);
-    if (fin.fail())
+    if (stat(A_fname, &fileInfo) != 0)
     {
-        cout << "Warning: Cannot find file: " << A_fname << endl;
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Cannot find file: %s\n", A_fname);
         return(SAMP_FALSE);
     }
 
@@ -44,13 +44,35 @@ SAMP_BOOLEAN AddFileToList(InstanceNode** A_list, char* A_fname)
     newNode->imageSent = SAMP_FALSE;
     newNode->msgID = -1;
     newNode->transferSyntax = IMPLICIT_LITTLE_ENDIAN;
+    newNode->action = STORE_ACTION_CONTINUE;
+    newNode->fileBytes = (size_t)fileInfo.st_size;
     list_updation(A_list, newNode);
 
     return (SAMP_TRUE);
 }
+/*
+ * The tail of the list last added to, so adding a file does not walk the
+ * whole list
+ */
+static InstanceNode* TailListHead = NULL;
+static InstanceNode* TailNode = NULL;
+
+static InstanceNode* TailSearchStart(InstanceNode* A_head)
+{
+    return (A_head == TailListHead && TailNode) ? TailNode : A_head;
+}
+
+static InstanceNode* FindTail(InstanceNode* A_head)
+{
+    InstanceNode* listNode = TailSearchStart(A_head);
+
+    while (listNode->Next)
+        listNode = listNode->Next;
+    return listNode;
+}
+
 void list_updation(InstanceNode** A_list, InstanceNode* newNode)
 {
-    InstanceNode* listNode;
     if (!*A_list)
     {
         /*
@@ -64,13 +86,41 @@ void list_updation(InstanceNode** A_list, InstanceNode* newNode)
         /*
          * Add to the tail of the list
          */
-        listNode = *A_list;
+        FindTail(*A_list)->Next = newNode;
+    }
+    TailListHead = *A_list;
+    TailNode = newNode;
+}
 
-        while (listNode->Next)
-            listNode = listNode->Next;
+/****************************************************************************
+ *
+ *  Function    :   ResetListTail
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Forget the tail of the list last added to.  Called when
+ *                  nodes are moved between lists.
+ *
+ ****************************************************************************/
+void ResetListTail(void)
+{
+    TailListHead = TailNode = NULL;
+}
 
-        listNode->Next = newNode;
-    }
+/****************************************************************************
+ *
+ *  Function    :   GetListTail
+ *
+ *  Parameters  :   A_list     - Head of the list
+ *
+ *  Returns     :   The last node of the list, NULL if it is empty
+ *
+ ****************************************************************************/
+InstanceNode* GetListTail(InstanceNode* A_list)
+{
+    return A_list ? FindTail(A_list) : NULL;
 }
 
 /****************************************************************************
@@ -126,6 +176,7 @@ void FreeList(InstanceNode** A_list)
     /*
      * Free the instance list
      */
+    TailListHead = TailNode = NULL;
     while (*A_list)
     {
         node = *A_list;
@@ -165,3 +216,156 @@ int GetNumNodes(InstanceNode* A_list)
 
     return numNodes;
 }
+
+
+/****************************************************************************
+ *
+ *  Function    :   IsRetryRequested
+ *
+ *  Parameters  :   A_node     - node to check
+ *
+ *  Returns     :   true if the response status asked for the instance to
+ *                  be sent again, false otherwise
+ *
+ ****************************************************************************/
+static bool IsRetryRequested(InstanceNode* A_node)
+{
+    return A_node->action == STORE_ACTION_RETRY_LATER || A_node->action == STORE_ACTION_RETRY_NEW_ASSOCIATION;
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   GetNumRetryRequests
+ *
+ *  Parameters  :   A_list     - Pointer to head of node list to get count for
+ *
+ *  Returns     :   int, num instances to be sent again
+ *
+ *  Description :   Counts the instances whose response status asked for
+ *                  them to be sent again.
+ *
+ ****************************************************************************/
+int GetNumRetryRequests(InstanceNode* A_list)
+{
+    int            retryRequests = 0;
+    InstanceNode* node;
+
+    for (node = A_list; node; node = node->Next)
+    {
+        if (IsRetryRequested(node))
+            retryRequests++;
+    }
+    return retryRequests;
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   NeedsNewAssociation
+ *
+ *  Parameters  :   A_list     - Pointer to head of node list to check
+ *
+ *  Returns     :   true if any instance must be sent again on a new
+ *                  association, false otherwise
+ *
+ ****************************************************************************/
+bool NeedsNewAssociation(InstanceNode* A_list)
+{
+    InstanceNode* node;
+
+    for (node = A_list; node; node = node->Next)
+    {
+        if (node->action == STORE_ACTION_RETRY_NEW_ASSOCIATION)
+            return true;
+    }
+    return false;
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   PrepareNodeForRetry
+ *
+ *  Parameters  :   A_node     - node to send again
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Reset the send and response state of an instance
+ *                  before it is sent again.
+ *
+ ****************************************************************************/
+void PrepareNodeForRetry(InstanceNode* A_node)
+{
+    A_node->retryCount++;
+    A_node->action = STORE_ACTION_CONTINUE;
+    A_node->imageSent = SAMP_FALSE;
+    A_node->responseReceived = SAMP_FALSE;
+    A_node->failedResponse = SAMP_FALSE;
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   IsUnacknowledged
+ *
+ *  Parameters  :   A_node     - node to check
+ *
+ *  Returns     :   true if the instance was sent, or read to be sent,
+ *                  and no response was received, false otherwise
+ *
+ ****************************************************************************/
+static bool IsUnacknowledged(InstanceNode* A_node)
+{
+    return !A_node->responseReceived && (A_node->imageSent || A_node->msgID != -1);
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   RequeueNode
+ *
+ *  Parameters  :   A_node     - node to send again
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+static void RequeueNode(InstanceNode* A_node)
+{
+    if (A_node->msgID != -1)
+        FreeNodeMessage(A_node);
+    ReleaseNodeMemory(A_node);
+    A_node->imageSent = SAMP_FALSE;
+    A_node->action = STORE_ACTION_RETRY_NEW_ASSOCIATION;
+}
+
+
+/****************************************************************************
+ *
+ *  Function    :   RequeueUnacknowledged
+ *
+ *  Parameters  :   A_list     - Pointer to head of node list
+ *
+ *  Returns     :   int, number of instances to be sent again
+ *
+ *  Description :   After an association failed, free the messages of the
+ *                  instances sent or being sent over it without a
+ *                  response, and mark them to be sent again on a new
+ *                  association.
+ *
+ ****************************************************************************/
+int RequeueUnacknowledged(InstanceNode* A_list)
+{
+    int            requeued = 0;
+    InstanceNode* node;
+
+    for (node = A_list; node; node = node->Next)
+    {
+        if (IsUnacknowledged(node))
+        {
+            RequeueNode(node);
+            requeued++;
+        }
+    }
+    return requeued;
+}
@@ -0,0 +1,223 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Asynchronous logger
+ *
+ *  Messages are formatted by the calling thread into a slot of a bounded
+ *  lock-free ring buffer (multi-producer, single consumer) and written to
+ *  stdout by a background writer thread, which flushes once per batch.
+ *  The send path therefore never waits on terminal or pipe I/O.
+ *
+ *  When the ring is full, errors, warnings and info messages wait for a
+ *  free slot while debug messages are dropped and counted.  Before LogStart()
+ *  and after LogStop() messages are written synchronously.
+ *
+ ****************************************************************************/
+
+#define LOG_SLOTS 512               /* must be a power of two */
+#define LOG_SLOT_SIZE 1024          /* longer messages are truncated */
+#define LOG_IDLE_WAIT_MS 2          /* writer sleep when the ring is empty */
+
+typedef struct log_slot
+{
+    std::atomic<size_t> sequence;   /* position the slot is ready for */
+    char text[LOG_SLOT_SIZE];
+} LogSlot;
+
+typedef enum
+{
+    CLAIM_OK = 0,
+    CLAIM_RETRY,
+    CLAIM_FULL
+} CLAIM_RESULT;
+
+static LogSlot LogRing[LOG_SLOTS];
+static std::atomic<size_t> LogEnqueuePos(0);
+static size_t LogDequeuePos = 0;    /* only used by the writer thread */
+static std::atomic<bool> LogRunning(false);
+static std::atomic<unsigned long> LogDropped(0);
+static LOG_LEVEL LogLevel = LOG_LEVEL_INFO;
+static std::thread* LogWriter = NULL;
+
+static CLAIM_RESULT ClaimMiss(intptr_t A_diff, size_t& A_pos)
+{
+    if (A_diff < 0)
+    {
+        return CLAIM_FULL;
+    }
+    A_pos = LogEnqueuePos.load(std::memory_order_relaxed);
+    return CLAIM_RETRY;
+}
+
+static CLAIM_RESULT TryClaimSlot(size_t& A_pos, LogSlot*& A_slot)
+{
+    A_slot = &LogRing[A_pos & (LOG_SLOTS - 1)];
+    intptr_t diff = (intptr_t)A_slot->sequence.load(std::memory_order_acquire) - (intptr_t)A_pos;
+    if (diff != 0)
+    {
+        return ClaimMiss(diff, A_pos);
+    }
+    return LogEnqueuePos.compare_exchange_weak(A_pos, A_pos + 1, std::memory_order_relaxed) ? CLAIM_OK : CLAIM_RETRY;
+}
+
+static LogSlot* ClaimSlot(size_t& A_pos)
+{
+    LogSlot* slot = NULL;
+    CLAIM_RESULT result = CLAIM_RETRY;
+
+    A_pos = LogEnqueuePos.load(std::memory_order_relaxed);
+    while (result == CLAIM_RETRY)
+    {
+        result = TryClaimSlot(A_pos, slot);
+    }
+    return result == CLAIM_OK ? slot : NULL;
+}
+
+static LogSlot* ClaimSlotForLevel(LOG_LEVEL A_level, size_t& A_pos)
+{
+    LogSlot* slot = ClaimSlot(A_pos);
+    while (slot == NULL && A_level <= LOG_LEVEL_INFO)
+    {
+        std::this_thread::yield();
+        slot = ClaimSlot(A_pos);
+    }
+    return slot;
+}
+
+static void LogEnqueue(LOG_LEVEL A_level, const char* A_format, va_list A_args)
+{
+    size_t   pos;
+    LogSlot* slot = ClaimSlotForLevel(A_level, pos);
+    if (slot == NULL)
+    {
+        LogDropped++;
+        return;
+    }
+    vsnprintf(slot->text, LOG_SLOT_SIZE, A_format, A_args);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+static bool WriteNextRecord()
+{
+    LogSlot* slot = &LogRing[LogDequeuePos & (LOG_SLOTS - 1)];
+    if (slot->sequence.load(std::memory_order_acquire) != LogDequeuePos + 1)
+    {
+        return false;
+    }
+    fputs(slot->text, stdout);
+    slot->sequence.store(LogDequeuePos + LOG_SLOTS, std::memory_order_release);
+    LogDequeuePos++;
+    return true;
+}
+
+static int DrainRecords()
+{
+    int written = 0;
+    while (WriteNextRecord())
+    {
+        written++;
+    }
+    if (written > 0)
+        fflush(stdout);
+    return written;
+}
+
+static void WriterLoop()
+{
+    while (LogRunning.load(std::memory_order_acquire))
+    {
+        if (DrainRecords() == 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(LOG_IDLE_WAIT_MS));
+    }
+    DrainRecords();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LogStart
+ *
+ *  Parameters  :   A_level    - Most detailed level of messages to write
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Start the writer thread.  From here on LogMessage only
+ *                  queues messages.
+ *
+ ****************************************************************************/
+void LogStart(LOG_LEVEL A_level)
+{
+    LogLevel = A_level;
+    if (LogWriter)
+    {
+        return;
+    }
+    for (size_t i = 0; i < LOG_SLOTS; i++)
+    {
+        LogRing[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    LogEnqueuePos.store(0, std::memory_order_relaxed);
+    LogDequeuePos = 0;
+    LogDropped.store(0);
+    LogRunning.store(true, std::memory_order_release);
+    LogWriter = new std::thread(WriterLoop);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LogStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Write all queued messages and stop the writer thread.
+ *                  Must be called once no other thread logs any more.
+ *
+ ****************************************************************************/
+void LogStop(void)
+{
+    if (!LogWriter)
+    {
+        return;
+    }
+    LogRunning.store(false, std::memory_order_release);
+    LogWriter->join();
+    delete LogWriter;
+    LogWriter = NULL;
+
+    if (LogDropped.load() > 0)
+        printf("Warning: %lu log messages were dropped.\n", LogDropped.load());
+    fflush(stdout);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   LogMessage
+ *
+ *  Parameters  :   A_level    - Level of the message
+ *                  A_format   - printf style format, including the newline
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Queue a message for the writer thread, or write it
+ *                  directly when the writer is not running.  Messages
+ *                  more detailed than the level given to LogStart are
+ *                  discarded before they are formatted.
+ *
+ ****************************************************************************/
+void LogMessage(LOG_LEVEL A_level, const char* A_format, ...)
+{
+    va_list args;
+
+    if (A_level > LogLevel)
+    {
+        return;
+    }
+    va_start(args, A_format);
+    if (LogRunning.load(std::memory_order_acquire))
+        LogEnqueue(A_level, A_format, args);
+    else
+        vprintf(A_format, args);
+    va_end(args);
+}
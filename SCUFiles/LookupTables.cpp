@@ -0,0 +1,248 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Lookup tables used on the per-image path.
+ *
+ *  All tables are constexpr.  A lookup is either a bounds check and an
+ *  array index, or a scan of a short table of fixed size: nothing is
+ *  built or allocated at run time.
+ *
+ ****************************************************************************/
+
+/*
+ * Transfer syntaxes, indexed by SyntaxSlot().  Slot 0 holds the invalid
+ * syntax, slots 1..N follow the TRANSFER_SYNTAX enumeration starting at
+ * IMPLICIT_LITTLE_ENDIAN.  The order is verified at compile time below.
+ */
+static constexpr SyntaxEntry SyntaxTable[] =
+{
+    { INVALID_TRANSFER_SYNTAX, "Invalid Transfer Syntax", false },
+    { IMPLICIT_LITTLE_ENDIAN, "Implicit VR Little Endian", true },
+    { EXPLICIT_LITTLE_ENDIAN, "Explicit VR Little Endian", true },
+    { EXPLICIT_BIG_ENDIAN, "Explicit VR Big Endian", true },
+    { IMPLICIT_BIG_ENDIAN, "Implicit VR Big Endian", true },
+    { DEFLATED_EXPLICIT_LITTLE_ENDIAN, "Deflated Explicit VR Little Endian", true },
+    { RLE, "RLE", true },
+    { JPEG_BASELINE, "JPEG Baseline (Process 1)", true },
+    { JPEG_EXTENDED_2_4, "JPEG Extended (Process 2 & 4)", true },
+    { JPEG_EXTENDED_3_5, "JPEG Extended (Process 3 & 5)", true },
+    { JPEG_SPEC_NON_HIER_6_8, "JPEG Spectral Selection, Non-Hierarchical (Process 6 & 8)", true },
+    { JPEG_SPEC_NON_HIER_7_9, "JPEG Spectral Selection, Non-Hierarchical (Process 7 & 9)", true },
+    { JPEG_FULL_PROG_NON_HIER_10_12, "JPEG Full Progression, Non-Hierarchical (Process 10 & 12)", true },
+    { JPEG_FULL_PROG_NON_HIER_11_13, "JPEG Full Progression, Non-Hierarchical (Process 11 & 13)", true },
+    { JPEG_LOSSLESS_NON_HIER_14, "JPEG Lossless, Non-Hierarchical (Process 14)", true },
+    { JPEG_LOSSLESS_NON_HIER_15, "JPEG Lossless, Non-Hierarchical (Process 15)", true },
+    { JPEG_EXTENDED_HIER_16_18, "JPEG Extended, Hierarchical (Process 16 & 18)", true },
+    { JPEG_EXTENDED_HIER_17_19, "JPEG Extended, Hierarchical (Process 17 & 19)", true },
+    { JPEG_SPEC_HIER_20_22, "JPEG Spectral Selection Hierarchical (Process 20 & 22)", true },
+    { JPEG_SPEC_HIER_21_23, "JPEG Spectral Selection Hierarchical (Process 21 & 23)", true },
+    { JPEG_FULL_PROG_HIER_24_26, "JPEG Full Progression, Hierarchical (Process 24 & 26)", true },
+    { JPEG_FULL_PROG_HIER_25_27, "JPEG Full Progression, Hierarchical (Process 25 & 27)", true },
+    { JPEG_LOSSLESS_HIER_28, "JPEG Lossless, Hierarchical (Process 28)", true },
+    { JPEG_LOSSLESS_HIER_29, "JPEG Lossless, Hierarchical (Process 29)", true },
+    { JPEG_LOSSLESS_HIER_14, "JPEG Lossless, Non-Hierarchical, First-Order Prediction", true },
+    { JPEG_2000_LOSSLESS_ONLY, "JPEG 2000 Lossless Only", true },
+    { JPEG_2000, "JPEG 2000", true },
+    { JPEG_LS_LOSSLESS, "JPEG-LS Lossless", true },
+    { JPEG_LS_LOSSY, "JPEG-LS Lossy (Near Lossless)", true },
+    { MPEG2_MPML, "MPEG2 Main Profile @ Main Level", true },
+    { PRIVATE_SYNTAX_1, "Private Syntax 1", true },
+    { PRIVATE_SYNTAX_2, "Private Syntax 2", true },
+    { JPEG_2000_MC_LOSSLESS_ONLY, "JPEG 2000 Part 2 Multi-component Lossless Only", true },
+    { JPEG_2000_MC, "JPEG 2000 Part 2 Multi-component", true },
+    { MPEG2_MPHL, "MPEG2 Main Profile @ High Level", true },
+    { MPEG4_AVC_H264_HP_LEVEL_4_1, "MPEG-4 AVC/H.264 High Profile / Level 4.1", true },
+    { MPEG4_AVC_H264_BDC_HP_LEVEL_4_1, "MPEG-4 AVC/H.264 BD-compatible High Profile / Level 4.1", true },
+    { MPEG4_AVC_H264_HP_LEVEL_4_2_2D, "MPEG-4 AVC/H.264 High Profile / Level 4.2 For 2D Video", true },
+    { MPEG4_AVC_H264_HP_LEVEL_4_2_3D, "MPEG-4 AVC/H.264 High Profile / Level 4.2 For 3D Video", true },
+    { MPEG4_AVC_H264_STEREO_HP_LEVEL_4_2, "MPEG-4 AVC/H.264 Stereo High Profile / Level 4.2", true },
+    { JPIP_REFERENCED, "JPIP Referenced", true },
+    { JPIP_REFERENCED_DEFLATE, "JPIP Referenced Deflate", true },
+    { HEVC_H265_MP_LEVEL_5_1, "HEVC/H.265 Main Profile / Level 5.1", true },
+    { HEVC_H265_M10P_LEVEL_5_1, "HEVC/H.265 Main 10 Profile / Level 5.1", true },
+    { SMPTE_ST_2110_20_UNCOMPRESSED_PROGRESSIVE_ACTIVE_VIDEO, "SMPTE ST 2110-20 Uncompressed Progressive Active Video", true },
+    { SMPTE_ST_2110_20_UNCOMPRESSED_INTERLACED_ACTIVE_VIDEO, "SMPTE ST 2110-20 Uncompressed Interlaced Active Video", true },
+    { SMPTE_ST_2110_30_PCM_DIGITAL_AUDIO, "SMPTE ST 2110-30 PCM Digital Audio", true },
+};
+
+static constexpr int NUM_SYNTAX_ENTRIES = (int)(sizeof(SyntaxTable) / sizeof(SyntaxTable[0]));
+
+static constexpr bool SyntaxTableOrdered(int i)
+{
+    return i >= NUM_SYNTAX_ENTRIES || ((int)SyntaxTable[i].syntax == IMPLICIT_LITTLE_ENDIAN + i - 1 && SyntaxTableOrdered(i + 1));
+}
+
+static_assert(SyntaxTableOrdered(1), "SyntaxTable must follow the TRANSFER_SYNTAX enumeration order");
+static_assert(SyntaxTable[NUM_SYNTAX_ENTRIES - 1].syntax == SMPTE_ST_2110_30_PCM_DIGITAL_AUDIO, "SyntaxTable is missing transfer syntaxes");
+
+static int SyntaxSlot(int A_syntax)
+{
+    int slot = A_syntax - IMPLICIT_LITTLE_ENDIAN + 1;
+    if (slot < 1 || slot >= NUM_SYNTAX_ENTRIES)
+    {
+        return 0;
+    }
+    return slot;
+}
+
+const SyntaxEntry& LookupSyntax(int A_syntax)
+{
+    return SyntaxTable[SyntaxSlot(A_syntax)];
+}
+
+/****************************************************************************
+ *
+ *  Function    :   GetSyntaxDescription
+ *
+ *  Description :   Return a text description of a DICOM transfer syntax.
+ *                  This is used for display purposes.
+ *
+ ****************************************************************************/
+char* GetSyntaxDescription(TRANSFER_SYNTAX A_syntax)
+{
+    return (char*)LookupSyntax(A_syntax).description;
+}
+
+/*
+ * C-STORE response statuses.  The first entry whose masked value matches
+ * the status wins, so single statuses come before the range they belong
+ * to and the last entry catches everything else.  Each entry has its own
+ * counter in ResponseMessage.cpp, indexed like this table.
+ */
+static constexpr StoreStatusEntry StoreStatusTable[] =
+{
+    { 0xFFFF, 0x0000, "0000", STATUS_CLASS_SUCCESS, STORE_ACTION_CONTINUE,             "C-STORE Success." },
+    { 0xFFFF, 0xB000, "B000", STATUS_CLASS_WARNING, STORE_ACTION_CONTINUE,             "Warning: Element Coersion... Continuing." },
+    { 0xFFFF, 0xB006, "B006", STATUS_CLASS_WARNING, STORE_ACTION_CONTINUE,             "Warning: Elements Discarded... Continuing." },
+    { 0xFFFF, 0xB007, "B007", STATUS_CLASS_WARNING, STORE_ACTION_CONTINUE,             "Warning: Invalid Dataset... Continuing." },
+    { 0xFF00, 0xB000, "B0xx", STATUS_CLASS_WARNING, STORE_ACTION_CONTINUE,             "Warning: Unknown warning... Continuing." },
+    { 0xFFFF, 0xA700, "A700", STATUS_CLASS_FAILURE, STORE_ACTION_RETRY_LATER,          "ERROR: REFUSED, NO RESOURCES.  RETRYING LATER." },
+    { 0xFF00, 0xA700, "A7xx", STATUS_CLASS_FAILURE, STORE_ACTION_RETRY_LATER,          "ERROR: REFUSED, OUT OF RESOURCES.  RETRYING LATER." },
+    { 0xFFFF, 0xA900, "A900", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: INVALID_DATASET.  IMAGE NOT STORED." },
+    { 0xFF00, 0xA900, "A9xx", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: DATASET DOES NOT MATCH SOP CLASS.  IMAGE NOT STORED." },
+    { 0xFFFF, 0xC000, "C000", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: CANNOT UNDERSTAND.  IMAGE NOT STORED." },
+    { 0xF000, 0xC000, "Cxxx", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: CANNOT UNDERSTAND.  IMAGE NOT STORED." },
+    { 0xFFFF, 0x0110, "0110", STATUS_CLASS_FAILURE, STORE_ACTION_RETRY_NEW_ASSOCIATION, "ERROR: PROCESSING FAILURE.  RETRYING ON A NEW ASSOCIATION." },
+    { 0xFFFF, 0x0122, "0122", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: SOP CLASS NOT SUPPORTED.  IMAGE NOT STORED." },
+    { 0xFFFF, 0x0124, "0124", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: NOT AUTHORIZED.  IMAGE NOT STORED." },
+    { 0xFFFF, 0x0210, "0210", STATUS_CLASS_FAILURE, STORE_ACTION_RETRY_NEW_ASSOCIATION, "ERROR: DUPLICATE INVOCATION.  RETRYING ON A NEW ASSOCIATION." },
+    { 0xFFFF, 0x0211, "0211", STATUS_CLASS_FAILURE, STORE_ACTION_ABORT,                "ERROR: UNRECOGNIZED OPERATION.  ASSOCIATION ABORTING." },
+    { 0xFFFF, 0x0212, "0212", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: MISTYPED ARGUMENT.  IMAGE NOT STORED." },
+    { 0xFFFF, 0x0213, "0213", STATUS_CLASS_FAILURE, STORE_ACTION_RETRY_LATER,          "ERROR: RESOURCE LIMITATION.  RETRYING LATER." },
+    { 0xFFFF, 0xFE00, "FE00", STATUS_CLASS_FAILURE, STORE_ACTION_FAIL_INSTANCE,        "ERROR: CANCELED.  IMAGE NOT STORED." },
+    { 0xFF00, 0xFF00, "FFxx", STATUS_CLASS_FAILURE, STORE_ACTION_ABORT,                "ERROR: PENDING IS NOT VALID FOR C-STORE.  ASSOCIATION ABORTING." },
+    { 0x0000, 0x0000, "????", STATUS_CLASS_UNKNOWN, STORE_ACTION_FAIL_INSTANCE,        "ERROR: UNKNOWN STATUS.  IMAGE NOT STORED." },
+};
+
+static_assert(sizeof(StoreStatusTable) / sizeof(StoreStatusTable[0]) == NUM_STORE_STATUS_ENTRIES, "NUM_STORE_STATUS_ENTRIES does not match StoreStatusTable");
+static_assert(StoreStatusTable[NUM_STORE_STATUS_ENTRIES - 1].mask == 0, "StoreStatusTable must end with a catch-all entry");
+
+int LookupStoreStatusIndex(unsigned int A_status)
+{
+    int index = 0;
+    while ((A_status & StoreStatusTable[index].mask) != StoreStatusTable[index].value)
+    {
+        index++;
+    }
+    return index;
+}
+
+const StoreStatusEntry& StoreStatusAt(int A_index)
+{
+    return StoreStatusTable[A_index];
+}
+
+STORE_STATUS_CLASS ClassifyStoreStatus(unsigned int A_status)
+{
+    return StoreStatusTable[LookupStoreStatusIndex(A_status)].statusClass;
+}
+
+/*
+ * MC_Send_Request_Message return values after which the association
+ * can not be used any more.
+ */
+static constexpr MC_STATUS FatalSendStatusTable[] =
+{
+    MC_ASSOCIATION_ABORTED,
+    MC_SYSTEM_ERROR,
+    MC_UNACCEPTABLE_SERVICE,
+};
+
+bool IsFatalSendStatus(MC_STATUS A_status)
+{
+    for (MC_STATUS fatal : FatalSendStatusTable)
+    {
+        if (A_status == fatal)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Command line switches, indexed by the (lower case) letter after the '-'.
+ */
+static constexpr OptionHandler SwitchTable[26] =
+{
+    LocalAE,        /* -a */
+    LocalPort,      /* -b */
+    StudyContexts,  /* -c */
+    Directory,      /* -d */
+    EndpointPool,   /* -e */
+    Filename,       /* -f */
+    GroupStudies,   /* -g */
+    NULL,           /* -h, handled by PrintHelp */
+    DicomDir,       /* -i */
+    ParallelAssociations, /* -j */
+    NegotiationCacheFile, /* -k */
+    ServiceList,    /* -l */
+    MemoryLimit,    /* -m */
+    RemoteHost,     /* -n */
+    DirectThreshold, /* -o */
+    RemotePort,     /* -p */
+    DeflateLevels,  /* -q */
+    ReadAhead,      /* -r */
+    SpillThreshold, /* -s */
+    ScratchPath,    /* -t */
+    SmallestSyntax, /* -u */
+    VerboseMode,    /* -v */
+    WatchDirectory, /* -w */
+    StreamThreshold, /* -x */
+    RleSyntax,      /* -y */
+    ValidationRate, /* -z */
+};
+
+/*
+ * Positional arguments, indexed by their position among the arguments
+ * that are not switches.
+ */
+static constexpr OptionHandler PositionalTable[] =
+{
+    RemoteAE,
+    StartImage,
+    StopImage,
+};
+
+static bool IsSingleLetterSwitch(const char* A_arg)
+{
+    return A_arg[0] == '-' && isalpha((unsigned char)A_arg[1]) && A_arg[2] == '\0';
+}
+
+OptionHandler LookupSwitch(const char* A_arg)
+{
+    if (!IsSingleLetterSwitch(A_arg))
+    {
+        return NULL;
+    }
+    return SwitchTable[tolower((unsigned char)A_arg[1]) - 'a'];
+}
+
+OptionHandler LookupPositional(int A_position)
+{
+    int count = (int)(sizeof(PositionalTable) / sizeof(PositionalTable[0]));
+    if (A_position < 1 || A_position > count)
+    {
+        return NULL;
+    }
+    return PositionalTable[A_position - 1];
+}
@@ -0,0 +1,253 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Memory budget
+ *
+ *  A global cap on the bytes held by message objects that have been read
+ *  but not yet freed.  ReadImage() reserves the expected size of an object
+ *  before reading it and blocks while the reservation would exceed the cap;
+ *  the reservation is returned once the message is freed.
+ *
+ *  When the toolkit keeps the large attributes of a message in temporary
+ *  files (see LargeDataStore.cpp) only the part of the object below
+ *  LARGE_DATA_SIZE is charged, otherwise the whole file is.
+ *
+ *  A single object larger than the cap is let through when nothing else
+ *  is held, so it is sent instead of waiting forever.
+ *
+ ****************************************************************************/
+
+static std::mutex              BudgetLock;
+static std::condition_variable BudgetFreed;
+static size_t BudgetLimit = (size_t)DEFAULT_MEMORY_BUDGET_MB * 1024 * 1024;
+static size_t BudgetUsed = 0;
+static size_t BudgetPeak = 0;
+static size_t BudgetLargeDataSize = 0;
+
+static bool BudgetAvailable(size_t A_bytes)
+{
+    return BudgetUsed == 0 || BudgetUsed + A_bytes <= BudgetLimit;
+}
+
+static size_t GetLargeDataSize()
+{
+    int size = 0;
+
+    if (MC_Get_Int_Config_Value(LARGE_DATA_SIZE, &size) != MC_NORMAL_COMPLETION)
+        return 0;
+    return (size_t)size;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   MemoryBudgetConfigure
+ *
+ *  Parameters  :   A_limitBytes      - Cap on bytes held by messages
+ *                  A_largeDataSize   - Size above which an attribute may
+ *                                      be kept in a temporary file
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Set the cap and how object sizes are charged against it.
+ *
+ ****************************************************************************/
+void MemoryBudgetConfigure(size_t A_limitBytes, size_t A_largeDataSize)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    BudgetLimit = A_limitBytes;
+    BudgetLargeDataSize = A_largeDataSize;
+    BudgetFreed.notify_all();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   MemoryBudgetInit
+ *
+ *  Parameters  :   A_limitMB  - Cap in megabytes, 0 for the default
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Configure the budget from the command line and the
+ *                  toolkit's LARGE_DATA_SIZE setting.
+ *                  Must be called after MC_Library_Initialization.
+ *
+ ****************************************************************************/
+void MemoryBudgetInit(int A_limitMB)
+{
+    size_t limitMB = A_limitMB > 0 ? (size_t)A_limitMB : DEFAULT_MEMORY_BUDGET_MB;
+
+    MemoryBudgetConfigure(limitMB * 1024 * 1024, GetLargeDataSize());
+    LogMessage(LOG_LEVEL_DEBUG, "Message memory budget: %luMB\n", (unsigned long)limitMB);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   EstimateMessageBytes
+ *
+ *  Parameters  :   A_fileBytes - Size of the file on disk
+ *                  A_inFile    - true if large attributes are kept in
+ *                                temporary files
+ *
+ *  Returns     :   size_t, bytes the message is expected to hold in memory
+ *
+ *  Description :   Large attributes such as pixel data are not held in
+ *                  memory when LARGE_DATA_STORE is FILE.
+ *
+ ****************************************************************************/
+size_t EstimateMessageBytes(size_t A_fileBytes, bool A_inFile)
+{
+    if (A_inFile && A_fileBytes > BudgetLargeDataSize)
+        return BudgetLargeDataSize;
+    return A_fileBytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   MemoryBudgetAcquire
+ *
+ *  Parameters  :   A_bytes    - Bytes to reserve
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Reserve bytes, waiting until other messages have been
+ *                  freed if the cap would be exceeded.
+ *
+ ****************************************************************************/
+void MemoryBudgetAcquire(size_t A_bytes)
+{
+    std::unique_lock<std::mutex> lock(BudgetLock);
+    BudgetFreed.wait(lock, [A_bytes] { return BudgetAvailable(A_bytes); });
+    BudgetUsed += A_bytes;
+    BudgetPeak = std::max(BudgetPeak, BudgetUsed);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   MemoryBudgetTryAcquire
+ *
+ *  Parameters  :   A_bytes    - Bytes to reserve
+ *
+ *  Returns     :   true if the bytes were reserved
+ *                  false if the cap would be exceeded
+ *
+ *  Description :   Reserve bytes without waiting, for readers that must
+ *                  not hold up the sender while they wait.
+ *
+ ****************************************************************************/
+bool MemoryBudgetTryAcquire(size_t A_bytes)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    if (!BudgetAvailable(A_bytes))
+        return false;
+    BudgetUsed += A_bytes;
+    BudgetPeak = std::max(BudgetPeak, BudgetUsed);
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   MemoryBudgetRelease
+ *
+ *  Parameters  :   A_bytes    - Bytes reserved by MemoryBudgetAcquire
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Return a reservation and wake up waiting readers.
+ *
+ ****************************************************************************/
+void MemoryBudgetRelease(size_t A_bytes)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    BudgetUsed -= std::min(A_bytes, BudgetUsed);
+    BudgetFreed.notify_all();
+}
+
+size_t MemoryBudgetLimit(void)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    return BudgetLimit;
+}
+
+size_t MemoryBudgetInUse(void)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    return BudgetUsed;
+}
+
+size_t MemoryBudgetPeak(void)
+{
+    std::lock_guard<std::mutex> lock(BudgetLock);
+    return BudgetPeak;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReserveNodeMemory
+ *
+ *  Parameters  :   A_node     - The node whose file is about to be read
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Choose where the large attributes of the node's message
+ *                  are kept, or if its pixel data is streamed, and reserve
+ *                  its expected memory, taken from the size of its file
+ *                  when it was added to the list.
+ *
+ ****************************************************************************/
+static size_t NodeReservation(InstanceNode* A_node)
+{
+    A_node->largeDataInFile = (SAMP_BOOLEAN)ShouldSpillToFile(A_node->fileBytes);
+    A_node->streamPixelData = (SAMP_BOOLEAN)ShouldStreamPixelData(A_node->fileBytes);
+    return EstimateMessageBytes(A_node->fileBytes, (A_node->largeDataInFile | A_node->streamPixelData) != 0);
+}
+
+void ReserveNodeMemory(InstanceNode* A_node)
+{
+    if (A_node->reservedBytes > 0)
+        return;
+    A_node->reservedBytes = NodeReservation(A_node);
+    MemoryBudgetAcquire(A_node->reservedBytes);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TryReserveNodeMemory
+ *
+ *  Parameters  :   A_node     - The node whose file is about to be read
+ *
+ *  Returns     :   true if the node's memory is reserved
+ *                  false if it does not fit in the budget yet
+ *
+ *  Description :   As ReserveNodeMemory, without waiting.  ReadImage()
+ *                  does not reserve the node's memory again.
+ *
+ ****************************************************************************/
+bool TryReserveNodeMemory(InstanceNode* A_node)
+{
+    if (A_node->reservedBytes > 0)
+        return true;
+    size_t bytes = NodeReservation(A_node);
+    if (!MemoryBudgetTryAcquire(bytes))
+        return false;
+    A_node->reservedBytes = bytes;
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReleaseNodeMemory
+ *
+ *  Parameters  :   A_node     - The node whose message was freed
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Return the node's reservation.  Safe to call more than
+ *                  once.
+ *
+ ****************************************************************************/
+void ReleaseNodeMemory(InstanceNode* A_node)
+{
+    MemoryBudgetRelease(A_node->reservedBytes);
+    A_node->reservedBytes = 0;
+}
@@ -0,0 +1,335 @@
+#include "Definitions.h"
+#include <list>
+#include <string>
+
+/****************************************************************************
+ *
+ *  Negotiation cache
+ *
+ *  With -k the outcome of each association negotiated is kept in a file,
+ *  per remote AE title and service list: the services accepted with their
+ *  transfer syntax, the remote maximum PDU size and the maximum number of
+ *  operations invoked and performed.  The next run that finds an entry
+ *  less than NEGOTIATION_CACHE_HOURS old proposes only the services
+ *  accepted last time, asking for the same number of operations at once,
+ *  so the association is smaller to negotiate and the pipeline of
+ *  requests is sized from the first association.
+ *
+ *  An entry is learned again once it is older than that, so services the
+ *  remote AE has since been set up to accept are found, also within a run
+ *  that goes on for longer, as with -w.  Associations opened while the
+ *  entry is fresh proposed the services kept, and those proposing only
+ *  the services of a study (-c) say nothing of the configured list, so
+ *  neither is recorded and an entry is not kept fresh by its own use.
+ *
+ *  The file holds a line per remote AE and service list:
+ *      remote_ae <tab> service_list <tab> time <tab> max_pdu <tab>
+ *      invoked <tab> performed <tab> service=syntax,service=syntax...
+ *
+ ****************************************************************************/
+
+/*
+ * What a remote AE accepted of a service list
+ */
+typedef struct negotiation_entry
+{
+    time_t                   learned;       /* time the association was negotiated */
+    unsigned long            remotePDU;     /* Remote Max PDU Size */
+    unsigned short           maxInvoked;    /* Max operations invoked */
+    unsigned short           maxPerformed;  /* Max operations performed */
+    std::vector<std::string> services;      /* services accepted */
+    std::vector<int>         syntaxes;      /* transfer syntax accepted for each service */
+} NegotiationEntry;
+
+static std::map<std::string, NegotiationEntry> NegotiationEntries;
+static std::mutex                              NegotiationLock;
+static std::string                             NegotiationPath;
+static bool                                    NegotiationChanged = false;
+static std::list<std::string>                  CachedServiceLists;             /* lists made this run, freed by NegotiationCacheSave */
+static char*                                   CachedServiceList = NULL;       /* the one proposed, NULL when none */
+static time_t                                  CachedServiceListLearned = 0;   /* time its entry was learned */
+
+static std::string EntryKey(const char* A_remoteAE, const char* A_serviceList)
+{
+    return std::string(A_remoteAE) + "\t" + A_serviceList;
+}
+
+static void SplitFields(const std::string& A_text, char A_separator, std::vector<std::string>& A_fields)
+{
+    size_t start = 0;
+    size_t end;
+
+    while ((end = A_text.find(A_separator, start)) != std::string::npos)
+    {
+        A_fields.push_back(A_text.substr(start, end - start));
+        start = end + 1;
+    }
+    A_fields.push_back(A_text.substr(start));
+}
+
+static void ReadAccepted(const std::string& A_text, NegotiationEntry& A_entry)
+{
+    std::vector<std::string> accepted;
+
+    SplitFields(A_text, ',', accepted);
+    for (size_t i = 0; i < accepted.size(); i++)
+    {
+        size_t equals = accepted[i].find('=');
+        if (equals == std::string::npos)
+            continue;
+        A_entry.services.push_back(accepted[i].substr(0, equals));
+        A_entry.syntaxes.push_back(atoi(accepted[i].c_str() + equals + 1));
+    }
+}
+
+/*
+ * Lines that are not understood are left out
+ */
+static void ReadEntry(const std::string& A_line)
+{
+    std::vector<std::string> fields;
+    NegotiationEntry         entry;
+
+    SplitFields(A_line, '\t', fields);
+    if (fields.size() != 7)
+        return;
+    entry.learned = (time_t)atoll(fields[2].c_str());
+    entry.remotePDU = strtoul(fields[3].c_str(), NULL, 10);
+    entry.maxInvoked = (unsigned short)atoi(fields[4].c_str());
+    entry.maxPerformed = (unsigned short)atoi(fields[5].c_str());
+    ReadAccepted(fields[6], entry);
+    if (!entry.services.empty())
+        NegotiationEntries[fields[0] + "\t" + fields[1]] = entry;
+}
+
+static void ReadEntries(FILE* A_fp)
+{
+    char line[4096];
+
+    while (fgets(line, sizeof(line), A_fp))
+    {
+        line[strcspn(line, "\r\n")] = '\0';
+        ReadEntry(line);
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   NegotiationCacheLoad
+ *
+ *  Parameters  :   A_path     - File the negotiations are kept in
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Read the negotiations kept by earlier runs.  A missing
+ *                  file is an empty cache; it is written by
+ *                  NegotiationCacheSave.
+ *
+ ****************************************************************************/
+void NegotiationCacheLoad(const char* A_path)
+{
+    FILE* fp = fopen(A_path, TEXT_READ);
+
+    NegotiationPath = A_path;
+    NegotiationEntries.clear();
+    if (!fp)
+        return;
+    ReadEntries(fp);
+    fclose(fp);
+    LogMessage(LOG_LEVEL_DEBUG, "%d negotiations read from %s\n", (int)NegotiationEntries.size(), A_path);
+}
+
+static bool IsFresh(time_t A_learned)
+{
+    return difftime(time(NULL), A_learned) < NEGOTIATION_CACHE_HOURS * 3600.0;
+}
+
+/*
+ * Each list made gets a name of its own: an association may still be
+ * opening with the last one when its entry expires
+ */
+static bool MakeCachedServiceList(NegotiationEntry& A_entry)
+{
+    std::vector<char*> names;
+    char               listName[64];
+
+    for (size_t i = 0; i < A_entry.services.size(); i++)
+        names.push_back(&A_entry.services[i][0]);
+    names.push_back(NULL);
+    sprintf(listName, "CACHED_SERVICE_LIST_%d", (int)CachedServiceLists.size() + 1);
+    if (MC_NewProposedServiceListAsync(listName, &names[0], A_entry.maxInvoked, A_entry.maxPerformed) != MC_NORMAL_COMPLETION)
+        return false;
+    CachedServiceLists.push_back(listName);
+    CachedServiceList = &CachedServiceLists.back()[0];
+    CachedServiceListLearned = A_entry.learned;
+    return true;
+}
+
+static void UseEntry(const char* A_remoteAE, NegotiationEntry& A_entry)
+{
+    if (MakeCachedServiceList(A_entry))
+        LogMessage(LOG_LEVEL_INFO, "Proposing the %d services %s accepted before, %u operations at a time, max PDU %lu\n", (int)A_entry.services.size(), A_remoteAE, (unsigned)A_entry.maxInvoked, A_entry.remotePDU);
+}
+
+static NegotiationEntry* FreshEntry(const std::string& A_key)
+{
+    std::map<std::string, NegotiationEntry>::iterator entry = NegotiationEntries.find(A_key);
+
+    if (entry == NegotiationEntries.end() || !IsFresh(entry->second.learned))
+        return NULL;
+    return &entry->second;
+}
+
+/*
+ * Called holding NegotiationLock.  Once the entry the list was made of
+ * expires the configured list is proposed, until an association has
+ * learned the entry again.
+ */
+static void MakeFreshList(const char* A_remoteAE, const std::string& A_key)
+{
+    if (CachedServiceList && IsFresh(CachedServiceListLearned))
+        return;
+    CachedServiceList = NULL;
+    NegotiationEntry* entry = FreshEntry(A_key);
+    if (entry)
+        UseEntry(A_remoteAE, *entry);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   NegotiatedServiceList
+ *
+ *  Parameters  :   A_remoteAE   - AE title of the remote system
+ *                  A_configured - Service list configured for the SCU
+ *
+ *  Returns     :   The service list to propose
+ *
+ *  Description :   A list of the services accepted before, when the
+ *                  cache holds a recent negotiation of the configured
+ *                  list with the remote AE; the configured list otherwise.
+ *                  The list is made again each time the entry is learned
+ *                  again.
+ *
+ ****************************************************************************/
+char* NegotiatedServiceList(const char* A_remoteAE, char* A_configured)
+{
+    std::lock_guard<std::mutex> lock(NegotiationLock);
+
+    MakeFreshList(A_remoteAE, EntryKey(A_remoteAE, A_configured));
+    return CachedServiceList ? CachedServiceList : A_configured;
+}
+
+static void NoteSyntaxChange(const NegotiationEntry& A_old, const ServiceInfo& A_service)
+{
+    std::vector<std::string>::const_iterator found = std::find(A_old.services.begin(), A_old.services.end(), A_service.ServiceName);
+
+    if (found != A_old.services.end() && A_old.syntaxes[found - A_old.services.begin()] != (int)A_service.SyntaxType)
+        LogMessage(LOG_LEVEL_DEBUG, "%s now accepted in %s\n", A_service.ServiceName, GetSyntaxDescription(A_service.SyntaxType));
+}
+
+static void ReadAcceptedServices(int A_associationID, const NegotiationEntry& A_old, NegotiationEntry& A_entry)
+{
+    ServiceInfo service;
+    MC_STATUS   mcStatus = MC_Get_First_Acceptable_Service(A_associationID, &service);
+
+    for (; mcStatus == MC_NORMAL_COMPLETION; mcStatus = MC_Get_Next_Acceptable_Service(A_associationID, &service))
+    {
+        if (!service.ServiceName[0])
+            continue;
+        NoteSyntaxChange(A_old, service);
+        A_entry.services.push_back(service.ServiceName);
+        A_entry.syntaxes.push_back((int)service.SyntaxType);
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   NegotiationCacheRecord
+ *
+ *  Parameters  :   A_remoteAE      - AE title of the remote system
+ *                  A_configured    - Service list configured for the SCU
+ *                  A_associationID - Association just negotiated
+ *                  A_info          - Its association information
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Keep what the remote AE accepted, to be written by
+ *                  NegotiationCacheSave.  Does nothing without -k, or
+ *                  while the entry kept is fresh, as the association
+ *                  then proposed the services kept.
+ *
+ ****************************************************************************/
+void NegotiationCacheRecord(const char* A_remoteAE, const char* A_configured, int A_associationID, const AssocInfo* A_info)
+{
+    NegotiationEntry entry;
+
+    if (NegotiationPath.empty())
+        return;
+    entry.learned = time(NULL);
+    entry.remotePDU = A_info->RemoteMaximumPDUSize;
+    entry.maxInvoked = A_info->MaxOperationsInvoked;
+    entry.maxPerformed = A_info->MaxOperationsPerformed;
+
+    std::lock_guard<std::mutex> lock(NegotiationLock);
+    std::string                 key = EntryKey(A_remoteAE, A_configured);
+    if (FreshEntry(key))
+        return;
+    NegotiationEntry& kept = NegotiationEntries[key];
+    ReadAcceptedServices(A_associationID, kept, entry);
+    kept = entry;
+    NegotiationChanged = true;
+}
+
+static void WriteEntry(FILE* A_fp, const std::string& A_key, const NegotiationEntry& A_entry)
+{
+    fprintf(A_fp, "%s\t%lld\t%lu\t%u\t%u\t", A_key.c_str(), (long long)A_entry.learned, A_entry.remotePDU, (unsigned)A_entry.maxInvoked, (unsigned)A_entry.maxPerformed);
+    for (size_t i = 0; i < A_entry.services.size(); i++)
+        fprintf(A_fp, "%s%s=%d", i ? "," : "", A_entry.services[i].c_str(), A_entry.syntaxes[i]);
+    fprintf(A_fp, "\n");
+}
+
+static void WriteEntries(FILE* A_fp)
+{
+    for (std::map<std::string, NegotiationEntry>::iterator entry = NegotiationEntries.begin(); entry != NegotiationEntries.end(); ++entry)
+    {
+        if (!entry->second.services.empty())
+            WriteEntry(A_fp, entry->first, entry->second);
+    }
+}
+
+static void WriteCache()
+{
+    FILE* fp = fopen(NegotiationPath.c_str(), TEXT_WRITE);
+
+    if (!fp)
+    {
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Cannot write the negotiation cache %s\n", NegotiationPath.c_str());
+        return;
+    }
+    WriteEntries(fp);
+    fclose(fp);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   NegotiationCacheSave
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Write the negotiations recorded in this run, and free
+ *                  the service lists made from the cache.  Called before
+ *                  the application is released.
+ *
+ ****************************************************************************/
+void NegotiationCacheSave(void)
+{
+    for (std::list<std::string>::iterator name = CachedServiceLists.begin(); name != CachedServiceLists.end(); ++name)
+        MC_FreeServiceList(&(*name)[0]);
+    CachedServiceLists.clear();
+    CachedServiceList = NULL;
+    if (NegotiationChanged)
+        WriteCache();
+    NegotiationChanged = false;
+}
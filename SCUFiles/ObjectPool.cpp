@@ -0,0 +1,194 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Object pools
+ *
+ *  Read buffers and message objects are kept for the whole run instead of
+ *  being created and destroyed for every file.
+ *
+ *  Each thread reading files owns one read buffer aligned to
+ *  READ_BUFFER_ALIGNMENT bytes, which only grows when a larger buffer is
+ *  asked for and is freed when the thread ends.
+ *
+ *  Messages that have been sent are emptied with MC_Empty_Message and
+ *  kept; the next file is read into one of them after MC_Message_To_File
+ *  instead of a new object from MC_Create_Empty_File.
+ *
+ ****************************************************************************/
+
+#ifdef _WIN32
+static char* AllocateAligned(size_t A_length)
+{
+    return (char*)_aligned_malloc(A_length, READ_BUFFER_ALIGNMENT);
+}
+
+static void FreeAligned(char* A_buffer)
+{
+    _aligned_free(A_buffer);
+}
+#else
+static char* AllocateAligned(size_t A_length)
+{
+    void* buffer = NULL;
+
+    if (posix_memalign(&buffer, READ_BUFFER_ALIGNMENT, A_length) != 0)
+        return NULL;
+    return (char*)buffer;
+}
+
+static void FreeAligned(char* A_buffer)
+{
+    free(A_buffer);
+}
+#endif
+
+/*
+ * Read buffer of one thread, freed when the thread ends
+ */
+class ReadBuffer
+{
+public:
+    char*   buffer;
+    size_t  length;
+
+    ReadBuffer() : buffer(NULL), length(0) {}
+    ~ReadBuffer() { FreeAligned(buffer); }
+};
+
+static thread_local ReadBuffer ThreadReadBuffer;
+
+static std::mutex MessagePoolLock;
+static int        RecycledMessages[MAX_RECYCLED_MESSAGES];
+static int        NumRecycledMessages = 0;
+
+/****************************************************************************
+ *
+ *  Function    :   GetReadBuffer
+ *
+ *  Parameters  :   A_length   - Number of bytes needed
+ *
+ *  Returns     :   Aligned buffer of at least A_length bytes owned by the
+ *                  calling thread, NULL if it cannot be allocated
+ *
+ *  Description :   The buffer stays valid until the next call from the
+ *                  same thread with a larger length.  It must not be freed
+ *                  by the caller.
+ *
+ ****************************************************************************/
+char* GetReadBuffer(size_t A_length)
+{
+    if (A_length <= ThreadReadBuffer.length)
+        return ThreadReadBuffer.buffer;
+
+    FreeAligned(ThreadReadBuffer.buffer);
+    ThreadReadBuffer.buffer = AllocateAligned(A_length);
+    ThreadReadBuffer.length = ThreadReadBuffer.buffer ? A_length : 0;
+    return ThreadReadBuffer.buffer;
+}
+
+static int PopRecycledMessage()
+{
+    std::lock_guard<std::mutex> lock(MessagePoolLock);
+    if (NumRecycledMessages == 0)
+        return -1;
+    return RecycledMessages[--NumRecycledMessages];
+}
+
+static bool PushRecycledMessage(int A_msgID)
+{
+    std::lock_guard<std::mutex> lock(MessagePoolLock);
+    if (NumRecycledMessages == MAX_RECYCLED_MESSAGES)
+        return false;
+    RecycledMessages[NumRecycledMessages++] = A_msgID;
+    return true;
+}
+
+static bool ReuseMessage(int A_recycledID, int* A_msgID, const char* A_filename)
+{
+    if (MC_Message_To_File(A_recycledID, A_filename) != MC_NORMAL_COMPLETION)
+    {
+        MC_Free_Message(&A_recycledID);
+        return false;
+    }
+    *A_msgID = A_recycledID;
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   CreateFileObject
+ *
+ *  Parameters  :   A_msgID    - ID of the file object returned here
+ *                  A_filename - Name of the file it will be read from
+ *
+ *  Returns     :   MC_NORMAL_COMPLETION on success
+ *                  any other MC_STATUS value on failure.
+ *
+ *  Description :   Turn a recycled message into an empty file object, or
+ *                  create a new one when none is left.
+ *
+ ****************************************************************************/
+MC_STATUS CreateFileObject(int* A_msgID, const char* A_filename)
+{
+    int recycledID = PopRecycledMessage();
+
+    if (recycledID != -1 && ReuseMessage(recycledID, A_msgID, A_filename))
+        return MC_NORMAL_COMPLETION;
+    return MC_Create_Empty_File(A_msgID, A_filename);
+}
+
+static MC_STATUS RecycleMessage(int* A_msgID)
+{
+    if (MC_Empty_Message(*A_msgID) != MC_NORMAL_COMPLETION || !PushRecycledMessage(*A_msgID))
+        return MC_Free_Message(A_msgID);
+
+    *A_msgID = -1;
+    return MC_NORMAL_COMPLETION;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   FreeNodeMessage
+ *
+ *  Parameters  :   A_node     - The node whose message has been sent
+ *
+ *  Returns     :   MC_NORMAL_COMPLETION on success
+ *                  any other MC_STATUS value on failure.
+ *
+ *  Description :   Empty the node's message and keep it for the next
+ *                  file.  Messages that had their pixel data streamed
+ *                  carry the stream callback, and messages transcoded
+ *                  carry compression callbacks; they are freed instead.
+ *
+ ****************************************************************************/
+MC_STATUS FreeNodeMessage(InstanceNode* A_node)
+{
+    ReleasePixelStream(A_node->msgID);
+    if (A_node->streamPixelData || A_node->transcoded)
+        return MC_Free_Message(&A_node->msgID);
+    return RecycleMessage(&A_node->msgID);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   FreeRecycledMessages
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Free the kept messages.  Called before the library is
+ *                  released.
+ *
+ ****************************************************************************/
+void FreeRecycledMessages(void)
+{
+    int msgID = PopRecycledMessage();
+
+    while (msgID != -1)
+    {
+        MC_Free_Message(&msgID);
+        msgID = PopRecycledMessage();
+    }
+}
@@ -0,0 +1,243 @@
+#include "Definitions.h"
+#include <deque>
+#include <vector>
+
+/****************************************************************************
+ *
+ *  Parallel associations
+ *
+ *  With -j the files are sent over several associations to the same
+ *  destination at once.  They are shared out by size rather than by
+ *  count: taken largest first, each file goes to the association with the
+ *  fewest bytes so far (longest processing time first), so a few very
+ *  large objects do not all end up on one association.
+ *
+ *  Each association sends its own files largest first.  One that has run
+ *  out takes the smallest file left to the association with the most
+ *  bytes still to send, so the associations finish close together even
+ *  when the sizes mislead, e.g. when an SCP is slow for one SOP Class.
+ *
+ ****************************************************************************/
+
+/*
+ * Files still to be sent over one association
+ */
+typedef struct send_queue
+{
+    std::mutex                lock;
+    std::deque<InstanceNode*> nodes;    /* largest first */
+    std::atomic<size_t>       bytes;    /* bytes of the files in nodes */
+} SendQueue;
+
+static SendQueue*        SendQueues = NULL;
+static int               NumSendQueues = 0;
+static std::atomic<long> StolenFiles(0);
+
+static bool LargerFirst(const InstanceNode* A_left, const InstanceNode* A_right)
+{
+    return A_left->fileBytes > A_right->fileBytes;
+}
+
+static int LeastLoadedQueue()
+{
+    int least = 0;
+
+    for (int i = 1; i < NumSendQueues; i++)
+    {
+        if (SendQueues[i].bytes < SendQueues[least].bytes)
+            least = i;
+    }
+    return least;
+}
+
+static void AssignNode(InstanceNode* A_node)
+{
+    SendQueue& queue = SendQueues[LeastLoadedQueue()];
+
+    A_node->Next = NULL;
+    queue.nodes.push_back(A_node);
+    queue.bytes += A_node->fileBytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ParallelPlan
+ *
+ *  Parameters  :   A_list     - Files to send, the list is taken over
+ *                  A_queues   - Number of associations
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Share the files out between the associations by size.
+ *                  Must be called before the sending threads start.
+ *
+ ****************************************************************************/
+void ParallelPlan(InstanceNode* A_list, int A_queues)
+{
+    std::vector<InstanceNode*> nodes;
+
+    for (InstanceNode* node = A_list; node; node = node->Next)
+        nodes.push_back(node);
+    std::stable_sort(nodes.begin(), nodes.end(), LargerFirst);
+
+    delete[] SendQueues;
+    SendQueues = new SendQueue[A_queues]();
+    NumSendQueues = A_queues;
+    StolenFiles = 0;
+    for (size_t i = 0; i < nodes.size(); i++)
+        AssignNode(nodes[i]);
+    ResetListTail();
+}
+
+static InstanceNode* PopLargest(SendQueue& A_queue)
+{
+    std::lock_guard<std::mutex> lock(A_queue.lock);
+    if (A_queue.nodes.empty())
+        return NULL;
+    InstanceNode* node = A_queue.nodes.front();
+    A_queue.nodes.pop_front();
+    A_queue.bytes -= node->fileBytes;
+    return node;
+}
+
+static InstanceNode* PopSmallest(SendQueue& A_queue)
+{
+    std::lock_guard<std::mutex> lock(A_queue.lock);
+    if (A_queue.nodes.empty())
+        return NULL;
+    InstanceNode* node = A_queue.nodes.back();
+    A_queue.nodes.pop_back();
+    A_queue.bytes -= node->fileBytes;
+    return node;
+}
+
+static size_t StealableBytes(int A_queue, int A_thief)
+{
+    return A_queue == A_thief ? 0 : SendQueues[A_queue].bytes.load();
+}
+
+/*
+ * Returns -1 when no other association has bytes left to send
+ */
+static int MostLoadedQueue(int A_thief)
+{
+    int    most = -1;
+    size_t mostBytes = 0;
+
+    for (int i = 0; i < NumSendQueues; i++)
+    {
+        size_t bytes = StealableBytes(i, A_thief);
+        most = bytes > mostBytes ? i : most;
+        mostBytes = std::max(bytes, mostBytes);
+    }
+    return most;
+}
+
+static InstanceNode* CountStolen(InstanceNode* A_node, int A_thief)
+{
+    StolenFiles++;
+    LogMessage(LOG_LEVEL_DEBUG, "Association %d took over [%s]\n", A_thief, A_node->fname);
+    return A_node;
+}
+
+/*
+ * The queue chosen may be emptied by its owner before the file is taken,
+ * in which case the next one is tried
+ */
+static InstanceNode* StealNode(int A_thief)
+{
+    int victim;
+
+    while ((victim = MostLoadedQueue(A_thief)) >= 0)
+    {
+        InstanceNode* node = PopSmallest(SendQueues[victim]);
+        if (node)
+            return CountStolen(node, A_thief);
+    }
+    return NULL;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ParallelTake
+ *
+ *  Parameters  :   A_queue    - Index of the association asking
+ *
+ *  Returns     :   The next file to send over the association, NULL once
+ *                  no association has files left
+ *
+ *  Description :   The largest file left to the association, or else the
+ *                  smallest file left to the most loaded association.
+ *                  The node returned is no longer linked to any list.
+ *
+ ****************************************************************************/
+InstanceNode* ParallelTake(int A_queue)
+{
+    InstanceNode* node = PopLargest(SendQueues[A_queue]);
+
+    return node ? node : StealNode(A_queue);
+}
+
+static void AppendQueue(SendQueue& A_queue, InstanceNode**& A_tail)
+{
+    for (size_t i = 0; i < A_queue.nodes.size(); i++)
+    {
+        *A_tail = A_queue.nodes[i];
+        A_tail = &A_queue.nodes[i]->Next;
+    }
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ParallelReadAhead
+ *
+ *  Parameters  :   A_queue    - Index of the association sending
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Ask the kernel to read the next files left to the
+ *                  association, see ReadAheadNext.  The files taken over
+ *                  from other associations are not known in advance and
+ *                  are not hinted.
+ *
+ ****************************************************************************/
+void ParallelReadAhead(int A_queue)
+{
+    SendQueue&                  queue = SendQueues[A_queue];
+    std::lock_guard<std::mutex> lock(queue.lock);
+    size_t                      bytes = 0;
+    int                         files = 0;
+    size_t                      i = 0;
+
+    while (i < queue.nodes.size() && ReadAheadNext(queue.nodes[i], &files, &bytes))
+        i++;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ParallelFinish
+ *
+ *  Parameters  :   A_list     - List the files never taken are added to
+ *
+ *  Returns     :   Number of files taken over from another association
+ *
+ *  Description :   Called once the sending threads have ended.  Files
+ *                  are left when every association failed.
+ *
+ ****************************************************************************/
+long ParallelFinish(InstanceNode** A_list)
+{
+    InstanceNode** tail = A_list;
+
+    while (*tail)
+        tail = &(*tail)->Next;
+    for (int i = 0; i < NumSendQueues; i++)
+        AppendQueue(SendQueues[i], tail);
+    *tail = NULL;
+
+    delete[] SendQueues;
+    SendQueues = NULL;
+    NumSendQueues = 0;
+    ResetListTail();
+    return StolenFiles;
+}
@@ -0,0 +1,506 @@
+#include "Definitions.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+/****************************************************************************
+ *
+ *  Streaming pixel data
+ *
+ *  Objects of at least the streaming threshold (-x) are not loaded as a
+ *  whole.  MC_Open_File_Upto_Tag reads the attributes before the pixel
+ *  data only, and the position and length of the pixel data value in the
+ *  file are recorded.  A callback registered for the pixel data tag then
+ *  supplies the value chunk by chunk from disk while MC_Send_Request_Message
+ *  writes it to the network, so memory use does not grow with object size
+ *  and sending starts as soon as the header has been read.
+ *
+ *  The pixel data is mapped into memory copy-on-write, and the toolkit is
+ *  given the chunks where they lie in the mapping, so the value is not
+ *  copied into a buffer of ours on its way to the socket.  Should the
+ *  toolkit change a chunk, e.g. to swap its bytes for a big endian
+ *  association, only the pages changed are copied, never the file.  When
+ *  the file cannot be mapped, e.g. pixel data larger than the address
+ *  space of a 32-bit build or a file cut short, the chunks are read into
+ *  a buffer instead, which fails the send of a file cut short cleanly.
+ *
+ *  Only native pixel data of defined length in the little endian transfer
+ *  syntaxes is streamed; anything else is read with MC_Open_File as
+ *  before.  Attributes following the pixel data (trailing padding) are not
+ *  sent for a streamed object.
+ *
+ ****************************************************************************/
+
+/*
+ * Transfer syntaxes whose pixel data may be streamed, with the length of
+ * the pixel data element header (tag, VR and length) in that syntax.
+ */
+typedef struct stream_syntax
+{
+    TRANSFER_SYNTAX syntax;
+    long            headerLength;
+} StreamSyntax;
+
+static const StreamSyntax StreamSyntaxes[] =
+{
+    { IMPLICIT_LITTLE_ENDIAN, 8 },
+    { EXPLICIT_LITTLE_ENDIAN, 12 },
+};
+
+static std::mutex  PixelStreamLock;            /* slots and the callback registration */
+static PixelStream PixelStreams[MAX_PIXEL_STREAMS];
+static size_t      StreamThresholdBytes = 0;    /* 0 when streaming is off */
+static thread_local bool StreamNextFile = false;
+
+#ifdef _WIN32
+static void* MapRegion(const char* A_filename, long long A_offset, size_t A_length)
+{
+    HANDLE file = CreateFileA(A_filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return NULL;
+    void* view = MapViewOfFile(mapping, FILE_MAP_COPY, (DWORD)(A_offset >> 32), (DWORD)A_offset, A_length);
+    CloseHandle(mapping);
+    return view;
+}
+
+static void UnmapRegion(void* A_view, size_t A_length)
+{
+    UnmapViewOfFile(A_view);
+}
+
+static long long MapGranularity()
+{
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+}
+#else
+/*
+ * Touching a page mapped past the end of the file raises SIGBUS, so a file
+ * shorter than its pixel data length says, e.g. one still being written
+ * under -w, is read instead
+ */
+static bool FileHolds(int A_fd, long long A_end)
+{
+    struct stat fileStat;
+
+    return fstat(A_fd, &fileStat) == 0 && A_end <= (long long)fileStat.st_size;
+}
+
+static void* MapRegion(const char* A_filename, long long A_offset, size_t A_length)
+{
+    int fd = open(A_filename, O_RDONLY);
+
+    if (fd < 0)
+        return NULL;
+    void* view = FileHolds(fd, A_offset + (long long)A_length) ? mmap(NULL, A_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)A_offset) : MAP_FAILED;
+    close(fd);
+    if (view == MAP_FAILED)
+        return NULL;
+    madvise(view, A_length, MADV_SEQUENTIAL);
+    return view;
+}
+
+static void UnmapRegion(void* A_view, size_t A_length)
+{
+    munmap(A_view, A_length);
+}
+
+static long long MapGranularity()
+{
+    return sysconf(_SC_PAGESIZE);
+}
+#endif
+
+static bool IsStreamOf(const PixelStream& A_stream, int A_msgID)
+{
+    return A_stream.inUse && A_stream.msgID == A_msgID;
+}
+
+static PixelStream* FindPixelStream(int A_msgID)
+{
+    for (int i = 0; i < MAX_PIXEL_STREAMS; i++)
+    {
+        if (IsStreamOf(PixelStreams[i], A_msgID))
+            return &PixelStreams[i];
+    }
+    return NULL;
+}
+
+/*
+ * The slot of a message is only used by the thread sending it, so it is
+ * used without the lock once found
+ */
+static PixelStream* LockedFindPixelStream(int A_msgID)
+{
+    std::lock_guard<std::mutex> lock(PixelStreamLock);
+    return FindPixelStream(A_msgID);
+}
+
+static PixelStream* FindFreePixelStream()
+{
+    for (int i = 0; i < MAX_PIXEL_STREAMS; i++)
+    {
+        if (!PixelStreams[i].inUse)
+            return &PixelStreams[i];
+    }
+    return NULL;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PixelStreamInit
+ *
+ *  Parameters  :   A_thresholdMB - Objects of at least this size are
+ *                                  streamed, 0 to read every object whole
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void PixelStreamInit(int A_thresholdMB)
+{
+    StreamThresholdBytes = A_thresholdMB > 0 ? (size_t)A_thresholdMB * 1024 * 1024 : 0;
+}
+
+bool ShouldStreamPixelData(size_t A_fileBytes)
+{
+    return StreamThresholdBytes > 0 && A_fileBytes >= StreamThresholdBytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ApplyPixelStreaming
+ *
+ *  Parameters  :   A_stream   - true to stream the pixel data of the next
+ *                               file opened with OpenFileObject
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void ApplyPixelStreaming(bool A_stream)
+{
+    StreamNextFile = A_stream;
+}
+
+static long StreamHeaderLength(TRANSFER_SYNTAX A_syntax)
+{
+    for (size_t i = 0; i < sizeof(StreamSyntaxes) / sizeof(StreamSyntaxes[0]); i++)
+    {
+        if (StreamSyntaxes[i].syntax == A_syntax)
+            return StreamSyntaxes[i].headerLength;
+    }
+    return 0;
+}
+
+static long PixelDataHeaderLength(int A_msgID)
+{
+    TRANSFER_SYNTAX syntax;
+    char            transferSyntaxUID[UI_LENGTH + 2] = { 0 };
+
+    if (MC_Get_Value_To_String(A_msgID, MC_ATT_TRANSFER_SYNTAX_UID, sizeof(transferSyntaxUID), transferSyntaxUID) != MC_NORMAL_COMPLETION
+        || MC_Get_Enum_From_Transfer_Syntax(transferSyntaxUID, &syntax) != MC_NORMAL_COMPLETION)
+        return 0;
+    return StreamHeaderLength(syntax);
+}
+
+static bool ReadPixelDataHeader(FILE* A_fp, long A_offset, long A_headerLength, unsigned char* A_header)
+{
+    return fseek(A_fp, A_offset, SEEK_SET) == 0 && fread(A_header, 1, A_headerLength, A_fp) == (size_t)A_headerLength;
+}
+
+static unsigned long LittleEndian32(const unsigned char* A_bytes)
+{
+    return (unsigned long)A_bytes[0] | ((unsigned long)A_bytes[1] << 8) | ((unsigned long)A_bytes[2] << 16) | ((unsigned long)A_bytes[3] << 24);
+}
+
+static bool ReadPixelDataElement(char* A_filename, long A_offset, long A_headerLength, unsigned char* A_header)
+{
+    static const unsigned char pixelDataTag[4] = { 0xE0, 0x7F, 0x10, 0x00 };
+    FILE* fp = fopen(A_filename, BINARY_READ);
+
+    if (!fp)
+        return false;
+    bool found = ReadPixelDataHeader(fp, A_offset, A_headerLength, A_header) && memcmp(A_header, pixelDataTag, 4) == 0;
+    fclose(fp);
+    return found;
+}
+
+/*
+ * Check that the element at A_offset is the pixel data and read the
+ * position and length of its value.  Undefined length (encapsulated
+ * pixel data) is not streamed.
+ */
+static bool LocatePixelData(char* A_filename, long A_offset, long A_headerLength, PixelStream* A_stream)
+{
+    unsigned char header[12] = { 0 };
+
+    if (A_headerLength == 0 || !ReadPixelDataElement(A_filename, A_offset, A_headerLength, header))
+        return false;
+
+    A_stream->length = LittleEndian32(header + A_headerLength - 4);
+    A_stream->valueOffset = A_offset + A_headerLength;
+    return A_stream->length != 0xFFFFFFFFUL;
+}
+
+static MC_STATUS OpenWholeFile(int A_appID, int A_msgID, CBinfo& A_callbackInfo)
+{
+    CloseCallBackInfo(A_callbackInfo);
+    memset(&A_callbackInfo, 0, sizeof(A_callbackInfo));
+
+    MC_STATUS mcStatus = MC_Empty_File(A_msgID);
+    if (mcStatus != MC_NORMAL_COMPLETION)
+        return mcStatus;
+    return MC_Open_File(A_appID, A_msgID, &A_callbackInfo, GetFileReadCallback());
+}
+
+/*
+ * The callback is registered only while it is attached to the streamed
+ * message, so files read with MC_Open_File keep their pixel data in the
+ * message.
+ */
+static MC_STATUS AttachPixelStream(int A_appID, int A_msgID, char* A_filename, PixelStream* A_stream)
+{
+    MC_STATUS mcStatus;
+
+    mcStatus = MC_Register_Callback_Function(A_appID, MC_ATT_PIXEL_DATA, NULL, PixelDataCallback);
+    if (mcStatus != MC_NORMAL_COMPLETION)
+        return mcStatus;
+    mcStatus = MC_Set_Message_Callbacks(A_appID, A_msgID);
+    MC_Release_Callback_Function(A_appID, MC_ATT_PIXEL_DATA);
+
+    strncpy(A_stream->fname, A_filename, sizeof(A_stream->fname) - 1);
+    A_stream->msgID = A_msgID;
+    A_stream->inUse = mcStatus == MC_NORMAL_COMPLETION;
+    return mcStatus;
+}
+
+/*
+ * A slot is claimed and attached under the lock, so messages read on
+ * several threads do not take the same slot
+ */
+static MC_STATUS StreamOpenedFile(int A_appID, int A_msgID, char* A_filename, long A_offset, CBinfo& A_callbackInfo)
+{
+    ReleasePixelStream(A_msgID);
+
+    std::unique_lock<std::mutex> lock(PixelStreamLock);
+    PixelStream* stream = FindFreePixelStream();
+
+    if (!stream || !LocatePixelData(A_filename, A_offset, PixelDataHeaderLength(A_msgID), stream))
+    {
+        lock.unlock();
+        return OpenWholeFile(A_appID, A_msgID, A_callbackInfo);
+    }
+
+    LogMessage(LOG_LEVEL_DEBUG, "Streaming %lu bytes of pixel data from %s\n", stream->length, A_filename);
+    A_callbackInfo.bytesRead += stream->length;
+    return AttachPixelStream(A_appID, A_msgID, A_filename, stream);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   OpenFileObject
+ *
+ *  Parameters  :   A_appID        - Application ID registered
+ *                  A_msgID        - Empty file object to read into
+ *                  A_filename     - Name of file to open
+ *                  A_callbackInfo - Read state used by the read callback
+ *
+ *  Returns     :   MC_NORMAL_COMPLETION on success
+ *                  any other MC_STATUS value on failure.
+ *
+ *  Description :   Read a Part 10 file into a file object.  When streaming
+ *                  was selected with ApplyPixelStreaming, reading stops at
+ *                  the pixel data, which is supplied by PixelDataCallback
+ *                  when the message is sent.
+ *
+ ****************************************************************************/
+MC_STATUS OpenFileObject(int A_appID, int A_msgID, char* A_filename, CBinfo& A_callbackInfo)
+{
+    long      offset = 0;
+    MC_STATUS mcStatus;
+
+    if (!StreamNextFile)
+        return MC_Open_File(A_appID, A_msgID, &A_callbackInfo, GetFileReadCallback());
+
+    mcStatus = MC_Open_File_Upto_Tag(A_appID, A_msgID, &A_callbackInfo, MC_ATT_PIXEL_DATA, &offset, GetFileReadCallback());
+    if (mcStatus != MC_NORMAL_COMPLETION)
+        return mcStatus;
+    return StreamOpenedFile(A_appID, A_msgID, A_filename, offset, A_callbackInfo);
+}
+
+static bool OpenPixelStreamFile(PixelStream* A_stream)
+{
+    if (!A_stream->fp)
+        A_stream->fp = fopen(A_stream->fname, BINARY_READ);
+    return A_stream->fp != NULL;
+}
+
+static bool AllocatePixelStreamBuffer(PixelStream* A_stream)
+{
+    if (!A_stream->buffer)
+        A_stream->buffer = (char*)malloc(STREAM_CHUNK_SIZE);
+    return A_stream->buffer != NULL;
+}
+
+/*
+ * The mapping starts on the boundary before the value that the system
+ * maps from
+ */
+static bool MapPixelStream(PixelStream* A_stream)
+{
+    long long start = A_stream->valueOffset - A_stream->valueOffset % MapGranularity();
+    size_t    length = (size_t)(A_stream->valueOffset - start) + A_stream->length;
+
+    A_stream->view = A_stream->length ? MapRegion(A_stream->fname, start, length) : NULL;
+    A_stream->viewLength = length;
+    A_stream->mapped = A_stream->view ? (char*)A_stream->view + (A_stream->valueOffset - start) : NULL;
+    return A_stream->view != NULL;
+}
+
+static bool IsMapped(PixelStream* A_stream)
+{
+    return A_stream->view || MapPixelStream(A_stream);
+}
+
+static bool RewindReadStream(PixelStream* A_stream)
+{
+    return OpenPixelStreamFile(A_stream) && AllocatePixelStreamBuffer(A_stream)
+        && fseek(A_stream->fp, A_stream->valueOffset, SEEK_SET) == 0;
+}
+
+/*
+ * The toolkit asks for the value from the start again if the message is
+ * sent more than once, e.g. when it is retried.
+ */
+static bool RewindPixelStream(PixelStream* A_stream, int A_isFirst)
+{
+    if (!A_isFirst)
+        return true;
+    A_stream->remaining = A_stream->length;
+    return IsMapped(A_stream) || RewindReadStream(A_stream);
+}
+
+static bool TakeMappedChunk(PixelStream* A_stream, size_t A_chunk, size_t& A_bytes, void** A_dataBuffer)
+{
+    *A_dataBuffer = A_stream->mapped + (A_stream->length - A_stream->remaining);
+    A_bytes = A_chunk;
+    return true;
+}
+
+static bool ReadPixelChunk(PixelStream* A_stream, size_t A_chunk, size_t& A_bytes, void** A_dataBuffer)
+{
+    A_bytes = fread(A_stream->buffer, 1, A_chunk, A_stream->fp);
+    *A_dataBuffer = A_stream->buffer;
+    return A_bytes == A_chunk;
+}
+
+static bool NextPixelChunk(PixelStream* A_stream, int A_isFirst, size_t& A_bytes, void** A_dataBuffer)
+{
+    if (!RewindPixelStream(A_stream, A_isFirst))
+        return false;
+
+    size_t chunk = (size_t)std::min(A_stream->remaining, (unsigned long)STREAM_CHUNK_SIZE);
+    if (A_stream->view)
+        return TakeMappedChunk(A_stream, chunk, A_bytes, A_dataBuffer);
+    return ReadPixelChunk(A_stream, chunk, A_bytes, A_dataBuffer);
+}
+
+static MC_STATUS SupplyPixelData(PixelStream* A_stream, unsigned long* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast)
+{
+    size_t bytesRead = 0;
+
+    if (!NextPixelChunk(A_stream, A_isFirst, bytesRead, A_dataBuffer))
+        return MC_CANNOT_COMPLY;
+
+    A_stream->remaining -= bytesRead;
+    *A_dataSize = (unsigned long)bytesRead;
+    *A_isLast = A_stream->remaining == 0;
+    return MC_NORMAL_COMPLETION;
+}
+
+static MC_STATUS HandleStreamRequest(PixelStream* A_stream, CALLBACK_TYPE A_type, unsigned long* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast)
+{
+    if (A_type == REQUEST_FOR_DATA_LENGTH)
+    {
+        *A_dataSize = A_stream->length;
+        return MC_NORMAL_COMPLETION;
+    }
+    if (A_type == REQUEST_FOR_DATA)
+        return SupplyPixelData(A_stream, A_dataSize, A_dataBuffer, A_isFirst, A_isLast);
+    return MC_NORMAL_COMPLETION;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PixelDataCallback
+ *
+ *  Parameters  :   A_msgID      - Message whose pixel data is requested
+ *                  A_tag        - MC_ATT_PIXEL_DATA
+ *                  A_userInfo   - Not used
+ *                  A_type       - REQUEST_FOR_DATA_LENGTH or
+ *                                 REQUEST_FOR_DATA when sending
+ *                  A_dataSize   - Length of the value or of this chunk
+ *                  A_dataBuffer - Chunk of the value returned here
+ *                  A_isFirst    - Set to non-zero value on first call
+ *                  A_isLast     - Set to 1 with the last chunk
+ *
+ *  Returns     :   MC_NORMAL_COMPLETION on success
+ *                  MC_CANNOT_COMPLY on failure
+ *
+ *  Description :   Callback registered for the pixel data of streamed
+ *                  messages.  Supplies the value in chunks of
+ *                  STREAM_CHUNK_SIZE bytes of the mapping of the file, or
+ *                  read from it when it is not mapped.
+ *
+ ****************************************************************************/
+MC_STATUS NOEXP_FUNC PixelDataCallback(int A_msgID, unsigned long A_tag, void* A_userInfo, CALLBACK_TYPE A_type,
+    unsigned long* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast)
+{
+    PixelStream* stream = LockedFindPixelStream(A_msgID);
+    if (!stream)
+        return MC_CANNOT_COMPLY;
+    return HandleStreamRequest(stream, A_type, A_dataSize, A_dataBuffer, A_isFirst, A_isLast);
+}
+
+static void ClosePixelStream(PixelStream* A_stream)
+{
+    if (A_stream->fp)
+        fclose(A_stream->fp);
+    if (A_stream->view)
+        UnmapRegion(A_stream->view, A_stream->viewLength);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReleasePixelStream
+ *
+ *  Parameters  :   A_msgID    - Message about to be freed
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Close or unmap the file of the message's pixel data
+ *                  stream, if it has one.  The buffer stays with the slot
+ *                  for the next streamed message.
+ *
+ ****************************************************************************/
+void ReleasePixelStream(int A_msgID)
+{
+    std::lock_guard<std::mutex> lock(PixelStreamLock);
+    PixelStream* stream = FindPixelStream(A_msgID);
+    if (!stream)
+        return;
+
+    char* buffer = stream->buffer;
+    ClosePixelStream(stream);
+    memset(stream, 0, sizeof(PixelStream));
+    stream->buffer = buffer;
+}
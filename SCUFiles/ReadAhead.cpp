@@ -0,0 +1,144 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Read-ahead hints
+ *
+ *  While an image is sent, the kernel is asked to start reading the next
+ *  files of the instance list (POSIX_FADV_WILLNEED), up to a number of
+ *  files and a number of bytes.  Once a file has been acknowledged its
+ *  pages are dropped again (POSIX_FADV_DONTNEED), so the files sent do not
+ *  push the rest of the page cache out.
+ *
+ *  The hints are only given where posix_fadvise is available; elsewhere
+ *  the functions do nothing.
+ *
+ ****************************************************************************/
+
+static int    ReadAheadFiles = DEFAULT_READ_AHEAD_FILES;
+static size_t ReadAheadBudget = (size_t)DEFAULT_READ_AHEAD_MB * 1024 * 1024;
+
+/*
+ * A_length of 0 covers the whole file
+ */
+#if defined(_WIN32)
+static bool AdviseFile(const char* A_filename, bool A_willNeed, size_t A_length)
+{
+    return false;
+}
+#else
+static bool AdviseFile(const char* A_filename, bool A_willNeed, size_t A_length)
+{
+    int fd = open(A_filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    bool advised = posix_fadvise(fd, 0, (off_t)A_length, A_willNeed ? POSIX_FADV_WILLNEED : POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return advised;
+}
+#endif
+
+static bool WithinReadAheadWindow(int A_files, size_t A_bytes)
+{
+    return A_files < ReadAheadFiles && A_bytes < ReadAheadBudget;
+}
+
+/*
+ * Each file is hinted once, at most for the bytes left in the window, and
+ * the bytes hinted are charged against the budget of every window it is
+ * in.  Files read with O_DIRECT bypass the page cache and are not hinted.
+ */
+static size_t ReadAheadNode(InstanceNode* A_node, size_t A_room)
+{
+    if (!A_node->readAheadIssued && !ShouldReadDirect(A_node->fileBytes))
+    {
+        A_node->readAheadBytes = std::min((size_t)A_node->fileBytes, A_room);
+        A_node->readAheadIssued = (SAMP_BOOLEAN)AdviseFile(A_node->fname, true, A_node->readAheadBytes);
+    }
+    return A_node->readAheadBytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReadAheadInit
+ *
+ *  Parameters  :   A_files    - Number of upcoming files to hint, 0 for
+ *                               none, -1 for the default
+ *                  A_budgetMB - Bytes of upcoming files to hint, in MB,
+ *                               -1 for the default
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void ReadAheadInit(int A_files, int A_budgetMB)
+{
+    size_t budgetMB = A_budgetMB >= 0 ? (size_t)A_budgetMB : DEFAULT_READ_AHEAD_MB;
+
+    ReadAheadFiles = A_files >= 0 ? A_files : DEFAULT_READ_AHEAD_FILES;
+    ReadAheadBudget = budgetMB * 1024 * 1024;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReadAheadNext
+ *
+ *  Parameters  :   A_node     - The next upcoming file
+ *                  A_files    - Files in the window so far, counted here
+ *                  A_bytes    - Bytes in the window so far, counted here
+ *
+ *  Returns     :   false once the window is full and A_node was not
+ *                  hinted
+ *
+ *  Description :   Ask the kernel to read A_node if the window of
+ *                  upcoming files has room for it.
+ *
+ ****************************************************************************/
+bool ReadAheadNext(InstanceNode* A_node, int* A_files, size_t* A_bytes)
+{
+    if (!WithinReadAheadWindow(*A_files, *A_bytes))
+        return false;
+    *A_bytes += ReadAheadNode(A_node, ReadAheadBudget - *A_bytes);
+    (*A_files)++;
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReadAheadFrom
+ *
+ *  Parameters  :   A_current  - The node being sent
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Ask the kernel to read the files following A_current,
+ *                  up to the number of files and bytes of -r.  Only the
+ *                  start of the file that crosses the byte budget is
+ *                  hinted.
+ *
+ ****************************************************************************/
+void ReadAheadFrom(InstanceNode* A_current)
+{
+    size_t        bytes = 0;
+    int           files = 0;
+    InstanceNode* node = A_current->Next;
+
+    while (node && ReadAheadNext(node, &files, &bytes))
+        node = node->Next;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   DropFromPageCache
+ *
+ *  Parameters  :   A_node     - The node whose response was received
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Tell the kernel the file's pages are no longer needed.
+ *
+ ****************************************************************************/
+void DropFromPageCache(InstanceNode* A_node)
+{
+    AdviseFile(A_node->fname, false, 0);
+}
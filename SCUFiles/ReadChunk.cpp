@@ -0,0 +1,141 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Read chunk size
+ *
+ *  MediaToFileObj reads each file in chunks whose size is chosen from the
+ *  size of the file and the throughput measured on the files read so far,
+ *  between MIN_READ_CHUNK and MAX_READ_CHUNK.  A file that fits is read in
+ *  one chunk; a larger one in chunks that take about READ_CHUNK_TARGET_MS
+ *  to read at the measured throughput, so fast devices get few large reads
+ *  and slow ones do not hold up the toolkit on a single read.
+ *
+ *  The throughput is averaged over the files of at least MIN_READ_CHUNK
+ *  bytes; until one has been read only the file size is used.
+ *
+ ****************************************************************************/
+
+static std::mutex    ChunkLock;
+static double        ReadThroughput = 0;     /* bytes per second, 0 until measured */
+static thread_local size_t NextChunkSize = MIN_READ_CHUNK;
+static size_t        LargestChunk = 0;
+static unsigned long ChunkReads = 0;
+static double        ChunkBytes = 0;
+
+static size_t RoundUpToChunk(double A_bytes)
+{
+    size_t chunks = (size_t)((A_bytes + MIN_READ_CHUNK - 1) / MIN_READ_CHUNK);
+    return std::min(std::max(chunks, (size_t)1), (size_t)(MAX_READ_CHUNK / MIN_READ_CHUNK)) * MIN_READ_CHUNK;
+}
+
+static size_t ThroughputChunkSize()
+{
+    std::lock_guard<std::mutex> lock(ChunkLock);
+    if (ReadThroughput == 0)
+        return MAX_READ_CHUNK;
+    return RoundUpToChunk(ReadThroughput * READ_CHUNK_TARGET_MS / 1000);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ReadChunkInit
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Forget the throughput measured and the read statistics.
+ *
+ ****************************************************************************/
+void ReadChunkInit(void)
+{
+    std::lock_guard<std::mutex> lock(ChunkLock);
+    ReadThroughput = 0;
+    LargestChunk = 0;
+    ChunkReads = 0;
+    ChunkBytes = 0;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ChooseReadChunkSize
+ *
+ *  Parameters  :   A_fileBytes - Size of the file about to be read
+ *
+ *  Returns     :   size_t, bytes to read at a time, a multiple of
+ *                  MIN_READ_CHUNK
+ *
+ *  Description :   One byte more than the file is asked for, so the end
+ *                  of a file read in one chunk is seen on the same read.
+ *
+ ****************************************************************************/
+size_t ChooseReadChunkSize(size_t A_fileBytes)
+{
+    return std::min(RoundUpToChunk((double)A_fileBytes + 1), ThroughputChunkSize());
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ApplyReadChunkSize
+ *
+ *  Parameters  :   A_fileBytes - Size of the next file opened with
+ *                                OpenFileObject
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void ApplyReadChunkSize(size_t A_fileBytes)
+{
+    NextChunkSize = ChooseReadChunkSize(A_fileBytes);
+}
+
+size_t NextReadChunkSize(void)
+{
+    return NextChunkSize;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   RecordFileRead
+ *
+ *  Parameters  :   A_info     - Read state of a file read to the end
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Add the file to the read statistics and to the measured
+ *                  throughput.
+ *
+ ****************************************************************************/
+void RecordFileRead(const CBinfo* A_info)
+{
+    std::lock_guard<std::mutex> lock(ChunkLock);
+    ChunkReads += A_info->reads;
+    ChunkBytes += (double)A_info->bytesRead;
+    LargestChunk = std::max(LargestChunk, A_info->bufferLength);
+
+    if (A_info->bytesRead < MIN_READ_CHUNK || A_info->readSeconds <= 0)
+        return;
+    double throughput = A_info->bytesRead / A_info->readSeconds;
+    ReadThroughput = ReadThroughput == 0 ? throughput : 0.75 * ReadThroughput + 0.25 * throughput;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PrintReadChunkStats
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Print the number of reads, their average and largest
+ *                  size and the measured throughput.
+ *
+ ****************************************************************************/
+void PrintReadChunkStats(void)
+{
+    std::lock_guard<std::mutex> lock(ChunkLock);
+    LogMessage(LOG_LEVEL_INFO, "File reads: %lu, average %luKB, largest chunk %luKB, %luMB/s\n",
+        ChunkReads, (unsigned long)(ChunkBytes / std::max(ChunkReads, 1UL) / 1024),
+        (unsigned long)(LargestChunk / 1024), (unsigned long)(ReadThroughput / (1024 * 1024)));
+}
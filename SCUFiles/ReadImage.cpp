@@ -26,8 +26,16 @@ SAMP_BOOLEAN ReadImage(STORAGE_OPTIONS* A_options, int A_appID, InstanceNode* A_
     FORMAT_ENUM             format = UNKNOWN_FORMAT;
     SAMP_BOOLEAN            sampBool = SAMP_FALSE;
 
+    /*
+     * Wait until the message fits in the memory budget
+     */
+    ReserveNodeMemory(A_node);
+    ApplyLargeDataStore(A_node->largeDataInFile == SAMP_TRUE);
+    ApplyPixelStreaming(A_node->streamPixelData == SAMP_TRUE);
+    ApplyDirectRead(ShouldReadDirect(A_node->fileBytes));
+    ApplyReadChunkSize(A_node->fileBytes);
 
-    format = CheckFileFormat(A_node->fname);
+    format = GetNodeFormat(A_node);
     if (format == MEDIA_FORMAT)
     {
         A_node->mediaFormat = SAMP_TRUE;
@@ -42,7 +50,6 @@ SAMP_BOOLEAN ReadImage(STORAGE_OPTIONS* A_options, int A_appID, InstanceNode* A_
     {
         ValidImageCheck(A_node);
     }
-    fflush(stdout);
     return sampBool;
 }
 void ValidImageCheck(InstanceNode* A_node)
@@ -90,67 +97,18 @@ void ValidImageCheck(InstanceNode* A_node)
 bool CheckTransferSyntax(int A_syntax)
 {
     //Associated with ReadFileFromMedia checks whether transfer syntax is supported or not
-    map<int, int> MapTransferSyntaxToValue;
-
-    MapTransferSyntaxToValue[DEFLATED_EXPLICIT_LITTLE_ENDIAN] = 1;
-    MapTransferSyntaxToValue[EXPLICIT_BIG_ENDIAN] = 1;
-    MapTransferSyntaxToValue[EXPLICIT_LITTLE_ENDIAN] = 1;
-    MapTransferSyntaxToValue[HEVC_H265_M10P_LEVEL_5_1] = 1;
-    MapTransferSyntaxToValue[HEVC_H265_MP_LEVEL_5_1] = 1;
-    MapTransferSyntaxToValue[IMPLICIT_BIG_ENDIAN] = 1;
-    MapTransferSyntaxToValue[IMPLICIT_LITTLE_ENDIAN] = 1;
-    MapTransferSyntaxToValue[JPEG_2000] = 1;
-    MapTransferSyntaxToValue[JPEG_2000_LOSSLESS_ONLY] = 1;
-    MapTransferSyntaxToValue[JPEG_2000_MC] = 1;
-    MapTransferSyntaxToValue[JPEG_2000_MC_LOSSLESS_ONLY] = 1;
-    MapTransferSyntaxToValue[JPEG_BASELINE] = 1;
-    MapTransferSyntaxToValue[JPEG_EXTENDED_2_4] = 1;
-    MapTransferSyntaxToValue[JPEG_EXTENDED_3_5] = 1;
-    MapTransferSyntaxToValue[JPEG_SPEC_NON_HIER_6_8] = 1;
-    MapTransferSyntaxToValue[JPEG_SPEC_NON_HIER_7_9] = 1;
-    MapTransferSyntaxToValue[JPEG_FULL_PROG_NON_HIER_10_12] = 1;
-    MapTransferSyntaxToValue[JPEG_FULL_PROG_NON_HIER_11_13] = 1;
-    MapTransferSyntaxToValue[JPEG_LOSSLESS_NON_HIER_14] = 1;
-    MapTransferSyntaxToValue[JPEG_LOSSLESS_NON_HIER_15] = 1;
-    MapTransferSyntaxToValue[JPEG_EXTENDED_HIER_16_18] = 1;
-    MapTransferSyntaxToValue[JPEG_EXTENDED_HIER_17_19] = 1;
-    MapTransferSyntaxToValue[JPEG_SPEC_HIER_20_22] = 1;
-    MapTransferSyntaxToValue[JPEG_SPEC_HIER_21_23] = 1;
-    MapTransferSyntaxToValue[JPEG_FULL_PROG_HIER_24_26] = 1;
-    MapTransferSyntaxToValue[JPEG_FULL_PROG_HIER_25_27] = 1;
-    MapTransferSyntaxToValue[JPEG_LOSSLESS_HIER_28] = 1;
-    MapTransferSyntaxToValue[JPEG_LOSSLESS_HIER_29] = 1;
-    MapTransferSyntaxToValue[JPEG_LOSSLESS_HIER_14] = 1;
-    MapTransferSyntaxToValue[JPEG_LS_LOSSLESS] = 1;
-    MapTransferSyntaxToValue[JPEG_LS_LOSSY] = 1;
-    MapTransferSyntaxToValue[JPIP_REFERENCED] = 1;
-    MapTransferSyntaxToValue[JPIP_REFERENCED_DEFLATE] = 1;
-    MapTransferSyntaxToValue[MPEG2_MPHL] = 1;
-    MapTransferSyntaxToValue[MPEG2_MPML] = 1;
-    MapTransferSyntaxToValue[MPEG4_AVC_H264_HP_LEVEL_4_1] = 1;
-    MapTransferSyntaxToValue[MPEG4_AVC_H264_BDC_HP_LEVEL_4_1] = 1;
-    MapTransferSyntaxToValue[MPEG4_AVC_H264_HP_LEVEL_4_2_2D] = 1;
-    MapTransferSyntaxToValue[MPEG4_AVC_H264_HP_LEVEL_4_2_3D] = 1;
-    MapTransferSyntaxToValue[MPEG4_AVC_H264_STEREO_HP_LEVEL_4_2] = 1;
-    MapTransferSyntaxToValue[SMPTE_ST_2110_20_UNCOMPRESSED_PROGRESSIVE_ACTIVE_VIDEO] = 1;
-    MapTransferSyntaxToValue[SMPTE_ST_2110_20_UNCOMPRESSED_INTERLACED_ACTIVE_VIDEO] = 1;
-    MapTransferSyntaxToValue[SMPTE_ST_2110_30_PCM_DIGITAL_AUDIO] = 1;
-    MapTransferSyntaxToValue[PRIVATE_SYNTAX_1] = 1;
-    MapTransferSyntaxToValue[PRIVATE_SYNTAX_2] = 1;
-    MapTransferSyntaxToValue[RLE] = 1;
-    MapTransferSyntaxToValue[INVALID_TRANSFER_SYNTAX] = 0;
-
-    return MapTransferSyntaxToValue[A_syntax];
-
+    return LookupSyntax(A_syntax).supported;
 }
 
 void CloseCallBackInfo(CBinfo& callbackInfo)
 {
     ////Associated with ReadFileFromMedia
+    //The buffer belongs to the thread's read buffer, see GetReadBuffer
     if (callbackInfo.fp)
         fclose(callbackInfo.fp);
-    if (callbackInfo.buffer)
-        free(callbackInfo.buffer);
+    CloseDirectRead(callbackInfo);
+    callbackInfo.fp = NULL;
+    callbackInfo.buffer = NULL;
     return;
 }
 
@@ -158,23 +116,23 @@ MC_STATUS CreateEmptyFileAndStoreIt(int& A_appID, int*& A_msgID, char*& A_filena
 {
     //Associated with ReadFileFromMedia
     MC_STATUS mcStatusTemp;
-    mcStatusTemp = MC_Create_Empty_File(A_msgID, A_filename);
+    mcStatusTemp = CreateFileObject(A_msgID, A_filename);
 
     if (mcStatusTemp != MC_NORMAL_COMPLETION)
     {
 
         PrintError("Unable to create file object", mcStatusTemp);
-        fflush(stdout);
         return(mcStatusTemp);
     }
 
-    mcStatusTemp = MC_Open_File(A_appID, *A_msgID, &callbackInfo, MediaToFileObj);
+    LargeDataStoreBeginRead();
+    mcStatusTemp = OpenFileObject(A_appID, *A_msgID, A_filename, callbackInfo);
+    LargeDataStoreEndRead();
     if (mcStatusTemp != MC_NORMAL_COMPLETION)
     {
         CloseCallBackInfo(callbackInfo);
         PrintError("MC_Open_File failed, unable to read file from media", mcStatusTemp);
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return(mcStatusTemp);
     }
     return mcStatusTemp;
@@ -196,7 +154,7 @@ bool Transfer_Syntax_Encoding(MC_STATUS mcStatus, int*& A_msgID, TRANSFER_SYNTAX
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
 
-        printf("Invalid transfer syntax UID contained in the file: %s\n", transferSyntaxUID);
+        LogMessage(LOG_LEVEL_ERROR, "Invalid transfer syntax UID contained in the file: %s\n", transferSyntaxUID);
         MC_Free_File(A_msgID);
         return false;
     }
@@ -206,22 +164,20 @@ bool Transfer_Syntax_Encoding(MC_STATUS mcStatus, int*& A_msgID, TRANSFER_SYNTAX
 bool Image_Extraction(int*& A_msgID, TRANSFER_SYNTAX*& A_syntax, char*& A_filename, char* sopClassUID, char* sopInstanceUID, size_t& size_sopClassUID, size_t& size_sopInstanceUID)
 {
     MC_STATUS mcStatus;
-    printf("Reading DICOM Part 10 format file in %s: %s\n", GetSyntaxDescription(*A_syntax), A_filename);
+    LogMessage(LOG_LEVEL_INFO, "Reading DICOM Part 10 format file in %s: %s\n", GetSyntaxDescription(*A_syntax), A_filename);
     mcStatus = MC_Get_Value_To_String(*A_msgID, MC_ATT_MEDIA_STORAGE_SOP_CLASS_UID, size_sopClassUID, sopClassUID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Get MC_ATT_AFFECTED_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
+        LogMessage(LOG_LEVEL_ERROR, "Get MC_ATT_AFFECTED_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
 
     mcStatus = MC_Get_Value_To_String(*A_msgID, MC_ATT_MEDIA_STORAGE_SOP_INSTANCE_UID, size_sopInstanceUID, sopInstanceUID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Get MC_ATT_MEDIA_STORAGE_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
+        LogMessage(LOG_LEVEL_ERROR, "Get MC_ATT_MEDIA_STORAGE_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
     return true;
@@ -232,18 +188,16 @@ bool Message_Creation(MC_STATUS mcStatus, int*& A_msgID, char* sopClassUID, char
     mcStatus = MC_Set_Value_From_String(*A_msgID, MC_ATT_AFFECTED_SOP_CLASS_UID, sopClassUID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Set MC_ATT_AFFECTED_SOP_CLASS_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
+        LogMessage(LOG_LEVEL_ERROR, "Set MC_ATT_AFFECTED_SOP_CLASS_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
 
     mcStatus = MC_Set_Value_From_String(*A_msgID, MC_ATT_AFFECTED_SOP_INSTANCE_UID, sopInstanceUID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Set MC_ATT_AFFECTED_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
+        LogMessage(LOG_LEVEL_ERROR, "Set MC_ATT_AFFECTED_SOP_INSTANCE_UID failed. Error %d (%s)\n", (int)mcStatus, MC_Error_Message(mcStatus));
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
     return true;
@@ -257,10 +211,9 @@ bool Syntax_Handling(MC_STATUS mcStatus, int*& A_msgID, TRANSFER_SYNTAX*& A_synt
 
     if (!CheckTransferSyntax(*A_syntax))
     {
-        printf("Warning: Invalid transfer syntax (%s) specified\n", GetSyntaxDescription(*A_syntax));
-        printf("         Not sending image.\n");
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Invalid transfer syntax (%s) specified\n", GetSyntaxDescription(*A_syntax));
+        LogMessage(LOG_LEVEL_WARNING, "         Not sending image.\n");
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
     return true;
@@ -279,7 +232,6 @@ bool Message_Handling(int*& A_msgID, char* sopClassUID, char* sopInstanceUID)
     {
         PrintError("Unable to convert file object to message object", mcStatus);
         MC_Free_File(A_msgID);
-        fflush(stdout);
         return false;
     }
 
@@ -351,7 +303,6 @@ SAMP_BOOLEAN ReadFileFromMedia(STORAGE_OPTIONS* A_options,
         return SAMP_FALSE;
     }
 
-    fflush(stdout);
     return SAMP_TRUE;
 } /* ReadFileFromMedia() */
 
@@ -376,33 +327,20 @@ SAMP_BOOLEAN ReadFileFromMedia(STORAGE_OPTIONS* A_options,
  *                  in the DICOM Part 10 (media) format.
  *
  ****************************************************************************/
-int GetWorkBufferSize()
-{
-    MC_STATUS mcStatus = MC_NORMAL_COMPLETION;
-    int length = 0;
-
-    mcStatus = MC_Get_Int_Config_Value(WORK_BUFFER_SIZE, &length);
-    if (mcStatus != MC_NORMAL_COMPLETION)
-    {
-        length = 64 * 1024;
-    }
-    return length;
-}
-
 bool AllocateBuffer(CBinfo*& callbackInfo)
 {
     if (callbackInfo->bufferLength == 0)
     {
-
-        int length = GetWorkBufferSize();
-
-        callbackInfo->bufferLength = length;
+        /*
+         * Chosen by ApplyReadChunkSize from the size of the file
+         */
+        callbackInfo->bufferLength = NextReadChunkSize();
     }
 
-    callbackInfo->buffer = (char*)(malloc(callbackInfo->bufferLength));
+    callbackInfo->buffer = GetReadBuffer(callbackInfo->bufferLength);
     if (callbackInfo->buffer == NULL)
     {
-        printf("Error: failed to allocate file read buffer [%d] kb", (int)callbackInfo->bufferLength);
+        LogMessage(LOG_LEVEL_ERROR, "Error: failed to allocate file read buffer [%d] kb", (int)callbackInfo->bufferLength);
         return false;
     }
     return true;
@@ -412,25 +350,33 @@ void checkIfBufferSet(int retStatus)
 {
     if (retStatus != 0)
     {
-        printf("WARNING:  Unable to set IO buffering on input file.\n");
+        LogMessage(LOG_LEVEL_WARNING, "WARNING:  Unable to set IO buffering on input file.\n");
     }
 }
 
-bool firstCallProcedure(char*& A_filename, CBinfo*& callbackInfo, int& retStatus, int& A_isFirst)
+bool OpenCallBackFile(char*& A_filename, CBinfo*& callbackInfo, int& retStatus)
 {
-    if (A_isFirst)
-    {
-        callbackInfo->bytesRead = 0;
-        callbackInfo->fp = fopen(A_filename, BINARY_READ);
+    callbackInfo->fp = fopen(A_filename, BINARY_READ);
+    if (!callbackInfo->fp)
+        return false;
 
-        retStatus = setvbuf(callbackInfo->fp, (char*)NULL, _IOFBF, 32768);
-        checkIfBufferSet(retStatus);
+    /*
+     * Each read fills a whole chunk, so stdio buffering would only add a copy
+     */
+    retStatus = setvbuf(callbackInfo->fp, (char*)NULL, _IONBF, 0);
+    checkIfBufferSet(retStatus);
+    return true;
+}
 
-        if (AllocateBuffer(callbackInfo) == false)
-            return false;
+bool firstCallProcedure(char*& A_filename, CBinfo*& callbackInfo, int& retStatus, int& A_isFirst)
+{
+    if (!A_isFirst)
+        return true;
 
-    }
-    return true;
+    callbackInfo->bytesRead = 0;
+    callbackInfo->reads = 0;
+    callbackInfo->readSeconds = 0;
+    return OpenCallBackFile(A_filename, callbackInfo, retStatus) && AllocateBuffer(callbackInfo);
 }
 
 bool SetBuffer(char*& A_filename, CBinfo*& callbackInfo, int& retStatus, int& A_isFirst, void* A_userInfo)
@@ -450,7 +396,6 @@ bool closeCallBackFile(CBinfo*& callbackInfo, int*& A_isLast)
 {
     if (ferror(callbackInfo->fp))
     {
-        free(callbackInfo->buffer);
         callbackInfo->buffer = NULL;
 
         return false;
@@ -459,6 +404,7 @@ bool closeCallBackFile(CBinfo*& callbackInfo, int*& A_isLast)
     if (feof(callbackInfo->fp))
     {
         *A_isLast = 1;
+        RecordFileRead(callbackInfo);
 
         fclose(callbackInfo->fp);
         callbackInfo->fp = NULL;
@@ -474,7 +420,11 @@ bool ReadInCallBackFile(CBinfo*& callbackInfo, size_t& bytes_read, int*& A_isLas
     if (!callbackInfo->fp)
         return false;
 
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     bytes_read = fread(callbackInfo->buffer, 1, callbackInfo->bufferLength, callbackInfo->fp);
+    callbackInfo->readSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    callbackInfo->reads++;
+    callbackInfo->bytesRead += bytes_read;
 
     if (closeCallBackFile(callbackInfo, A_isLast) == false)
         return false;
@@ -502,7 +452,6 @@ MC_STATUS NOEXP_FUNC MediaToFileObj(char* A_filename,
 
     *A_dataBuffer = callbackInfo->buffer;
     *A_dataSize = (int)bytes_read;
-    callbackInfo->bytesRead += bytes_read;
 
     return MC_NORMAL_COMPLETION;
 
@@ -532,37 +481,31 @@ MC_STATUS NOEXP_FUNC MediaToFileObj(char* A_filename,
 FORMAT_ENUM CheckSignatureOfMediaFile(FILE*& fp)
 {
     //Associated with CheckFileFormat checks signature of Media file 
-    char signature[5] = "\0\0\0\0";
+    char preamble[132];
 
     /*
-     * Read the signature, only 4 bytes
+     * Read the preamble and the signature in one read
      */
-    if (fread(signature, 1, 4, fp) == 4)
+    if (fread(preamble, 1, sizeof(preamble), fp) != sizeof(preamble))
     {
-        /*
-         * if it is the signature, return true.  The file is
-         * definately in the DICOM Part 10 format.
-         */
-        if (!strcmp(signature, "DICM"))
-        {
-            fclose(fp);
-            return MEDIA_FORMAT;
-        }
+        return UNKNOWN_FORMAT;
     }
-    return UNKNOWN_FORMAT;
+    /*
+     * if it is the signature, the file is definately
+     * in the DICOM Part 10 format.
+     */
+    return memcmp(preamble + 128, "DICM", 4) == 0 ? MEDIA_FORMAT : UNKNOWN_FORMAT;
 }
 
 FORMAT_ENUM CheckFileFormat(char* A_filename)
 {
-    FILE* fp;
-    if ((fp = fopen(A_filename, BINARY_READ)) != NULL)
+    FORMAT_ENUM format;
+    FILE* fp = fopen(A_filename, BINARY_READ);
+    if (fp == NULL)
     {
-        if (fseek(fp, 128, SEEK_SET) == 0)
-        {
-            return CheckSignatureOfMediaFile(fp);
-        }
-
+        return UNKNOWN_FORMAT;
     }
+    format = CheckSignatureOfMediaFile(fp);
     fclose(fp);
-    return UNKNOWN_FORMAT;
+    return format;
 } /* CheckFileFormat() */
@@ -27,7 +27,6 @@ int checkForNormalCompletionResponse(MC_STATUS mcStatus)
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Read_Message failed", mcStatus);
-        fflush(stdout);
         return (SAMP_FALSE);
     }
     return (SAMP_TRUE);
@@ -38,7 +37,6 @@ int checkMessageIdResponse(MC_STATUS mcStatus)
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Get_Value_To_UInt for Message ID Being Responded To failed.  Unable to process response message.", mcStatus);
-        fflush(stdout);
         return(SAMP_TRUE);
     }
     return(SAMP_FALSE);
@@ -49,13 +47,12 @@ int checkForSopInstanceResponse(MC_STATUS mcStatus)
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Get_Value_To_String for affected SOP instance failed.  Unable to process response message.", mcStatus);
-        fflush(stdout);
         return(SAMP_TRUE);
     }
     return(SAMP_FALSE);
 }
 
-void checkForNodeList(STORAGE_OPTIONS* A_options, unsigned int dicomMsgID, InstanceNode* node, char* affectedSOPinstance, InstanceNode** A_list)
+InstanceNode* checkForNodeList(STORAGE_OPTIONS* A_options, unsigned int dicomMsgID, InstanceNode* node, char* affectedSOPinstance, InstanceNode** A_list)
 {
     if (!A_options->StreamMode)
     {
@@ -72,7 +69,7 @@ void checkForNodeList(STORAGE_OPTIONS* A_options, unsigned int dicomMsgID, Insta
             node = node->Next;
         }
     }
-    return;
+    return node;
 }
 
 int checkForResponseMessageFailure(MC_STATUS mcStatus)
@@ -80,7 +77,6 @@ int checkForResponseMessageFailure(MC_STATUS mcStatus)
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Free_Message failed for response message", mcStatus);
-        fflush(stdout);
         return (SAMP_TRUE);
     }
     return (SAMP_FALSE);
@@ -93,7 +89,7 @@ SAMP_BOOLEAN ReadResponseMessages(STORAGE_OPTIONS* A_options, int A_associationI
     int             responseMessageID;
     char* responseService;
     MC_COMMAND      responseCommand;
-    static char     affectedSOPinstance[UI_LENGTH + 2];
+    char            affectedSOPinstance[UI_LENGTH + 2];
     unsigned int    dicomMsgID;
     InstanceNode* node = (InstanceNode*)A_node;
 
@@ -104,40 +100,46 @@ SAMP_BOOLEAN ReadResponseMessages(STORAGE_OPTIONS* A_options, int A_associationI
     if (mcStatus == MC_TIMEOUT)
         return (SAMP_TRUE);
 
-    checkForNormalCompletionResponse(mcStatus);
+    if (!checkForNormalCompletionResponse(mcStatus))
+        return (SAMP_FALSE);
 
     mcStatus = MC_Get_Value_To_UInt(responseMessageID, MC_ATT_MESSAGE_ID_BEING_RESPONDED_TO, &dicomMsgID);
-    checkMessageIdResponse(mcStatus);
+    if (checkMessageIdResponse(mcStatus))
+    {
+        MC_Free_Message(&responseMessageID);
+        return (SAMP_TRUE);
+    }
 
     mcStatus = MC_Get_Value_To_String(responseMessageID, MC_ATT_AFFECTED_SOP_INSTANCE_UID, sizeof(affectedSOPinstance), affectedSOPinstance);
-    checkForSopInstanceResponse(mcStatus);
+    if (checkForSopInstanceResponse(mcStatus))
+    {
+        MC_Free_Message(&responseMessageID);
+        return (SAMP_TRUE);
+    }
 
-    checkForNodeList(A_options, dicomMsgID, node, affectedSOPinstance, A_list);
+    node = checkForNodeList(A_options, dicomMsgID, node, affectedSOPinstance, A_list);
 
     if (!node)
     {
-        printf("Message ID Being Responded To tag does not match message sent over association: %d\n", dicomMsgID);
+        LogMessage(LOG_LEVEL_WARNING, "Message ID Being Responded To tag does not match message sent over association: %d\n", dicomMsgID);
         MC_Free_Message(&responseMessageID);
-        fflush(stdout);
         return (SAMP_TRUE);
     }
 
     node->responseReceived = SAMP_TRUE;
+    DropFromPageCache(node);
 
-    sampBool = CheckResponseMessage(responseMessageID, &node->status, node->statusMeaning, sizeof(node->statusMeaning));
-    if (!sampBool)
-    {
-        node->failedResponse = SAMP_TRUE;
-    }
-
-    if ((A_options->Verbose) || (node->status != C_STORE_SUCCESS))
-        printf("   Status: %s\n", node->statusMeaning);
+    sampBool = CheckResponseMessage(responseMessageID, &node->status, node->statusMeaning, sizeof(node->statusMeaning), &node->action);
+    node->failedResponse = sampBool ? SAMP_FALSE : SAMP_TRUE;
 
-    node->failedResponse = SAMP_FALSE;
+    if ((A_options->Verbose) || (ClassifyStoreStatus(node->status) != STATUS_CLASS_SUCCESS))
+        LogMessage(LOG_LEVEL_INFO, "   Status: %s\n", node->statusMeaning);
 
     mcStatus = MC_Free_Message(&responseMessageID);
     checkForResponseMessageFailure(mcStatus);
-    fflush(stdout);
+
+    if (node->action == STORE_ACTION_ABORT)
+        return (SAMP_FALSE);
     return (SAMP_TRUE);
 }
 
@@ -154,121 +156,79 @@ SAMP_BOOLEAN ReadResponseMessages(STORAGE_OPTIONS* A_options, int A_associationI
  *                                     returned here.
  *                  A_statusMeaningLength - The size of the buffer at
  *                                     A_statusMeaning.
+ *                  A_action         - What to do with the instance is
+ *                                     returned here.
  *
  *  Returns     :   SAMP_TRUE on success or warning status
  *                  SAMP_FALSE on failure status
  *
  *  Description :   Examine the status tag in the response to see if we
  *                  the C-STORE-RQ was successfully received by the SCP.
+ *                  The status is classified with the status table in
+ *                  LookupTables.cpp and counted.
  *
  ****************************************************************************/
-void checkForSuccessResponse(unsigned int *A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    if (A_status != (unsigned int*)C_STORE_SUCCESS)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "C-STORE Success.", A_statusMeaningLength);
+static std::atomic<unsigned long> StoreStatusCounts[NUM_STORE_STATUS_ENTRIES];
 
-}
-
-void checkForElementCoercionWarningResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
+SAMP_BOOLEAN CheckResponseMessage(int A_responseMsgID, unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength, STORE_ACTION* A_action)
 {
-    if (*A_status != C_STORE_WARNING_ELEMENT_COERCION)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "Warning: Element Coersion... Continuing.", A_statusMeaningLength);
-}
+    MC_STATUS mcStatus;
+    int       index;
 
-void checkForInvalidDatasetWarningResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    if (*A_status != C_STORE_WARNING_INVALID_DATASET)
+    mcStatus = MC_Get_Value_To_UInt(A_responseMsgID, MC_ATT_STATUS, A_status);
+    if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        return;
+        /* Problem with MC_Get_Value_To_UInt */
+        PrintError("MC_Get_Value_To_UInt for response status failed", mcStatus);
+        strncpy(A_statusMeaning, "Unknown Status", A_statusMeaningLength);
+        *A_action = STORE_ACTION_FAIL_INSTANCE;
+        return SAMP_FALSE;
     }
-    strncpy(A_statusMeaning, "Warning: Invalid Dataset... Continuing.", A_statusMeaningLength);
-}
 
-void checkForElementsDiscardedWarningResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    if (*A_status != C_STORE_WARNING_ELEMENTS_DISCARDED)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "Warning: Elements Discarded... Continuing.", A_statusMeaningLength);
-}
+    /* MC_Get_Value_To_UInt worked.  Check the response status */
 
-void checkForRefusedErrorResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    SAMP_BOOLEAN returnBool = SAMP_TRUE;
-    if (*A_status != C_STORE_FAILURE_REFUSED_NO_RESOURCES)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "ERROR: REFUSED, NO RESOURCES.  ASSOCIATION ABORTING.", A_statusMeaningLength);
-    returnBool = SAMP_FALSE;
-}
+    index = LookupStoreStatusIndex(*A_status);
+    StoreStatusCounts[index]++;
 
-void checkForInvalidDatasetErrorResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    SAMP_BOOLEAN returnBool = SAMP_TRUE;
-    if (*A_status != C_STORE_FAILURE_INVALID_DATASET)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "ERROR: INVALID_DATASET.  ASSOCIATION ABORTING.", A_statusMeaningLength);
-    returnBool = SAMP_FALSE;
-}
+    const StoreStatusEntry& entry = StoreStatusAt(index);
+    strncpy(A_statusMeaning, entry.meaning, A_statusMeaningLength);
+    A_statusMeaning[A_statusMeaningLength - 1] = '\0';
+    *A_action = entry.action;
 
-void checkForUnUnderstandableErrorResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
-{
-    SAMP_BOOLEAN returnBool = SAMP_TRUE;
-    if (*A_status != C_STORE_FAILURE_CANNOT_UNDERSTAND)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "ERROR: CANNOT UNDERSTAND.  ASSOCIATION ABORTING.", A_statusMeaningLength);
-    returnBool = SAMP_FALSE;
+    if (entry.statusClass == STATUS_CLASS_SUCCESS || entry.statusClass == STATUS_CLASS_WARNING)
+        return SAMP_TRUE;
+    return SAMP_FALSE;
 }
 
-void checkForprocessingFailureErrorResponse(unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
+/****************************************************************************
+ *
+ *  Function    :   GetStoreStatusCount
+ *
+ *  Parameters  :   A_status   - C-STORE response status
+ *
+ *  Returns     :   unsigned long, number of responses received so far with
+ *                  a status in the same status table entry
+ *
+ ****************************************************************************/
+unsigned long GetStoreStatusCount(unsigned int A_status)
 {
-    SAMP_BOOLEAN returnBool = SAMP_TRUE;
-    if (*A_status != C_STORE_FAILURE_PROCESSING_FAILURE)
-    {
-        return;
-    }
-    strncpy(A_statusMeaning, "ERROR: PROCESSING FAILURE.  ASSOCIATION ABORTING.", A_statusMeaningLength);
-    returnBool = SAMP_FALSE;
+    return StoreStatusCounts[LookupStoreStatusIndex(A_status)];
 }
 
-SAMP_BOOLEAN CheckResponseMessage(int A_responseMsgID, unsigned int* A_status, char* A_statusMeaning, size_t A_statusMeaningLength)
+/****************************************************************************
+ *
+ *  Function    :   PrintStoreStatusCounts
+ *
+ *  Description :   Display the number of responses received for every
+ *                  status table entry that was seen at least once.
+ *
+ ****************************************************************************/
+void PrintStoreStatusCounts(void)
 {
-    MC_STATUS mcStatus;
-    SAMP_BOOLEAN returnBool = SAMP_TRUE;
-
-    mcStatus = MC_Get_Value_To_UInt(A_responseMsgID, MC_ATT_STATUS, A_status);
-    if (mcStatus != MC_NORMAL_COMPLETION)
+    LogMessage(LOG_LEVEL_INFO, "Response statuses received:\n");
+    for (int i = 0; i < NUM_STORE_STATUS_ENTRIES; i++)
     {
-        /* Problem with MC_Get_Value_To_UInt */
-        PrintError("MC_Get_Value_To_UInt for response status failed", mcStatus);
-        strncpy(A_statusMeaning, "Unknown Status", A_statusMeaningLength);
-        fflush(stdout);
-        return SAMP_FALSE;
+        if (StoreStatusCounts[i] > 0)
+            LogMessage(LOG_LEVEL_INFO, "  %s %8lu  %s\n", StoreStatusAt(i).code, StoreStatusCounts[i].load(), StoreStatusAt(i).meaning);
     }
-
-    /* MC_Get_Value_To_UInt worked.  Check the response status */
-
-    checkForSuccessResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForUnUnderstandableErrorResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForInvalidDatasetWarningResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForElementsDiscardedWarningResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForRefusedErrorResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForInvalidDatasetErrorResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForUnUnderstandableErrorResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    checkForprocessingFailureErrorResponse(A_status, A_statusMeaning, A_statusMeaningLength);
-    fflush(stdout);
-
-    return returnBool;
 }
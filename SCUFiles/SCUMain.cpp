@@ -22,6 +22,11 @@ int main(int argc, const char* argv[])
         return(EXIT_FAILURE);
     }
 
+    /*
+     * From here on messages are queued and written by the logger thread
+     */
+    LogStart(obj.options.Verbose ? LOG_LEVEL_DEBUG : LOG_LEVEL_INFO);
+
     /* ------------------------------------------------------- */
     /* This call MUST be the first call made to the library!!! */
     /* ------------------------------------------------------- */
@@ -36,19 +41,22 @@ int main(int argc, const char* argv[])
      */
     if (obj.InitializeApplication() == false) {
 
+        CrawlStop();
+        PoolStop();
+        LogStop();
         return (EXIT_FAILURE);
     }
 
-    fflush(stdout);
 
     /*
      *   Send all requested images.  Traverse through instanceList to
      *   get all files to send.
      *   Read all images
      *   Send all images that are ready to be sent 
+     *   With -w, keep sending the files written to the watched directory
      */
 
-    obj.StartSendImage();
+    obj.SendImages();
 
     /*
     * Abort Association, free all nodes and Release Application
@@ -59,6 +67,6 @@ int main(int argc, const char* argv[])
     obj.CloseAssociation();
     obj.ReleaseApplication();
 
-    fflush(stdout);
+    LogStop();
     return(EXIT_SUCCESS);
 }
@@ -12,44 +12,114 @@ bool mainclass::InitializeApplication()
     {
         return (false);
     }
+    MemoryBudgetInit(options.MemoryBudgetMB);
+    LargeDataStoreInit(options.ScratchPath, options.SpillThresholdMB);
+    PixelStreamInit(options.StreamThresholdMB);
+    ReadAheadInit(options.ReadAheadFiles, options.ReadAheadMB);
+    DirectReadInit(options.DirectThresholdMB);
+    ReadChunkInit();
+    TranscodeInit(options.Transcode == SAMP_TRUE, options.RleOnly == SAMP_TRUE);
+    DeflateTuneInit(options.TuneDeflate == SAMP_TRUE);
+    ValidateInit(options.ValidatePercent);
 
     /*
      *  Register this DICOM application
      */
-  
+    if (mainclass::RegisterApplication() == false)
+    {
+        return(false);
+    }
+    return mainclass::InitializeList();
+}
+
+bool mainclass::RegisterApplication()
+{
+    if (applicationID != -1)
+    {
+        return true;
+    }
     mcStatus = MC_Register_Application(&applicationID, options.LocalAE);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Unable to register \"%s\":\n", options.LocalAE);
-        printf("\t%s\n", MC_Error_Message(mcStatus));
-        fflush(stdout);
+        LogMessage(LOG_LEVEL_ERROR, "Unable to register \"%s\":\n", options.LocalAE);
+        LogMessage(LOG_LEVEL_ERROR, "\t%s\n", MC_Error_Message(mcStatus));
         return(false);
     }
-    return mainclass::InitializeList();
+    return true;
 }
 
 bool mainclass::InitializeList()
 {
+    if (mainclass::FillList() == false)
+    {
+        return(false);
+    }
+    totalImages = GetNumNodes(instanceList);
+    mainclass::VerboseBeforeConnection();
+    mainclass::LoadNegotiations();
+    return mainclass::StartPool() && mainclass::CreateAssociation();
+}
+
+bool mainclass::FillList()
+{
+    if (options.UseDirectory)
+    {
+        return mainclass::CrawlDirectory();
+    }
+    if (options.UseDicomDir)
+    {
+        return ReadDicomDir(&instanceList, options.DicomDir);
+    }
+    return mainclass::FillListFromArguments();
+}
+
+bool mainclass::FillListFromArguments()
+{
+    if (options.UseWatch)
+    {
+        return WatchStart(options.WatchPath);
+    }
     if (options.UseFileList)
     {
-        /* Read the command line file to create the list */
-        fp = fopen(options.FileList, TEXT_READ);
-        if (!fp)
-        {
-            printf("ERROR: Unable to open %s.\n", options.FileList);
-            fflush(stdout);
-            return(false);
-        }
-        mainclass::ReadFileByFILENAME();
+        return mainclass::OpenFileList();
     }
-    else
+    /* Traverse through the possible names and add them to the list based on the start/stop count */
+    mainclass::ReadFileFromStartStopPosition();
+    return true;
+}
+
+bool mainclass::OpenFileList()
+{
+    /* Read the command line file to create the list */
+    fp = fopen(options.FileList, TEXT_READ);
+    if (!fp)
     {
-        /* Traverse through the possible names and add them to the list based on the start/stop count */
-        mainclass::ReadFileFromStartStopPosition();
+        LogMessage(LOG_LEVEL_ERROR, "ERROR: Unable to open %s.\n", options.FileList);
+        return(false);
     }
-    totalImages = GetNumNodes(instanceList);
-    mainclass::VerboseBeforeConnection();
-    return mainclass::CreateAssociation();
+    mainclass::ReadFileByFILENAME();
+    return true;
+}
+
+/*
+ * Sending starts with the first files found; the rest are added to the
+ * list as the sender reaches its end, see AdvanceNode()
+ */
+bool mainclass::CrawlDirectory()
+{
+    CrawlStart(options.CrawlPath);
+    CrawlAppendFiles(&instanceList);
+    return true;
+}
+
+void mainclass::AdvanceNode()
+{
+    if (!node->Next && options.UseDirectory)
+    {
+        totalImages += CrawlAppendFiles(&instanceList);
+        TranscodeListGrown();
+    }
+    node = node->Next;
 }
 
 void mainclass::ReadFileByFILENAME()
@@ -70,7 +140,7 @@ void mainclass::ReadEachLineInFile()
     sampBool = AddFileToList(&instanceList, fname);
     if (!sampBool)
     {
-        printf("Warning, cannot add SOP instance to File List, image will not be sent [%s]\n", fname);
+        LogMessage(LOG_LEVEL_WARNING, "Warning, cannot add SOP instance to File List, image will not be sent [%s]\n", fname);
     }
 }
 void mainclass::ReadFileFromStartStopPosition()
@@ -81,7 +151,7 @@ void mainclass::ReadFileFromStartStopPosition()
         sampBool = AddFileToList(&instanceList, fname);
         if (!sampBool)
         {
-            printf("Warning, cannot add SOP instance to File List, image will not be sent [%s]\n", fname);
+            LogMessage(LOG_LEVEL_WARNING, "Warning, cannot add SOP instance to File List, image will not be sent [%s]\n", fname);
         }
     }
 }
@@ -103,8 +173,12 @@ char* mainclass::checkServiceList(char* ServiceList)
 MC_STATUS mainclass::OpenAssociation()
 {
     char* tempremoteHostName = mainclass::checkRemoteHostName(options.RemoteHostname);
-    char* tempServiceList = mainclass::checkServiceList(options.ServiceList);
+    char* tempServiceList = mainclass::checkServiceList(StudyServiceList(NegotiatedServiceList(options.RemoteAE, options.ServiceList)));
 
+    if (CheckHostandPort(&options))
+    {
+        return mainclass::OpenRacedAssociation(tempremoteHostName, tempServiceList);
+    }
     return MC_Open_Association(applicationID,
         &associationID,
         options.RemoteAE,
@@ -112,48 +186,154 @@ MC_STATUS mainclass::OpenAssociation()
         tempremoteHostName,
         tempServiceList);
 }
+/*
+ * The connection is made to the first address of the host to answer, see
+ * ConnectRace.cpp.  The toolkit closes the socket with the association.
+ */
+MC_STATUS mainclass::OpenRacedAssociation(char* A_host, char* A_serviceList)
+{
+    MC_SOCKET socket = RaceConnect(A_host, options.RemotePort);
+
+    if (socket == NO_SOCKET)
+    {
+        return MC_TIMEOUT;
+    }
+    return MC_Open_Association_With_Socket(applicationID,
+        &associationID,
+        options.RemoteAE,
+        &options.RemotePort,
+        A_host,
+        A_serviceList,
+        socket);
+}
+
+/*
+ * With -e the associations go to the SCPs of a pool, see ScpPool.cpp,
+ * in place of the remote host and port
+ */
+bool mainclass::StartPool()
+{
+    if (!options.ScpPool[0])
+    {
+        return true;
+    }
+    return PoolStart(options.ScpPool, applicationID, options.RemoteAE, checkServiceList(options.ServiceList));
+}
+
+/*
+ * With -k the services the remote AE accepted before are proposed, see
+ * NegotiationCache.cpp
+ */
+void mainclass::LoadNegotiations()
+{
+    if (options.NegotiationCache[0])
+    {
+        NegotiationCacheLoad(options.NegotiationCache);
+    }
+}
+
 bool mainclass::CreateAssociation()
+{
+    return PoolConfigured() ? ConnectPool() : ConnectAssociation();
+}
+
+/*
+ * An SCP that does not accept the association is taken out of the pool
+ * and the next one tried
+ */
+bool mainclass::ConnectPool()
+{
+    while (SelectEndpoint())
+    {
+        if (ConnectAssociation())
+        {
+            return true;
+        }
+        ReleaseEndpoint(true);
+    }
+    LogMessage(LOG_LEVEL_ERROR, "No SCP of the pool is up\n");
+    return false;
+}
+
+bool mainclass::SelectEndpoint()
+{
+    endpoint = PoolAcquire();
+    if (endpoint == -1)
+    {
+        return false;
+    }
+    PoolEndpointAddress(endpoint, options.RemoteHostname, &options.RemotePort);
+    LogMessage(LOG_LEVEL_DEBUG, "Opening association to SCP %s:%d of the pool\n", options.RemoteHostname, options.RemotePort);
+    return true;
+}
+
+void mainclass::ReleaseEndpoint(bool A_failed)
+{
+    PoolRelease(endpoint, A_failed);
+    endpoint = -1;
+}
+
+bool mainclass::ConnectAssociation()
 {
     mcStatus = mainclass::OpenAssociation();
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
-        printf("Unable to open association with \"%s\":\n", options.RemoteAE);
-        printf("\t%s\n", MC_Error_Message(mcStatus));
-        fflush(stdout);
+        LogMessage(LOG_LEVEL_ERROR, "Unable to open association with \"%s\":\n", options.RemoteAE);
+        LogMessage(LOG_LEVEL_ERROR, "\t%s\n", MC_Error_Message(mcStatus));
         return(false);
     }
 
+    mainclass::GetAssociationInfo();
+    mainclass::VerboseAfterConnection();
+    return true;
+}
+
+/*
+ * The association of a study proposing only its own services (-c) says
+ * nothing of what the remote AE accepts of the configured list
+ */
+void mainclass::GetAssociationInfo()
+{
     mcStatus = MC_Get_Association_Info(associationID, &options.asscInfo);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Get_Association_Info failed", mcStatus);
+        return;
+    }
+    TranscodeLearn(associationID);
+    if (!options.StudyContexts)
+    {
+        NegotiationCacheRecord(options.RemoteAE, options.ServiceList, associationID, &options.asscInfo);
     }
-    mainclass::VerboseAfterConnection();
-    return true;
 }
 void mainclass::RemoteVerbose()
 {
+    if (options.ScpPool[0])
+    {
+        LogMessage(LOG_LEVEL_INFO, "    SCP pool: %s\n", options.ScpPool);
+        return;
+    }
     if (options.RemoteHostname[0])
-        printf("    Hostname: %s\n", options.RemoteHostname);
+        LogMessage(LOG_LEVEL_INFO, "    Hostname: %s\n", options.RemoteHostname);
     else
-        printf("    Hostname: Default in mergecom.app\n");
+        LogMessage(LOG_LEVEL_INFO, "    Hostname: Default in mergecom.app\n");
 
     if (options.RemotePort != -1)
-        printf("        Port: %d\n", options.RemotePort);
+        LogMessage(LOG_LEVEL_INFO, "        Port: %d\n", options.RemotePort);
     else
-        printf("        Port: Default in mergecom.app\n");
+        LogMessage(LOG_LEVEL_INFO, "        Port: Default in mergecom.app\n");
 }
 void mainclass::VerboseBeforeConnection()
 {
-    printf("Opening connection to remote system:\n");
-    printf("    AE title: %s\n", options.RemoteAE);
+    LogMessage(LOG_LEVEL_INFO, "Opening connection to remote system:\n");
+    LogMessage(LOG_LEVEL_INFO, "    AE title: %s\n", options.RemoteAE);
     RemoteVerbose();
     if (options.ServiceList[0])
-        printf("Service List: %s\n", options.ServiceList);
+        LogMessage(LOG_LEVEL_INFO, "Service List: %s\n", options.ServiceList);
     else
-        printf("Service List: Default in mergecom.app\n");
+        LogMessage(LOG_LEVEL_INFO, "Service List: Default in mergecom.app\n");
 
-    printf("   Files to Send: %d \n", totalImages);
+    LogMessage(LOG_LEVEL_INFO, "   Files to Send: %d \n", totalImages);
 
 }
 
@@ -162,28 +342,28 @@ void mainclass::VerboseAfterConnection()
 
     if (options.Verbose)
     {
-        printf("Connecting to Remote Application:\n");
-        printf("  Remote AE Title:          %s\n", options.asscInfo.RemoteApplicationTitle);
-        printf("  Local AE Title:           %s\n", options.asscInfo.LocalApplicationTitle);
-        printf("  Host name:                %s\n", options.asscInfo.RemoteHostName);
-        printf("  IP Address:               %s\n", options.asscInfo.RemoteIPAddress);
-        printf("  Local Max PDU Size:       %lu\n", options.asscInfo.LocalMaximumPDUSize);
-        printf("  Remote Max PDU Size:      %lu\n", options.asscInfo.RemoteMaximumPDUSize);
-        printf("  Max operations invoked:   %u\n", options.asscInfo.MaxOperationsInvoked);
-        printf("  Max operations performed: %u\n", options.asscInfo.MaxOperationsPerformed);
-        printf("  Implementation Version:   %s\n", options.asscInfo.RemoteImplementationVersion);
-        printf("  Implementation Class UID: %s\n", options.asscInfo.RemoteImplementationClassUID);
+        LogMessage(LOG_LEVEL_INFO, "Connecting to Remote Application:\n");
+        LogMessage(LOG_LEVEL_INFO, "  Remote AE Title:          %s\n", options.asscInfo.RemoteApplicationTitle);
+        LogMessage(LOG_LEVEL_INFO, "  Local AE Title:           %s\n", options.asscInfo.LocalApplicationTitle);
+        LogMessage(LOG_LEVEL_INFO, "  Host name:                %s\n", options.asscInfo.RemoteHostName);
+        LogMessage(LOG_LEVEL_INFO, "  IP Address:               %s\n", options.asscInfo.RemoteIPAddress);
+        LogMessage(LOG_LEVEL_INFO, "  Local Max PDU Size:       %lu\n", options.asscInfo.LocalMaximumPDUSize);
+        LogMessage(LOG_LEVEL_INFO, "  Remote Max PDU Size:      %lu\n", options.asscInfo.RemoteMaximumPDUSize);
+        LogMessage(LOG_LEVEL_INFO, "  Max operations invoked:   %u\n", options.asscInfo.MaxOperationsInvoked);
+        LogMessage(LOG_LEVEL_INFO, "  Max operations performed: %u\n", options.asscInfo.MaxOperationsPerformed);
+        LogMessage(LOG_LEVEL_INFO, "  Implementation Version:   %s\n", options.asscInfo.RemoteImplementationVersion);
+        LogMessage(LOG_LEVEL_INFO, "  Implementation Class UID: %s\n", options.asscInfo.RemoteImplementationClassUID);
 
         /*
          * Print out User Identity information if negotiated
          */
-        printf("  User Identity type:       None\n\n\n");
-        printf("Services and transfer syntaxes negotiated:\n");
+        LogMessage(LOG_LEVEL_INFO, "  User Identity type:       None\n\n\n");
+        LogMessage(LOG_LEVEL_INFO, "Services and transfer syntaxes negotiated:\n");
 
         mainclass::VerboseTransferSyntax();
     }
     else
-        printf("Connected to remote system [%s]\n\n", options.RemoteAE);
+        LogMessage(LOG_LEVEL_INFO, "Connected to remote system [%s]\n\n", options.RemoteAE);
 }
 void mainclass::VerboseTransferSyntax()
 {
@@ -191,7 +371,7 @@ void mainclass::VerboseTransferSyntax()
     mcStatus = MC_Get_First_Acceptable_Service(associationID, &servInfo);
     while (mcStatus == MC_NORMAL_COMPLETION)
     {
-        printf("  %-30s: %s\n", servInfo.ServiceName, GetSyntaxDescription(servInfo.SyntaxType));
+        LogMessage(LOG_LEVEL_INFO, "  %-30s: %s\n", servInfo.ServiceName, GetSyntaxDescription(servInfo.SyntaxType));
         mcStatus = MC_Get_Next_Acceptable_Service(associationID, &servInfo);
     }
 
@@ -199,7 +379,7 @@ void mainclass::VerboseTransferSyntax()
     {
         PrintError("Warning: Unable to get service info", mcStatus);
     }
-    printf("\n\n");
+    LogMessage(LOG_LEVEL_INFO, "\n\n");
 }
 
 void mainclass::UpdateImageSentCount()
@@ -215,11 +395,12 @@ void mainclass::UpdateImageSentCount()
         node->failedResponse = SAMP_TRUE;
     }
 
-    mcStatus = MC_Free_Message(&node->msgID);
+    mcStatus = FreeNodeMessage(node);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("MC_Free_Message failed for request message", mcStatus);
-    }   
+    }
+    ReleaseNodeMemory(node);
 }
 bool mainclass::SendImageAndUpdateNode()
 {
@@ -227,18 +408,16 @@ bool mainclass::SendImageAndUpdateNode()
     if (!sampBool)
     {
         node->imageSent = SAMP_FALSE;
-        printf("Failure in sending file [%s]\n", node->fname);
-        MC_Abort_Association(&associationID);
-        MC_Release_Application(&applicationID);
+        LogMessage(LOG_LEVEL_ERROR, "Failure in sending file [%s]\n", node->fname);
+        AbortAssociation();
         return false;
     }
     sampBool = UpdateNode(node);
     if (!sampBool)
     {
-        printf("Warning, unable to update node with information [%s]\n", node->fname);
+        LogMessage(LOG_LEVEL_WARNING, "Warning, unable to update node with information [%s]\n", node->fname);
 
-        MC_Abort_Association(&associationID);
-        MC_Release_Application(&applicationID);
+        AbortAssociation();
         return false;
     }
     return true;
@@ -249,10 +428,9 @@ bool mainclass::ResponseMessages()
     sampBool = ReadResponseMessages(&options, associationID, 0, &instanceList, NULL);
     if (!sampBool)
     {
-        printf("Failure in reading response message, aborting association.\n");
+        LogMessage(LOG_LEVEL_ERROR, "Failure in reading response message, aborting association.\n");
 
-        MC_Abort_Association(&associationID);
-        MC_Release_Application(&applicationID);
+        AbortAssociation();
         return false;
     }
     if (options.asscInfo.MaxOperationsInvoked > 0)
@@ -268,9 +446,8 @@ void mainclass::WaitforResponse()
         sampBool = ReadResponseMessages(&options, associationID, 10, &instanceList, NULL);
         if (!sampBool)
         {
-            printf("Failure in reading response message, aborting association.\n");
-            MC_Abort_Association(&associationID);
-            MC_Release_Application(&applicationID);
+            LogMessage(LOG_LEVEL_ERROR, "Failure in reading response message, aborting association.\n");
+            AbortAssociation();
             break;
         }
     }
@@ -294,17 +471,28 @@ bool mainclass::ImageTransfer()
         * Determine the image format and read the image in.  If the
         * image is in the part 10 format, convert it into a message.
         */
-    sampBool = ReadImage(&options, applicationID, node);
+    sampBool = ReadNextImage();
     if (!sampBool)
     {
         node->imageSent = SAMP_FALSE;
-        printf("Can not open image file [%s]\n", node->fname);
-        node = node->Next;
+        ReleaseNodeMemory(node);
+        LogMessage(LOG_LEVEL_ERROR, "Can not open image file [%s]\n", node->fname);
+        AdvanceNode();
+        return true;
+    }
+    if (node->quarantined)
+    {
+        HoldBackQuarantined();
         return true;
     }
 
     totalBytesRead += node->imageBytes;
 
+    /*
+     * Let the kernel read the next files while this one is sent
+     */
+    ReadAheadFrom(node);
+
     /*
      * Send image read in with ReadImage.
      * Save image transfer information in list
@@ -314,62 +502,560 @@ bool mainclass::ImageTransfer()
     /*
      * Traverse through file list
      */
-    node = node->Next;
+    AdvanceNode();
     return true;
 }
-void mainclass::checkResponseMsg()
+/*
+ * Validation found errors in the dataset, see Validation.cpp
+ */
+void mainclass::HoldBackQuarantined()
+{
+    node->imageSent = SAMP_FALSE;
+    FreeNodeMessage(node);
+    ReleaseNodeMemory(node);
+    AdvanceNode();
+}
+/*
+ * With -u the file may have been read and encoded already, see
+ * Transcode.cpp
+ */
+SAMP_BOOLEAN mainclass::ReadNextImage()
+{
+    if (TranscodeTake(node, &sampBool))
+    {
+        return sampBool;
+    }
+    sampBool = ReadImage(&options, applicationID, node);
+    if (sampBool)
+    {
+        TranscodeOnSend(associationID, node);
+    }
+    return sampBool;
+}
+
+bool mainclass::checkResponseMsg()
 {
     while (GetNumOutstandingRequests(instanceList) > 0)
     {
         sampBool = ReadResponseMessages(&options, associationID, 10, &instanceList, NULL);
         if (!sampBool)
         {
-            printf("Failure in reading response message, aborting association.\n");
-            MC_Abort_Association(&associationID);
-            MC_Release_Application(&applicationID);
-            break;
+            LogMessage(LOG_LEVEL_ERROR, "Failure in reading response message, aborting association.\n");
+            AbortAssociation();
+            return false;
         }
     }
+    return true;
 }
 
-void mainclass::StartSendImage()
+/*
+ * The file counts against the SCP of the pool it is sent to until it is
+ * acknowledged
+ */
+bool mainclass::SendNextImage()
+{
+    int       sentTo = endpoint;
+    long long bytes = (long long)node->fileBytes;
+
+    PoolAddInFlight(sentTo, bytes);
+    bool sent = ImageTransfer() && checkResponseMsg();
+    PoolAddInFlight(sentTo, -bytes);
+    return sent;
+}
+
+bool mainclass::SendAllImages()
 {
     node = instanceList;
     while (node)
     {
-        if (ImageTransfer() == false)
+        if (SendNextImage() == false && FailOver() == false)
         {
-            break;
+            return false;
         }
-        checkResponseMsg();
     }
+    return true;
 }
 
-void mainclass::CloseAssociation()
+/*
+ * With a pool of SCPs, the files not acknowledged over the association
+ * that failed are sent again over an association to another SCP once the
+ * rest have been sent, see RetryImages()
+ */
+bool mainclass::FailOver()
+{
+    if (!PoolConfigured())
+    {
+        return false;
+    }
+    int requeued = RequeueUnacknowledged(instanceList);
+    LogMessage(LOG_LEVEL_WARNING, "Association lost, %d unacknowledged files will be sent to another SCP of the pool\n", requeued);
+    SkipRequeuedNode();
+    return CreateAssociation();
+}
+
+/*
+ * The file being sent when the association failed is left for the retry
+ */
+void mainclass::SkipRequeuedNode()
+{
+    if (node && node->action == STORE_ACTION_RETRY_NEW_ASSOCIATION)
+    {
+        AdvanceNode();
+    }
+}
+
+void mainclass::SendImages()
+{
+    if (options.UseWatch)
+    {
+        WatchAndSend();
+        return;
+    }
+    StartSendImage();
+}
+
+void mainclass::StartSendImage()
+{
+    if (options.GroupStudies)
+    {
+        SendByStudy();
+        return;
+    }
+    if (options.Associations > 1)
+    {
+        SendParallel();
+        return;
+    }
+    SendList();
+}
+
+void mainclass::SendList()
 {
     /*
-    * A failure on close has no real recovery.  Abort the association
-    * and continue on.
-    */
+     * Check the format of upcoming files while earlier ones are sent.
+     * Files found by the directory crawl have been checked already.
+     */
+    if (!options.UseDirectory)
+    {
+        ProbeStart(instanceList);
+    }
+    StartTranscoding();
+    if (SendAllImages())
+    {
+        RetryImages();
+    }
+    TranscodeStop();
+    ProbeStop();
+    CrawlStop();
+}
 
+/*
+ * The files are read and encoded ahead of the sender, unless an SCP pool
+ * may take back the files sent, see FailOver()
+ */
+void mainclass::StartTranscoding()
+{
+    if (!PoolConfigured())
+    {
+        TranscodeStart(&options, applicationID, associationID, instanceList);
+    }
+}
+
+/*
+ * The files are shared out by size between options.Associations
+ * associations, see ParallelSend.cpp, each sent on a thread of its own.
+ * The association already open goes to the first one and is kept.
+ */
+void mainclass::SendParallel()
+{
+    std::vector<mainclass*>   workers;
+    std::vector<std::thread*> threads;
+
+    DrainCrawl();
+    ParallelPlan(instanceList, options.Associations);
+    instanceList = NULL;
+    StartWorkers(workers, threads);
+    JoinWorkers(workers, threads);
+
+    long moved = ParallelFinish(&instanceList);
+    LogMessage(LOG_LEVEL_INFO, "Sent over %d associations, %ld files moved between them\n", options.Associations, moved);
+    CrawlStop();
+}
+
+mainclass* mainclass::NewWorker(int A_index)
+{
+    mainclass* worker = new mainclass(fname);
+
+    worker->options = options;
+    worker->options.UseDirectory = SAMP_FALSE;
+    worker->applicationID = applicationID;
+    worker->associationID = A_index == 0 ? associationID : -1;
+    worker->endpoint = A_index == 0 ? endpoint : -1;
+    return worker;
+}
+
+void mainclass::StartWorkers(std::vector<mainclass*>& A_workers, std::vector<std::thread*>& A_threads)
+{
+    for (int i = 0; i < options.Associations; i++)
+    {
+        A_workers.push_back(NewWorker(i));
+        A_threads.push_back(new std::thread(&mainclass::SendAssigned, A_workers[i], i));
+    }
+    associationID = -1;
+    endpoint = -1;
+}
+
+void mainclass::JoinWorkers(std::vector<mainclass*>& A_workers, std::vector<std::thread*>& A_threads)
+{
+    for (size_t i = 0; i < A_workers.size(); i++)
+    {
+        A_threads[i]->join();
+        delete A_threads[i];
+        CollectWorker(A_workers[i], (int)i);
+        delete A_workers[i];
+    }
+}
+
+/*
+ * The files a worker sent are added to instanceList in the order it sent
+ * them
+ */
+void mainclass::CollectWorker(mainclass* A_worker, int A_index)
+{
+    InstanceNode** tail = &instanceList;
+
+    while (*tail)
+    {
+        tail = &(*tail)->Next;
+    }
+    *tail = A_worker->instanceList;
+    imagesSent += A_worker->imagesSent;
+    totalBytesRead += A_worker->totalBytesRead;
+    if (A_index == 0)
+    {
+        associationID = A_worker->associationID;
+        endpoint = A_worker->endpoint;
+    }
+    else
+    {
+        A_worker->CloseOrAbortAssociation();
+    }
+}
+
+/*
+ * Runs on the worker's own thread
+ */
+void mainclass::SendAssigned(int A_index)
+{
+    if (EnsureAssociation() && SendTaken(A_index))
+    {
+        RetryImages();
+    }
+}
+
+bool mainclass::SendTaken(int A_index)
+{
+    InstanceNode** tail = &instanceList;
+    bool           sending = true;
+
+    while (sending && (*tail = ParallelTake(A_index)) != NULL)
+    {
+        node = *tail;
+        tail = &node->Next;
+        /*
+         * The node taken is not linked to the files after it, so the
+         * read-ahead of ImageTransfer() has nothing to hint
+         */
+        ParallelReadAhead(A_index);
+        sending = SendNextImage() || FailOver();
+    }
+    return sending;
+}
+
+/*
+ * Every file is needed to group the files by study, so the directory
+ * crawl is waited for before the first study is sent
+ */
+void mainclass::SendByStudy()
+{
+    DrainCrawl();
+    HoldStudies(applicationID, instanceList);
+    instanceList = NULL;
+    SendQuietStudies(0);
+}
+
+void mainclass::DrainCrawl()
+{
+    int added = 0;
+
+    while (options.UseDirectory && (added = CrawlAppendFiles(&instanceList)) > 0)
+    {
+        totalImages += added;
+    }
+}
+
+/*
+ * The studies sent are left in instanceList
+ */
+void mainclass::SendQuietStudies(int A_quietSeconds)
+{
+    InstanceNode* sent = NULL;
+    InstanceNode** tail = &sent;
+
+    while ((instanceList = TakeQuietStudy(A_quietSeconds)) != NULL)
+    {
+        SendStudy();
+        *tail = instanceList;
+        tail = &GetListTail(instanceList)->Next;
+    }
+    instanceList = sent;
+}
+
+void mainclass::SendStudy()
+{
+    LogMessage(LOG_LEVEL_INFO, "Sending study %s, %d files\n", instanceList->studyUID, GetNumNodes(instanceList));
+    UseStudyServices();
+    if (EnsureAssociation())
+    {
+        SendList();
+    }
+    RequeueFailedBatch();
+    CloseOrAbortAssociation();
+    EndStudyServices();
+}
+
+/*
+ * The association open when the study comes up proposes the configured
+ * services, so it is closed first
+ */
+void mainclass::UseStudyServices()
+{
+    if (!options.StudyContexts)
+    {
+        return;
+    }
+    CloseOrAbortAssociation();
+    ProposeStudyServices(instanceList);
+}
+
+/*
+ * Files written to the watched directory are sent in batches as they
+ * arrive.  The association is kept open between batches and closed once
+ * no file has arrived for WATCH_IDLE_SECONDS; the next batch opens a new
+ * one.  An interrupt or termination signal ends the watch.
+ */
+void mainclass::WatchAndSend()
+{
+    LogMessage(LOG_LEVEL_INFO, "Watching %s for new files\n", options.WatchPath);
+    while (WatchRunning())
+    {
+        int files = WatchCollect(&instanceList, WatchWaitMs());
+        if (options.GroupStudies)
+        {
+            SendWatchStudies(files);
+        }
+        else
+        {
+            SendWatchBatch(files);
+        }
+    }
+    WatchStop();
+
+    /*
+     * Send the studies still held without waiting for them to be quiet
+     */
+    SendQuietStudies(0);
+}
+
+/*
+ * Studies held are sent as soon as they have been quiet for long enough
+ */
+int mainclass::WatchWaitMs()
+{
+    int idleMs = WATCH_IDLE_SECONDS * 1000;
+
+    return StudiesHeld() ? std::min(NextStudyDueMs(options.StudyQuietSeconds), idleMs) : idleMs;
+}
+
+void mainclass::SendWatchBatch(int A_files)
+{
+    if (A_files == 0)
+    {
+        CloseOrAbortAssociation();
+        return;
+    }
+    totalImages += A_files;
+    if (EnsureAssociation())
+    {
+        StartSendImage();
+    }
+    RequeueFailedBatch();
+    FreeList(&instanceList);
+}
+
+/*
+ * Each study is sent over an association of its own once it has been
+ * quiet, so the association is not kept open between batches
+ */
+void mainclass::SendWatchStudies(int A_files)
+{
+    totalImages += A_files;
+    RegisterApplication();
+    HoldStudies(applicationID, instanceList);
+    instanceList = NULL;
+    SendQuietStudies(options.StudyQuietSeconds);
+    FreeList(&instanceList);
+}
+
+/*
+ * A failed send aborts the association
+ */
+bool mainclass::EnsureAssociation()
+{
+    return RegisterApplication() && (associationID != -1 || CreateAssociation());
+}
+
+void mainclass::RequeueFailedBatch()
+{
+    if (associationID != -1 || !options.UseWatch)
+    {
+        return;
+    }
+    LogMessage(LOG_LEVEL_WARNING, "Association lost, unacknowledged files will be sent again in %d seconds\n", RETRY_DELAY);
+    WatchRequeue(instanceList);
+    std::this_thread::sleep_for(std::chrono::seconds(RETRY_DELAY));
+}
+
+/*
+ * Instances whose response status asked for them to be sent again
+ * (see StoreStatusTable) are sent in up to MAX_STORE_RETRIES passes
+ * once every instance has been sent once.
+ */
+void mainclass::RetryImages()
+{
+    for (int pass = 0; pass < MAX_STORE_RETRIES; pass++)
+    {
+        if (RetryPass() == false)
+        {
+            return;
+        }
+    }
+}
+
+bool mainclass::RetryPass()
+{
+    if (GetNumRetryRequests(instanceList) == 0)
+        return false;
+
+    if (PrepareRetryAssociation() == false)
+        return false;
+
+    node = instanceList;
+    while (node)
+    {
+        if (RetryNextImage() == false && FailOver() == false)
+            return false;
+    }
+    return true;
+}
+
+bool mainclass::PrepareRetryAssociation()
+{
+    if (NeedsNewAssociation(instanceList))
+    {
+        return ReopenAssociation();
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(RETRY_DELAY));
+    return true;
+}
+
+bool mainclass::RetryNextImage()
+{
+    return RetryNextNode() && checkResponseMsg();
+}
+
+bool mainclass::RetryNextNode()
+{
+    if (node->action != STORE_ACTION_RETRY_LATER && node->action != STORE_ACTION_RETRY_NEW_ASSOCIATION)
+    {
+        node = node->Next;
+        return true;
+    }
+    LogMessage(LOG_LEVEL_INFO, "Retrying file [%s], attempt %d\n", node->fname, node->retryCount + 2);
+    PrepareNodeForRetry(node);
+    return ImageTransfer();
+}
+
+/*
+ * The application stays registered, as it may be shared by several
+ * associations (-j); ReleaseApplication() releases it
+ */
+void mainclass::AbortAssociation()
+{
+    MC_Abort_Association(&associationID);
+    associationID = -1;
+    ReleaseEndpoint(true);
+}
+
+bool mainclass::ReopenAssociation()
+{
+    CloseOrAbortAssociation();
+    return CreateAssociation();
+}
+
+/*
+ * A failure on close has no real recovery.  Abort the association
+ * and continue on.
+ */
+void mainclass::CloseOrAbortAssociation()
+{
+    if (associationID == -1)
+    {
+        return;
+    }
     mcStatus = MC_Close_Association(&associationID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError("Close association failed", mcStatus);
         MC_Abort_Association(&associationID);
     }
+    associationID = -1;
+    ReleaseEndpoint(false);
+}
+
+void mainclass::CloseAssociation()
+{
+    CloseOrAbortAssociation();
 
     if (options.Verbose)
     {
-        printf("Association Closed.\n");
+        LogMessage(LOG_LEVEL_INFO, "Association Closed.\n");
+        PrintStoreStatusCounts();
+        LogMessage(LOG_LEVEL_INFO, "Peak message memory: %luKB\n", (unsigned long)(MemoryBudgetPeak() / 1024));
+        PrintReadChunkStats();
     }
-    printf("Data Transferred: %luMB\n", (unsigned long)(totalBytesRead / (1024 * 1024)));
-    fflush(stdout);
+    LogMessage(LOG_LEVEL_INFO, "Data Transferred: %luMB\n", (unsigned long)(totalBytesRead / (1024 * 1024)));
 }
 
 void mainclass::ReleaseApplication()
 {
     MC_STATUS mcStatus;
+
+    /*
+     * Free the messages kept for reuse
+     */
+    FreeRecycledMessages();
+
+    /*
+     * Stop the C-ECHOs to the SCPs of the pool, which use the application
+     */
+    PoolStop();
+
+    /*
+     * Keep what the remote AE accepted for the next run
+     */
+    NegotiationCacheSave();
+
     mcStatus = MC_Release_Application(&applicationID);
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
@@ -385,7 +1071,12 @@ void mainclass::ReleaseApplication()
      * Release all memory used by the Merge DICOM Toolkit.
      */
     if (MC_Library_Release() != MC_NORMAL_COMPLETION)
-        printf("Error releasing the library.\n");
+        LogMessage(LOG_LEVEL_ERROR, "Error releasing the library.\n");
+
+    /*
+     * Remove temporary files of large attributes left behind
+     */
+    LargeDataStoreCleanup();
 }
 
 /****************************************************************************
@@ -407,12 +1098,12 @@ void PrintError(const char* A_string, MC_STATUS A_status)
 #endif
     if (A_status == -1)
     {
-        printf("%s\t%s\n", prefix, A_string);
+        LogMessage(LOG_LEVEL_ERROR, "%s\t%s\n", prefix, A_string);
     }
     else
     {
-        printf("%s\t%s:\n", prefix, A_string);
-        printf("%s\t\t%s\n", prefix, MC_Error_Message(A_status));
+        LogMessage(LOG_LEVEL_ERROR, "%s\t%s:\n", prefix, A_string);
+        LogMessage(LOG_LEVEL_ERROR, "%s\t\t%s\n", prefix, MC_Error_Message(A_status));
     }
 }
 
@@ -422,7 +1113,6 @@ bool CheckIfMCStatusNotOk(MC_STATUS mcStatus, const char* ErrorMessage)
     if (mcStatus != MC_NORMAL_COMPLETION)
     {
         PrintError(ErrorMessage, mcStatus);
-        fflush(stdout);
         return true;
     }
     return false;
@@ -0,0 +1,408 @@
+#include "Definitions.h"
+#include <string>
+
+/****************************************************************************
+ *
+ *  SCP pool
+ *
+ *  With -e the destination is a pool of SCPs, several host:port pairs
+ *  behind the one remote AE title, e.g. the nodes of a clustered archive
+ *  with no load balancer in front of it.  Each association goes to the
+ *  SCP with the fewest associations, then the fewest bytes in flight, so
+ *  the parallel associations of -j are spread over the nodes.  An
+ *  association sends one file at a time and waits for its response, so
+ *  the bytes in flight are those of the files being sent right now; they
+ *  only break the tie between SCPs with as many associations.
+ *
+ *  An SCP is taken out of the pool when an association to it cannot be
+ *  opened or is aborted.  A thread sends a C-ECHO over an association of
+ *  its own to the SCPs that are down each POOL_ECHO_SECONDS and puts back
+ *  those that answer.  An SCP with associations open is not checked, as
+ *  they show whether it is up.  An idle SCP that is up is checked too,
+ *  so one that stops answering is taken out before an association fails
+ *  on it, but the time between its checks doubles with every answer up
+ *  to POOL_ECHO_MAX_SECONDS.  If the Verification service is not in the
+ *  service list, an SCP that accepts the association is taken to be up.
+ *
+ *  The files sent over an association that failed and not acknowledged
+ *  are sent again to another SCP of the pool, see mainclass::FailOver().
+ *
+ ****************************************************************************/
+
+/*
+ * One SCP of the pool.  Everything but inFlight is guarded by PoolLock.
+ */
+typedef struct scp_endpoint
+{
+    char                   host[STR_LENGTH];   /* Host name or address */
+    int                    port;               /* TCP listen port */
+    std::atomic<long long> inFlight;           /* bytes of the files being sent to it */
+    int                    associations;       /* associations open to the SCP */
+    bool                   up;                 /* Bool saying if the SCP is used */
+    int                    echoSeconds;        /* time until its next C-ECHO while idle and up */
+    std::chrono::steady_clock::time_point nextEcho;   /* time of its next C-ECHO while idle and up */
+} ScpEndpoint;
+
+static ScpEndpoint             PoolEndpoints[MAX_POOL_ENDPOINTS];
+static int                     NumPoolEndpoints = 0;
+static std::mutex              PoolLock;
+static std::condition_variable PoolStopped;
+static bool                    PoolRunning = false;
+static std::thread*            PoolChecker = NULL;
+static int                     PoolAppID = -1;
+static std::string             PoolRemoteAE;
+static std::string             PoolServiceList;
+
+static bool ParseEndpoint(const std::string& A_entry, ScpEndpoint& A_endpoint)
+{
+    size_t colon = A_entry.rfind(':');
+
+    if (colon == 0 || colon >= sizeof(A_endpoint.host))
+        return false;
+    A_endpoint.port = atoi(A_entry.c_str() + colon + 1);
+    strcpy(A_endpoint.host, A_entry.substr(0, colon).c_str());
+    return A_endpoint.port > 0;
+}
+
+static bool AddEndpoint(const std::string& A_entry)
+{
+    if (NumPoolEndpoints == MAX_POOL_ENDPOINTS || !ParseEndpoint(A_entry, PoolEndpoints[NumPoolEndpoints]))
+        return false;
+    PoolEndpoints[NumPoolEndpoints].inFlight = 0;
+    PoolEndpoints[NumPoolEndpoints].associations = 0;
+    PoolEndpoints[NumPoolEndpoints].up = true;
+    PoolEndpoints[NumPoolEndpoints].echoSeconds = POOL_ECHO_SECONDS;
+    PoolEndpoints[NumPoolEndpoints].nextEcho = std::chrono::steady_clock::now();
+    NumPoolEndpoints++;
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolParse
+ *
+ *  Parameters  :   A_spec     - host:port of each SCP, comma separated
+ *
+ *  Returns     :   true if every SCP was understood
+ *                  false if one was not, or there are more than
+ *                  MAX_POOL_ENDPOINTS
+ *
+ *  Description :   Make the pool the associations are opened to.  Every
+ *                  SCP starts out up.
+ *
+ ****************************************************************************/
+bool PoolParse(const char* A_spec)
+{
+    std::string spec(A_spec);
+    size_t      start = 0;
+    size_t      comma;
+
+    NumPoolEndpoints = 0;
+    while ((comma = spec.find(',', start)) != std::string::npos)
+    {
+        if (!AddEndpoint(spec.substr(start, comma - start)))
+            return false;
+        start = comma + 1;
+    }
+    return AddEndpoint(spec.substr(start));
+}
+
+static bool ReadEchoResponse(int A_associationID)
+{
+    int          responseID = -1;
+    char*        serviceName = NULL;
+    MC_COMMAND   command;
+    unsigned int status = 0xFFFF;
+
+    if (MC_Read_Message(A_associationID, POOL_ECHO_TIMEOUT, &responseID, &serviceName, &command) != MC_NORMAL_COMPLETION)
+        return false;
+    MC_Get_Value_To_UInt(responseID, MC_ATT_STATUS, &status);
+    MC_Free_Message(&responseID);
+    return status == C_ECHO_SUCCESS;
+}
+
+/*
+ * The association was accepted, which is all there is to check when the
+ * Verification service was not negotiated
+ */
+static bool SendEcho(int A_associationID)
+{
+    int       messageID = -1;
+    MC_STATUS mcStatus = MC_Open_Message(&messageID, "STANDARD_ECHO", C_ECHO_RQ);
+
+    if (mcStatus == MC_NORMAL_COMPLETION)
+        mcStatus = MC_Send_Request_Message(A_associationID, messageID);
+    MC_Free_Message(&messageID);
+    if (mcStatus != MC_NORMAL_COMPLETION)
+        return mcStatus == MC_UNACCEPTABLE_SERVICE;
+    return ReadEchoResponse(A_associationID);
+}
+
+static char* EchoServiceList()
+{
+    return PoolServiceList.empty() ? NULL : &PoolServiceList[0];
+}
+
+static bool EchoEndpoint(char* A_host, int A_port)
+{
+    int       associationID = -1;
+    MC_SOCKET socket = RaceConnect(A_host, A_port);
+
+    if (socket == NO_SOCKET || MC_Open_Association_With_Socket(PoolAppID, &associationID, PoolRemoteAE.c_str(), &A_port, A_host, EchoServiceList(), socket) != MC_NORMAL_COMPLETION)
+        return false;
+    bool echoed = SendEcho(associationID);
+    if (MC_Close_Association(&associationID) != MC_NORMAL_COMPLETION)
+        MC_Abort_Association(&associationID);
+    return echoed;
+}
+
+static void LogEndpointChange(const ScpEndpoint& A_endpoint, bool A_up)
+{
+    LogMessage(A_up ? LOG_LEVEL_INFO : LOG_LEVEL_WARNING, "SCP %s:%d of the pool is %s\n", A_endpoint.host, A_endpoint.port, A_up ? "up again" : "down");
+}
+
+/*
+ * Called holding PoolLock
+ */
+static void MarkEndpoint(int A_endpoint, bool A_up)
+{
+    if (PoolEndpoints[A_endpoint].up != A_up)
+        LogEndpointChange(PoolEndpoints[A_endpoint], A_up);
+    PoolEndpoints[A_endpoint].up = A_up;
+    if (!A_up)
+        PoolEndpoints[A_endpoint].echoSeconds = POOL_ECHO_SECONDS;
+}
+
+/*
+ * Called holding PoolLock.  Each answer doubles the time to the next
+ * check of an SCP that stays idle.
+ */
+static void ScheduleEcho(int A_endpoint)
+{
+    ScpEndpoint& endpoint = PoolEndpoints[A_endpoint];
+
+    if (endpoint.up)
+        endpoint.echoSeconds = std::min(endpoint.echoSeconds * 2, POOL_ECHO_MAX_SECONDS);
+    endpoint.nextEcho = std::chrono::steady_clock::now() + std::chrono::seconds(endpoint.echoSeconds);
+}
+
+/*
+ * An SCP with associations open is being checked by them
+ */
+static bool EchoDue(int A_endpoint)
+{
+    std::lock_guard<std::mutex> lock(PoolLock);
+    const ScpEndpoint&          endpoint = PoolEndpoints[A_endpoint];
+
+    return !endpoint.up || (endpoint.associations == 0 && std::chrono::steady_clock::now() >= endpoint.nextEcho);
+}
+
+/*
+ * The C-ECHO is sent without holding PoolLock, so associations can be
+ * opened to the other SCPs meanwhile
+ */
+static void CheckEndpoint(int A_endpoint)
+{
+    char host[STR_LENGTH];
+    int  port;
+
+    if (!EchoDue(A_endpoint))
+        return;
+    PoolEndpointAddress(A_endpoint, host, &port);
+    bool up = EchoEndpoint(host, port);
+
+    std::lock_guard<std::mutex> lock(PoolLock);
+    MarkEndpoint(A_endpoint, up);
+    ScheduleEcho(A_endpoint);
+}
+
+static bool PoolHasStopped()
+{
+    return !PoolRunning;
+}
+
+static bool WaitForNextCheck()
+{
+    std::unique_lock<std::mutex> lock(PoolLock);
+
+    PoolStopped.wait_for(lock, std::chrono::seconds(POOL_ECHO_SECONDS), PoolHasStopped);
+    return PoolRunning;
+}
+
+static void CheckEndpoints()
+{
+    do
+    {
+        for (int i = 0; i < NumPoolEndpoints; i++)
+            CheckEndpoint(i);
+    } while (WaitForNextCheck());
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolStart
+ *
+ *  Parameters  :   A_spec        - host:port of each SCP, comma separated
+ *                  A_appID       - Application ID registered
+ *                  A_remoteAE    - AE title of the SCPs
+ *                  A_serviceList - Service list proposed, NULL for the
+ *                                  default
+ *
+ *  Returns     :   true if the pool was made
+ *                  false if the SCPs were not understood
+ *
+ *  Description :   Make the pool and start the thread checking its SCPs.
+ *
+ ****************************************************************************/
+bool PoolStart(const char* A_spec, int A_appID, const char* A_remoteAE, const char* A_serviceList)
+{
+    if (!PoolParse(A_spec))
+    {
+        LogMessage(LOG_LEVEL_ERROR, "ERROR: SCP pool must be host:port[,host:port...], at most %d: %s\n", MAX_POOL_ENDPOINTS, A_spec);
+        return false;
+    }
+    PoolAppID = A_appID;
+    PoolRemoteAE = A_remoteAE;
+    PoolServiceList = A_serviceList ? A_serviceList : "";
+    PoolRunning = true;
+    PoolChecker = new std::thread(CheckEndpoints);
+    return true;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Stop checking the SCPs.  Called before the application
+ *                  is released.  Safe to call when no pool was made.
+ *
+ ****************************************************************************/
+void PoolStop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(PoolLock);
+        PoolRunning = false;
+    }
+    PoolStopped.notify_all();
+    if (PoolChecker)
+        PoolChecker->join();
+    delete PoolChecker;
+    PoolChecker = NULL;
+}
+
+bool PoolConfigured(void)
+{
+    return NumPoolEndpoints > 0;
+}
+
+static bool LessLoaded(const ScpEndpoint& A_left, const ScpEndpoint& A_right)
+{
+    long long left = A_left.inFlight;
+    long long right = A_right.inFlight;
+
+    return A_left.associations < A_right.associations || (A_left.associations == A_right.associations && left < right);
+}
+
+static bool BetterEndpoint(int A_candidate, int A_best)
+{
+    return PoolEndpoints[A_candidate].up && (A_best < 0 || LessLoaded(PoolEndpoints[A_candidate], PoolEndpoints[A_best]));
+}
+
+/*
+ * Called holding PoolLock
+ */
+static int LeastLoadedEndpoint()
+{
+    int best = -1;
+
+    for (int i = 0; i < NumPoolEndpoints; i++)
+        best = BetterEndpoint(i, best) ? i : best;
+    return best;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolAcquire
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   Index of the SCP to open the next association to, -1 if
+ *                  no SCP of the pool is up
+ *
+ *  Description :   The SCP up with the fewest associations, then the
+ *                  fewest bytes in flight.  It is counted as having one
+ *                  more association until PoolRelease.
+ *
+ ****************************************************************************/
+int PoolAcquire(void)
+{
+    std::lock_guard<std::mutex> lock(PoolLock);
+    int                         best = LeastLoadedEndpoint();
+
+    if (best >= 0)
+        PoolEndpoints[best].associations++;
+    return best;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolRelease
+ *
+ *  Parameters  :   A_endpoint - Index returned by PoolAcquire, -1 for none
+ *                  A_failed   - The association could not be opened or was
+ *                               aborted
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Count the association to the SCP as ended.  An SCP
+ *                  whose association failed is not used until it answers
+ *                  a C-ECHO.
+ *
+ ****************************************************************************/
+void PoolRelease(int A_endpoint, bool A_failed)
+{
+    if (A_endpoint < 0)
+        return;
+    std::lock_guard<std::mutex> lock(PoolLock);
+    PoolEndpoints[A_endpoint].associations--;
+    if (A_failed)
+        MarkEndpoint(A_endpoint, false);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolAddInFlight
+ *
+ *  Parameters  :   A_endpoint - Index returned by PoolAcquire, -1 for none
+ *                  A_bytes    - Bytes of the file about to be sent,
+ *                               negative once it is acknowledged
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void PoolAddInFlight(int A_endpoint, long long A_bytes)
+{
+    if (A_endpoint >= 0)
+        PoolEndpoints[A_endpoint].inFlight += A_bytes;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   PoolEndpointAddress
+ *
+ *  Parameters  :   A_endpoint - Index returned by PoolAcquire
+ *                  A_host     - Set to the host name, STR_LENGTH bytes
+ *                  A_port     - Set to the TCP listen port
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void PoolEndpointAddress(int A_endpoint, char* A_host, int* A_port)
+{
+    strcpy(A_host, PoolEndpoints[A_endpoint].host);
+    *A_port = PoolEndpoints[A_endpoint].port;
+}
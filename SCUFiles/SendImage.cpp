@@ -53,14 +53,9 @@ bool GetSOPUIDAndSetService(InstanceNode* A_node)
 
 bool checkSendRequestMessage(MC_STATUS mcStatus, InstanceNode*& A_node)
 {
-    std::map<MC_STATUS, string> SendRequestMap;
-    SendRequestMap[MC_ASSOCIATION_ABORTED] = "MC_Send_Request_Message failed";
-    SendRequestMap[MC_SYSTEM_ERROR] = "MC_Send_Request_Message failed";
-    SendRequestMap[MC_UNACCEPTABLE_SERVICE] = "MC_Send_Request_Message failed";
-
-
-    if (SendRequestMap.find(mcStatus) != SendRequestMap.end()) {
-        return CheckIfMCStatusNotOk(mcStatus, "MC_Send_Request_Message failed");;
+    if (IsFatalSendStatus(mcStatus))
+    {
+        return CheckIfMCStatusNotOk(mcStatus, "MC_Send_Request_Message failed");
     }
     else if (mcStatus != MC_NORMAL_COMPLETION)
     {
@@ -70,7 +65,6 @@ bool checkSendRequestMessage(MC_STATUS mcStatus, InstanceNode*& A_node)
         return (false);
     }
     A_node->imageSent = SAMP_TRUE;
-    fflush(stdout);
     return false;
 }
 
@@ -91,13 +85,11 @@ SAMP_BOOLEAN SendImage(STORAGE_OPTIONS* A_options, int A_associationID, Instance
     /*
      *  Send the message
      */
-    printf("     File: %s\n", A_node->fname);
-    printf("   Format: DICOM Part 10 Format(%s)\n", GetSyntaxDescription(A_node->transferSyntax));
-    printf("SOP Class: %s (%s)\n", A_node->SOPClassUID, A_node->serviceName);
-    printf("      UID: %s\n", A_node->SOPInstanceUID);
-    printf("     Size: %lu bytes\n", (unsigned long)A_node->imageBytes);
+    LogMessage(LOG_LEVEL_INFO, "     File: %s\n   Format: DICOM Part 10 Format(%s)\nSOP Class: %s (%s)\n      UID: %s\n     Size: %lu bytes\n",
+        A_node->fname, GetSyntaxDescription(A_node->transferSyntax), A_node->SOPClassUID, A_node->serviceName,
+        A_node->SOPInstanceUID, (unsigned long)A_node->imageBytes);
 
-    mcStatus = MC_Send_Request_Message(A_associationID, A_node->msgID);
+    mcStatus = DeflateTunedSend(A_options->RemoteAE, A_associationID, A_node);
     if (checkSendRequestMessage(mcStatus, A_node))
         return (SAMP_FALSE);
 
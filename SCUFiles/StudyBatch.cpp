@@ -0,0 +1,362 @@
+#include "Definitions.h"
+#include <string>
+#include <vector>
+
+/****************************************************************************
+ *
+ *  Study batches
+ *
+ *  With -g the instances are sent a study at a time, each study over an
+ *  association of its own, in the order the studies first appear in the
+ *  list.  The Study Instance UID of each file is read before anything is
+ *  sent, by the header scanner of HeaderScan.cpp, or by the toolkit from
+ *  the start of the file, up to the Series Instance UID, for the files
+ *  the scanner cannot walk.
+ *
+ *  Files are held here until their study is sent.  A study is sent once no
+ *  file of it has been added for the quiet period given with -g, so in
+ *  watch mode a study is sent whole even when its files arrive mixed with
+ *  those of other studies.  With -c the association of a study proposes
+ *  only the services of the SOP Classes in the study.
+ *
+ *  Files whose Study Instance UID cannot be read are sent together as a
+ *  study of their own.
+ *
+ ****************************************************************************/
+
+/*
+ * Read state of HeaderToFileObj
+ */
+typedef struct header_read
+{
+    FILE* fp;                           /* File being read */
+    char  buffer[STUDY_HEADER_CHUNK];   /* Data supplied to the toolkit */
+} HeaderRead;
+
+static InstanceNode* HeldStudies = NULL;    /* grouped by study */
+static std::map<std::string, std::chrono::steady_clock::time_point> StudyArrivals;   /* last file added to each held study */
+static char          StudyServiceListName[] = "STUDY_SERVICE_LIST";
+static bool          StudyServicesProposed = false;
+
+static MC_STATUS NOEXP_FUNC HeaderToFileObj(char* A_filename, void* A_userInfo, int* A_dataSize, void** A_dataBuffer, int A_isFirst, int* A_isLast)
+{
+    HeaderRead* read = (HeaderRead*)A_userInfo;
+
+    if (A_isFirst)
+        read->fp = fopen(A_filename, BINARY_READ);
+    if (!read->fp)
+        return MC_CANNOT_COMPLY;
+
+    size_t bytes = fread(read->buffer, 1, sizeof(read->buffer), read->fp);
+    *A_isLast = bytes < sizeof(read->buffer);
+    *A_dataBuffer = read->buffer;
+    *A_dataSize = (int)bytes;
+    return MC_NORMAL_COMPLETION;
+}
+
+/*
+ * The SOP Class UID is kept for the study's service list; ReadImage sets
+ * it again when the file is sent
+ */
+static bool GetStudyAttributes(int A_fileID, InstanceNode* A_node)
+{
+    MC_Get_Value_To_String(A_fileID, MC_ATT_SOP_CLASS_UID, sizeof(A_node->SOPClassUID), A_node->SOPClassUID);
+    return MC_Get_Value_To_String(A_fileID, MC_ATT_STUDY_INSTANCE_UID, sizeof(A_node->studyUID), A_node->studyUID) == MC_NORMAL_COMPLETION;
+}
+
+static MC_STATUS OpenStudyHeader(int A_appID, int A_fileID, HeaderRead* A_read)
+{
+    long      offset = 0;
+    MC_STATUS mcStatus = MC_Open_File_Upto_Tag(A_appID, A_fileID, A_read, MC_ATT_SERIES_INSTANCE_UID, &offset, HeaderToFileObj);
+
+    if (A_read->fp)
+        fclose(A_read->fp);
+    return mcStatus;
+}
+
+static bool ReadStudyHeader(int A_appID, int A_fileID, InstanceNode* A_node)
+{
+    HeaderRead* read = (HeaderRead*)calloc(1, sizeof(HeaderRead));
+
+    if (!read)
+        return false;
+    MC_STATUS mcStatus = OpenStudyHeader(A_appID, A_fileID, read);
+    free(read);
+    return mcStatus == MC_NORMAL_COMPLETION && GetStudyAttributes(A_fileID, A_node);
+}
+
+static void ReadStudyUIDWithToolkit(int A_appID, InstanceNode* A_node)
+{
+    int fileID = -1;
+
+    A_node->studyUID[0] = '\0';
+    if (MC_Create_Empty_File(&fileID, A_node->fname) != MC_NORMAL_COMPLETION)
+        return;
+    if (!ReadStudyHeader(A_appID, fileID, A_node))
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Cannot read the Study Instance UID of %s\n", A_node->fname);
+    MC_Free_File(&fileID);
+}
+
+static bool ScanStudyUID(InstanceNode* A_node)
+{
+    Part10Header header;
+
+    if (!ScanPart10Header(A_node->fname, &header) || !header.studyUID[0])
+        return false;
+    strcpy(A_node->SOPClassUID, header.sopClassUID);
+    strcpy(A_node->studyUID, header.studyUID);
+    return true;
+}
+
+/*
+ * Files of a DICOMDIR come with the UIDs of their records
+ */
+static bool StudyKnown(const InstanceNode* A_node)
+{
+    return A_node->studyUID[0] && A_node->SOPClassUID[0];
+}
+
+/*
+ * The scanner reads a few element headers where the toolkit makes a file
+ * object of the whole start of the file
+ */
+static void ReadStudyUID(int A_appID, InstanceNode* A_node)
+{
+    if (StudyKnown(A_node))
+        return;
+    if (!ScanStudyUID(A_node))
+        ReadStudyUIDWithToolkit(A_appID, A_node);
+}
+
+static void AddToStudy(std::map<std::string, std::vector<InstanceNode*> >& A_studies, std::vector<std::string>& A_order, InstanceNode* A_node)
+{
+    std::vector<InstanceNode*>& study = A_studies[A_node->studyUID];
+
+    if (study.empty())
+        A_order.push_back(A_node->studyUID);
+    study.push_back(A_node);
+}
+
+static InstanceNode** LinkStudy(const std::vector<InstanceNode*>& A_nodes, InstanceNode** A_link)
+{
+    for (size_t i = 0; i < A_nodes.size(); i++)
+    {
+        *A_link = A_nodes[i];
+        A_link = &A_nodes[i]->Next;
+    }
+    return A_link;
+}
+
+/*
+ * The files of a study keep their order; the studies are in the order
+ * they first appear
+ */
+static void GroupByStudy(InstanceNode** A_list)
+{
+    std::map<std::string, std::vector<InstanceNode*> > studies;
+    std::vector<std::string>                           order;
+    InstanceNode**                                     link = A_list;
+
+    for (InstanceNode* node = *A_list; node; node = node->Next)
+        AddToStudy(studies, order, node);
+    for (size_t i = 0; i < order.size(); i++)
+        link = LinkStudy(studies[order[i]], link);
+    *link = NULL;
+    ResetListTail();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   HoldStudies
+ *
+ *  Parameters  :   A_appID    - Application ID registered
+ *                  A_list     - Files to hold, the list is taken over
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Read the Study Instance UID of each file, unless it
+ *                  came with the file from a DICOMDIR, and hold the
+ *                  files with the rest of their study until it is taken
+ *                  with TakeQuietStudy.
+ *
+ ****************************************************************************/
+void HoldStudies(int A_appID, InstanceNode* A_list)
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    InstanceNode**                        link = &HeldStudies;
+
+    for (InstanceNode* node = A_list; node; node = node->Next)
+    {
+        ReadStudyUID(A_appID, node);
+        StudyArrivals[node->studyUID] = now;
+    }
+    while (*link)
+        link = &(*link)->Next;
+    *link = A_list;
+    GroupByStudy(&HeldStudies);
+}
+
+bool StudiesHeld(void)
+{
+    return HeldStudies != NULL;
+}
+
+static long long StudyQuietMs(const std::string& A_studyUID, int A_quietSeconds)
+{
+    std::chrono::steady_clock::duration left = StudyArrivals[A_studyUID] + std::chrono::seconds(A_quietSeconds) - std::chrono::steady_clock::now();
+
+    return std::chrono::duration_cast<std::chrono::milliseconds>(left).count();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   NextStudyDueMs
+ *
+ *  Parameters  :   A_quietSeconds - Quiet period of a study
+ *
+ *  Returns     :   Milliseconds until the first held study has been quiet
+ *                  for the period, 0 if one has been already
+ *
+ ****************************************************************************/
+int NextStudyDueMs(int A_quietSeconds)
+{
+    long long due = (long long)A_quietSeconds * 1000;
+
+    for (std::map<std::string, std::chrono::steady_clock::time_point>::iterator study = StudyArrivals.begin(); study != StudyArrivals.end(); ++study)
+        due = std::min(due, StudyQuietMs(study->first, A_quietSeconds));
+    return (int)std::max(due, 0LL);
+}
+
+/*
+ * Returns the link to the node after the study starting at A_link
+ */
+static InstanceNode** StudyEnd(InstanceNode** A_link)
+{
+    InstanceNode* node = *A_link;
+
+    while (node->Next && strcmp(node->Next->studyUID, (*A_link)->studyUID) == 0)
+        node = node->Next;
+    return &node->Next;
+}
+
+static InstanceNode* CutStudy(InstanceNode** A_link)
+{
+    InstanceNode* study = *A_link;
+
+    if (!study)
+        return NULL;
+    InstanceNode** end = StudyEnd(A_link);
+    *A_link = *end;
+    *end = NULL;
+    StudyArrivals.erase(study->studyUID);
+    ResetListTail();
+    return study;
+}
+
+static bool IsQuiet(InstanceNode* A_study, int A_quietSeconds)
+{
+    return StudyQuietMs(A_study->studyUID, A_quietSeconds) <= 0;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TakeQuietStudy
+ *
+ *  Parameters  :   A_quietSeconds - Time since the last file of a study was
+ *                                   added after which it is sent, 0 to
+ *                                   take any study
+ *
+ *  Returns     :   The files of the first held study that has been quiet
+ *                  for the period, NULL if there is none
+ *
+ *  Description :   The files returned are no longer held; the caller
+ *                  frees them.
+ *
+ ****************************************************************************/
+InstanceNode* TakeQuietStudy(int A_quietSeconds)
+{
+    InstanceNode** link = &HeldStudies;
+
+    while (*link && !IsQuiet(*link, A_quietSeconds))
+        link = StudyEnd(link);
+    return CutStudy(link);
+}
+
+static void AddStudyService(std::vector<std::string>& A_services, const InstanceNode* A_node)
+{
+    char serviceName[48];
+
+    if (MC_Get_MergeCOM_Service(A_node->SOPClassUID, serviceName, sizeof(serviceName)) == MC_NORMAL_COMPLETION
+        && std::find(A_services.begin(), A_services.end(), serviceName) == A_services.end())
+        A_services.push_back(serviceName);
+}
+
+static bool NewStudyServiceList(std::vector<std::string>& A_services)
+{
+    std::vector<char*> names;
+
+    if (A_services.empty())
+        return false;
+    for (size_t i = 0; i < A_services.size(); i++)
+        names.push_back(&A_services[i][0]);
+    names.push_back(NULL);
+    return MC_NewProposedServiceList(StudyServiceListName, &names[0]) == MC_NORMAL_COMPLETION;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ProposeStudyServices
+ *
+ *  Parameters  :   A_study    - Files of the study about to be sent
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Make a service list of the SOP Classes in the study,
+ *                  used by the next association in place of the one
+ *                  configured.  If none of the SOP Classes is known, the
+ *                  configured list is used.
+ *
+ ****************************************************************************/
+void ProposeStudyServices(InstanceNode* A_study)
+{
+    std::vector<std::string> services;
+
+    for (InstanceNode* node = A_study; node; node = node->Next)
+        AddStudyService(services, node);
+    StudyServicesProposed = NewStudyServiceList(services);
+    if (!StudyServicesProposed)
+        LogMessage(LOG_LEVEL_WARNING, "Warning: Cannot propose the services of study %s alone\n", A_study->studyUID);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   StudyServiceList
+ *
+ *  Parameters  :   A_configured - Service list configured for the SCU
+ *
+ *  Returns     :   The service list to propose
+ *
+ ****************************************************************************/
+char* StudyServiceList(char* A_configured)
+{
+    return StudyServicesProposed ? StudyServiceListName : A_configured;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   EndStudyServices
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Free the service list of a study once its association
+ *                  is closed.  Safe to call when none was made.
+ *
+ ****************************************************************************/
+void EndStudyServices(void)
+{
+    if (StudyServicesProposed)
+        MC_FreeServiceList(StudyServiceListName);
+    StudyServicesProposed = false;
+}
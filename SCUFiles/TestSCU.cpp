@@ -169,6 +169,14 @@ TEST_CASE("when a valid option is passed as an argument then the task correspond
         const char* argv[] = { "SCU", "-p" , "2020" };
         REQUIRE(MapOptions(1, argv, store) == true);
     }
+    SECTION("when '-v' is passed as an argument then verbose mode is set and MapOptions() returns true")
+    {
+        STORAGE_OPTIONS* store = new STORAGE_OPTIONS;
+        store->Verbose = SAMP_FALSE;
+        const char* argv[] = { "SCU", "-v" };
+        REQUIRE(MapOptions(1, argv, store) == true);
+        REQUIRE(store->Verbose == SAMP_TRUE);
+    }
 }
 TEST_CASE("when a valid extra option is passed as an argument then the task corresponding to the option is performed and true is returned by ExtraOptions()")
 {
@@ -218,4 +226,1037 @@ TEST_CASE("when remote host name and port are given then CheckHostandPort() retu
     MapOptions(1, argv, store);
     store->RemotePort = 2020;
     REQUIRE(CheckHostandPort(store) == true);
-}
\ No newline at end of file
+}
+/*
+ * A switch added to the command line, and what it sets
+ */
+typedef struct switch_case
+{
+    const char* name;                                   /* the switch */
+    const char* value;                                  /* its value, NULL for none */
+    bool        (*isSet)(const STORAGE_OPTIONS* A_options);
+} SwitchCase;
+
+static const SwitchCase SwitchCases[] =
+{
+    { "-c", NULL, [](const STORAGE_OPTIONS* A_options) { return A_options->StudyContexts == SAMP_TRUE; } },
+    { "-d", "images", [](const STORAGE_OPTIONS* A_options) { return A_options->UseDirectory == SAMP_TRUE && strcmp(A_options->CrawlPath, "images") == 0; } },
+    { "-e", "node1:104,node2:104", [](const STORAGE_OPTIONS* A_options) { return strcmp(A_options->ScpPool, "node1:104,node2:104") == 0; } },
+    { "-g", "5", [](const STORAGE_OPTIONS* A_options) { return A_options->GroupStudies == SAMP_TRUE && A_options->StudyQuietSeconds == 5; } },
+    { "-i", "DICOMDIR", [](const STORAGE_OPTIONS* A_options) { return A_options->UseDicomDir == SAMP_TRUE && strcmp(A_options->DicomDir, "DICOMDIR") == 0; } },
+    { "-j", "3", [](const STORAGE_OPTIONS* A_options) { return A_options->Associations == 3; } },
+    { "-k", "negotiations.txt", [](const STORAGE_OPTIONS* A_options) { return strcmp(A_options->NegotiationCache, "negotiations.txt") == 0; } },
+    { "-m", "512", [](const STORAGE_OPTIONS* A_options) { return A_options->MemoryBudgetMB == 512; } },
+    { "-o", "64", [](const STORAGE_OPTIONS* A_options) { return A_options->DirectThresholdMB == 64; } },
+    { "-q", NULL, [](const STORAGE_OPTIONS* A_options) { return A_options->TuneDeflate == SAMP_TRUE; } },
+    { "-r", "4", [](const STORAGE_OPTIONS* A_options) { return A_options->ReadAheadFiles == 4 && A_options->ReadAheadMB == -1; } },
+    { "-r", "4,16", [](const STORAGE_OPTIONS* A_options) { return A_options->ReadAheadFiles == 4 && A_options->ReadAheadMB == 16; } },
+    { "-s", "32", [](const STORAGE_OPTIONS* A_options) { return A_options->SpillThresholdMB == 32; } },
+    { "-t", "scratch", [](const STORAGE_OPTIONS* A_options) { return strcmp(A_options->ScratchPath, "scratch") == 0; } },
+    { "-u", NULL, [](const STORAGE_OPTIONS* A_options) { return A_options->Transcode == SAMP_TRUE; } },
+    { "-w", "incoming", [](const STORAGE_OPTIONS* A_options) { return A_options->UseWatch == SAMP_TRUE && strcmp(A_options->WatchPath, "incoming") == 0; } },
+    { "-x", "16", [](const STORAGE_OPTIONS* A_options) { return A_options->StreamThresholdMB == 16; } },
+    { "-y", NULL, [](const STORAGE_OPTIONS* A_options) { return A_options->RleOnly == SAMP_TRUE; } },
+    { "-z", "25", [](const STORAGE_OPTIONS* A_options) { return A_options->ValidatePercent == 25; } },
+};
+
+TEST_CASE("when a switch is given on the command line then TestCmdLine() sets its option")
+{
+    for (size_t i = 0; i < sizeof(SwitchCases) / sizeof(SwitchCases[0]); i++)
+    {
+        char        fname[256];
+        mainclass   testobj(fname);
+        const char* argv[] = { "SCU", "MERGE_STORE_SCP", SwitchCases[i].name, SwitchCases[i].value, NULL };
+        int         argc = SwitchCases[i].value ? 4 : 3;
+
+        INFO(SwitchCases[i].name << " " << (SwitchCases[i].value ? SwitchCases[i].value : ""));
+        REQUIRE(TestCmdLine(argc, argv, &testobj.options) == SAMP_TRUE);
+        REQUIRE(SwitchCases[i].isSet(&testobj.options));
+    }
+}
+//************Unit Tests LookupTables.cpp*********************
+TEST_CASE("when a transfer syntax is looked up then its own description and support flag are returned")
+{
+    SECTION("when a supported syntax is given then GetSyntaxDescription() returns its description")
+    {
+        REQUIRE(strcmp(GetSyntaxDescription(EXPLICIT_LITTLE_ENDIAN), "Explicit VR Little Endian") == 0);
+        REQUIRE(strcmp(GetSyntaxDescription(RLE), "RLE") == 0);
+        REQUIRE(LookupSyntax(JPEG_LS_LOSSLESS).supported == true);
+    }
+    SECTION("when an unknown syntax is given then the invalid entry is returned")
+    {
+        REQUIRE(LookupSyntax(INVALID_TRANSFER_SYNTAX).supported == false);
+        REQUIRE(LookupSyntax(12345).syntax == INVALID_TRANSFER_SYNTAX);
+    }
+}
+TEST_CASE("when a C-STORE status is classified then the class matches its range")
+{
+    REQUIRE(ClassifyStoreStatus(C_STORE_SUCCESS) == STATUS_CLASS_SUCCESS);
+    REQUIRE(ClassifyStoreStatus(C_STORE_WARNING_ELEMENT_COERCION) == STATUS_CLASS_WARNING);
+    REQUIRE(ClassifyStoreStatus(0xA710) == STATUS_CLASS_FAILURE);
+    REQUIRE(ClassifyStoreStatus(C_STORE_FAILURE_PROCESSING_FAILURE) == STATUS_CLASS_FAILURE);
+}
+TEST_CASE("when a switch is looked up then only known single letter switches have a handler")
+{
+    REQUIRE(LookupSwitch("-A") == LocalAE);
+    REQUIRE(LookupSwitch("-h") == NULL);
+    REQUIRE(LookupSwitch("-ab") == NULL);
+    REQUIRE(LookupPositional(1) == RemoteAE);
+    REQUIRE(LookupPositional(4) == NULL);
+}
+TEST_CASE("when a C-STORE status is looked up then the status table gives the action for the instance")
+{
+    SECTION("when the SCP is out of resources then the instance is retried later")
+    {
+        REQUIRE(StoreStatusAt(LookupStoreStatusIndex(C_STORE_FAILURE_REFUSED_NO_RESOURCES)).action == STORE_ACTION_RETRY_LATER);
+        REQUIRE(StoreStatusAt(LookupStoreStatusIndex(0xA7FF)).action == STORE_ACTION_RETRY_LATER);
+    }
+    SECTION("when the dataset is rejected then the instance fails and the others continue")
+    {
+        REQUIRE(StoreStatusAt(LookupStoreStatusIndex(0xA950)).action == STORE_ACTION_FAIL_INSTANCE);
+        REQUIRE(StoreStatusAt(LookupStoreStatusIndex(0xC123)).action == STORE_ACTION_FAIL_INSTANCE);
+    }
+    SECTION("when a processing failure is returned then the instance is retried on a new association")
+    {
+        REQUIRE(StoreStatusAt(LookupStoreStatusIndex(C_STORE_FAILURE_PROCESSING_FAILURE)).action == STORE_ACTION_RETRY_NEW_ASSOCIATION);
+    }
+    SECTION("when an unknown status is returned then the catch-all entry is used")
+    {
+        REQUIRE(LookupStoreStatusIndex(0x1234) == NUM_STORE_STATUS_ENTRIES - 1);
+        REQUIRE(ClassifyStoreStatus(0x1234) == STATUS_CLASS_UNKNOWN);
+    }
+}
+TEST_CASE("when instances ask to be sent again then GetNumRetryRequests() and NeedsNewAssociation() report them")
+{
+    InstanceNode first = { 0 }, second = { 0 };
+    first.Next = &second;
+    first.action = STORE_ACTION_RETRY_LATER;
+    second.action = STORE_ACTION_FAIL_INSTANCE;
+    REQUIRE(GetNumRetryRequests(&first) == 1);
+    REQUIRE(NeedsNewAssociation(&first) == false);
+
+    second.action = STORE_ACTION_RETRY_NEW_ASSOCIATION;
+    REQUIRE(GetNumRetryRequests(&first) == 2);
+    REQUIRE(NeedsNewAssociation(&first) == true);
+
+    PrepareNodeForRetry(&second);
+    REQUIRE(second.retryCount == 1);
+    REQUIRE(GetNumRetryRequests(&first) == 1);
+}
+//************Unit Tests Logger.cpp*********************
+TEST_CASE("when the logger is started and stopped then every queued message is written and LogStop() returns")
+{
+    LogStart(LOG_LEVEL_DEBUG);
+    for (int i = 0; i < 1000; i++)
+    {
+        LogMessage(LOG_LEVEL_DEBUG, "");
+    }
+    LogMessage(LOG_LEVEL_ERROR, "logger test message\n");
+    LogStop();
+    LogStop();
+    LogMessage(LOG_LEVEL_INFO, "logger test message after LogStop\n");
+}
+//************Unit Tests MemoryBudget.cpp*********************
+TEST_CASE("when messages are reserved in the memory budget then the cap is respected")
+{
+    MemoryBudgetConfigure(1000, 0);
+    SECTION("when a reservation fits then MemoryBudgetAcquire() returns at once")
+    {
+        MemoryBudgetAcquire(600);
+        REQUIRE(MemoryBudgetInUse() == 600);
+        MemoryBudgetRelease(600);
+        REQUIRE(MemoryBudgetInUse() == 0);
+    }
+    SECTION("when nothing is held then an object larger than the cap is let through")
+    {
+        MemoryBudgetAcquire(5000);
+        REQUIRE(MemoryBudgetInUse() == 5000);
+        MemoryBudgetRelease(5000);
+    }
+    SECTION("when the cap is reached then MemoryBudgetAcquire() waits for a release")
+    {
+        MemoryBudgetAcquire(800);
+        std::thread reader([] { MemoryBudgetAcquire(400); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        REQUIRE(MemoryBudgetInUse() == 800);
+        MemoryBudgetRelease(800);
+        reader.join();
+        REQUIRE(MemoryBudgetInUse() == 400);
+        MemoryBudgetRelease(400);
+    }
+}
+TEST_CASE("when large data is kept in files then only the part below LARGE_DATA_SIZE is charged")
+{
+    MemoryBudgetConfigure(1000, 4096);
+    REQUIRE(EstimateMessageBytes(100000, true) == 4096);
+    REQUIRE(EstimateMessageBytes(1000, true) == 1000);
+    REQUIRE(EstimateMessageBytes(100000, false) == 100000);
+}
+//************Unit Tests LargeDataStore.cpp*********************
+TEST_CASE("when an object is large or memory is short then ShouldSpillToFile() returns true")
+{
+    MemoryBudgetConfigure((size_t)DEFAULT_MEMORY_BUDGET_MB * 1024 * 1024, 4096);
+    SECTION("when a small object is read with memory to spare then it is kept in memory")
+    {
+        REQUIRE(ShouldSpillToFile(1024 * 1024) == false);
+    }
+    SECTION("when an object reaches the spill threshold then it is kept in temporary files")
+    {
+        REQUIRE(ShouldSpillToFile((size_t)DEFAULT_SPILL_THRESHOLD_MB * 1024 * 1024) == true);
+    }
+    SECTION("when the memory budget is under pressure then a small object is kept in temporary files")
+    {
+        size_t held = (size_t)DEFAULT_MEMORY_BUDGET_MB * 1024 * 1024 / 100 * SPILL_PRESSURE_PERCENT;
+        MemoryBudgetAcquire(held);
+        REQUIRE(ShouldSpillToFile(1024 * 1024) == true);
+        MemoryBudgetRelease(held);
+    }
+}
+//************Unit Tests PixelStream.cpp*********************
+TEST_CASE("when a streaming threshold is set then only objects of at least that size are streamed")
+{
+    PixelStreamInit(0);
+    REQUIRE(ShouldStreamPixelData((size_t)4096 * 1024 * 1024) == false);
+    PixelStreamInit(100);
+    REQUIRE(ShouldStreamPixelData((size_t)99 * 1024 * 1024) == false);
+    REQUIRE(ShouldStreamPixelData((size_t)100 * 1024 * 1024) == true);
+    PixelStreamInit(0);
+}
+TEST_CASE("when pixel data is requested for a message that is not streamed then PixelDataCallback() fails")
+{
+    unsigned long size = 0;
+    void* buffer = NULL;
+    int isLast = 0;
+    REQUIRE(PixelDataCallback(12345, MC_ATT_PIXEL_DATA, NULL, REQUEST_FOR_DATA, &size, &buffer, 1, &isLast) == MC_CANNOT_COMPLY);
+}
+//************Unit Tests ObjectPool.cpp*********************
+TEST_CASE("when a read buffer is asked for then GetReadBuffer() returns the thread's aligned buffer")
+{
+    char* first = GetReadBuffer(64 * 1024);
+    REQUIRE(first != NULL);
+    REQUIRE(((uintptr_t)first % READ_BUFFER_ALIGNMENT) == 0);
+    SECTION("when a smaller or equal buffer is asked for then the same buffer is returned")
+    {
+        REQUIRE(GetReadBuffer(32 * 1024) == first);
+        REQUIRE(GetReadBuffer(64 * 1024) == first);
+    }
+    SECTION("when a larger buffer is asked for then an aligned buffer of that size is returned")
+    {
+        char* larger = GetReadBuffer(1024 * 1024);
+        REQUIRE(larger != NULL);
+        REQUIRE(((uintptr_t)larger % READ_BUFFER_ALIGNMENT) == 0);
+        larger[1024 * 1024 - 1] = 0;
+    }
+}
+//************Unit Tests ReadAhead.cpp*********************
+TEST_CASE("when an image is sent then ReadAheadFrom() hints the next files within the window")
+{
+    InstanceNode nodes[4] = { 0 };
+    for (int i = 0; i < 4; i++)
+    {
+        strcpy(nodes[i].fname, "../SampleImg/0.img");
+        nodes[i].fileBytes = 1000;
+        nodes[i].Next = (i < 3) ? &nodes[i + 1] : NULL;
+    }
+    SECTION("when read-ahead is off then no file is hinted")
+    {
+        ReadAheadInit(0, -1);
+        ReadAheadFrom(&nodes[0]);
+        REQUIRE(nodes[1].readAheadBytes == 0);
+    }
+    SECTION("when two files are read ahead then only the two following files are hinted")
+    {
+        ReadAheadInit(2, -1);
+        ReadAheadFrom(&nodes[0]);
+        REQUIRE(nodes[0].readAheadBytes == 0);
+        REQUIRE(nodes[1].readAheadBytes > 0);
+        REQUIRE(nodes[2].readAheadBytes > 0);
+        REQUIRE(nodes[3].readAheadBytes == 0);
+    }
+    SECTION("when a file crosses the byte budget then only the bytes left in the window are hinted")
+    {
+        nodes[1].fileBytes = 3 * 1024 * 1024;
+        ReadAheadInit(8, 1);
+        ReadAheadFrom(&nodes[0]);
+        REQUIRE(nodes[1].readAheadBytes == 1024 * 1024);
+        REQUIRE(nodes[2].readAheadBytes == 0);
+    }
+    ReadAheadInit(-1, -1);
+}
+//************Unit Tests FileProbe.cpp*********************
+TEST_CASE("when the files are probed then GetNodeFormat() returns the format of each file")
+{
+    InstanceNode nodes[3] = { 0 };
+    strcpy(nodes[0].fname, "../SampleImg/0.img");
+    strcpy(nodes[1].fname, "NoSuchFile.dcm");
+    strcpy(nodes[2].fname, "../SampleImg/0.img");
+    nodes[0].Next = &nodes[1];
+    nodes[1].Next = &nodes[2];
+    SECTION("when the probe has run then every file is checked")
+    {
+        ProbeStart(&nodes[0]);
+        ProbeWait();
+        ProbeStop();
+        for (int i = 0; i < 3; i++)
+            REQUIRE(nodes[i].formatChecked == SAMP_TRUE);
+        REQUIRE(GetNodeFormat(&nodes[0]) == MEDIA_FORMAT);
+        REQUIRE(GetNodeFormat(&nodes[1]) == UNKNOWN_FORMAT);
+        REQUIRE(GetNodeFormat(&nodes[2]) == MEDIA_FORMAT);
+    }
+    SECTION("when the probe has not reached a file then it is checked on the spot")
+    {
+        REQUIRE(GetNodeFormat(&nodes[1]) == UNKNOWN_FORMAT);
+        REQUIRE(nodes[1].formatChecked == SAMP_FALSE);
+    }
+}
+//************Unit Tests DirectRead.cpp*********************
+TEST_CASE("when a direct read threshold is set then only objects of at least that size are read with O_DIRECT")
+{
+    DirectReadInit(0);
+    REQUIRE(ShouldReadDirect(1024 * 1024 * 1024) == false);
+    REQUIRE(GetFileReadCallback() == MediaToFileObj);
+    DirectReadInit(8);
+    REQUIRE(ShouldReadDirect(8 * 1024 * 1024) == true);
+    REQUIRE(ShouldReadDirect(8 * 1024 * 1024 - 1) == false);
+    ApplyDirectRead(true);
+    REQUIRE(GetFileReadCallback() == DirectToFileObj);
+    ApplyDirectRead(false);
+    DirectReadInit(0);
+}
+TEST_CASE("when a file is read with DirectToFileObj then the whole file is delivered with or without O_DIRECT")
+{
+    CBinfo      callbackInfo = { 0 };
+    struct stat fileInfo;
+    void*       buffer = NULL;
+    int         dataSize = 0;
+    int         isLast = 0;
+    int         isFirst = 1;
+
+    REQUIRE(stat("../SampleImg/0.img", &fileInfo) == 0);
+    while (!isLast)
+    {
+        REQUIRE(DirectToFileObj((char*)"../SampleImg/0.img", &callbackInfo, &dataSize, &buffer, isFirst, &isLast) == MC_NORMAL_COMPLETION);
+        isFirst = 0;
+    }
+    REQUIRE(callbackInfo.bytesRead == (size_t)fileInfo.st_size);
+    CloseCallBackInfo(callbackInfo);
+}
+//************Unit Tests ReadChunk.cpp*********************
+TEST_CASE("when a read chunk size is chosen then it grows with the file between MIN_READ_CHUNK and MAX_READ_CHUNK")
+{
+    ReadChunkInit();
+    REQUIRE(ChooseReadChunkSize(0) == MIN_READ_CHUNK);
+    REQUIRE(ChooseReadChunkSize(MIN_READ_CHUNK - 1) == MIN_READ_CHUNK);
+    REQUIRE(ChooseReadChunkSize(MIN_READ_CHUNK) == 2 * MIN_READ_CHUNK);
+    REQUIRE(ChooseReadChunkSize((size_t)500 * 1024 * 1024) <= MAX_READ_CHUNK);
+    REQUIRE(ChooseReadChunkSize((size_t)500 * 1024 * 1024) % READ_BUFFER_ALIGNMENT == 0);
+    SECTION("when a slow read has been measured then large files are read in smaller chunks")
+    {
+        CBinfo callbackInfo = { 0 };
+        callbackInfo.bytesRead = 16 * 1024 * 1024;
+        callbackInfo.readSeconds = 16.0;
+        callbackInfo.reads = 2;
+        callbackInfo.bufferLength = MAX_READ_CHUNK;
+        RecordFileRead(&callbackInfo);
+        REQUIRE(ChooseReadChunkSize((size_t)500 * 1024 * 1024) < MAX_READ_CHUNK);
+        REQUIRE(ChooseReadChunkSize((size_t)500 * 1024 * 1024) >= MIN_READ_CHUNK);
+    }
+    ReadChunkInit();
+}
+//************Unit Tests DirectoryCrawl.cpp*********************
+TEST_CASE("when a directory is crawled then every DICOM Part 10 file below it is added to the list")
+{
+    InstanceNode* list = NULL;
+    int           added = 0;
+    int           count = 0;
+
+    SECTION("when the directory holds DICOM files then all of them are added")
+    {
+        CrawlStart("../SampleImg");
+        while ((count = CrawlAppendFiles(&list)) > 0)
+            added += count;
+        CrawlStop();
+        REQUIRE(added == 4);
+        REQUIRE(GetNumNodes(list) == 4);
+        FreeList(&list);
+    }
+    SECTION("when the directory does not exist then nothing is added")
+    {
+        CrawlStart("NoSuchDirectory");
+        REQUIRE(CrawlAppendFiles(&list) == 0);
+        CrawlStop();
+        REQUIRE(list == NULL);
+    }
+}
+//************Unit Tests DicomDir.cpp*********************
+TEST_CASE("when the DICOMDIR cannot be opened then ReadDicomDir() fails and adds nothing")
+{
+    InstanceNode* list = NULL;
+
+    REQUIRE(ReadDicomDir(&list, "NoSuchDirectory/DICOMDIR") == false);
+    REQUIRE(list == NULL);
+}
+TEST_CASE("when files are added to a list then GetListTail() returns the last one")
+{
+    InstanceNode* list = NULL;
+    char          fname[] = "../SampleImg/0.img";
+
+    REQUIRE(GetListTail(list) == NULL);
+    AddFileToList(&list, fname);
+    REQUIRE(GetListTail(list) == list);
+    AddFileToList(&list, fname);
+    AddFileToList(&list, fname);
+    REQUIRE(GetListTail(list) == list->Next->Next);
+    REQUIRE(GetNumNodes(list) == 3);
+    FreeList(&list);
+}
+//************Unit Tests DirectoryWatch.cpp*********************
+TEST_CASE("when the directory cannot be watched then WatchStart() fails")
+{
+    REQUIRE(WatchStart("NoSuchDirectory") == false);
+    REQUIRE(WatchRunning() == false);
+    WatchStop();
+}
+#if defined(__linux__)
+TEST_CASE("when a DICOM file is written to the watched directory then WatchCollect() adds it to the list")
+{
+    InstanceNode* list = NULL;
+    char          buffer[4096];
+    size_t        bytes;
+
+    REQUIRE(WatchStart("."));
+    REQUIRE(WatchCollect(&list, 0) == 0);
+
+    FILE* in = fopen("../SampleImg/0.img", "rb");
+    FILE* out = fopen("WatchTest.img", "wb");
+    REQUIRE(in != NULL);
+    REQUIRE(out != NULL);
+    while ((bytes = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        fwrite(buffer, 1, bytes, out);
+    fclose(in);
+    fclose(out);
+
+    REQUIRE(WatchCollect(&list, 2000) == 1);
+    REQUIRE(GetNumNodes(list) == 1);
+    WatchStop();
+    remove("WatchTest.img");
+    FreeList(&list);
+}
+#endif
+//************Unit Tests StudyBatch.cpp*********************
+TEST_CASE("when no study is held then TakeQuietStudy() returns nothing")
+{
+    REQUIRE(StudiesHeld() == false);
+    REQUIRE(TakeQuietStudy(0) == NULL);
+    REQUIRE(NextStudyDueMs(5) == 5000);
+}
+/*
+ * Writes a Part 10 file in implicit VR little endian holding only its
+ * Study Instance UID
+ */
+static void WriteStudyFile(const char* A_fname, const char* A_studyUID)
+{
+    std::string syntax("1.2.840.10008.1.2\0", 18);
+    std::string study = std::string(A_studyUID) + std::string(strlen(A_studyUID) % 2, '\0');
+    std::string file = std::string(128, '\0') + "DICM";
+
+    file += std::string("\x02\x00\x10\x00UI", 6) + (char)syntax.size() + '\0' + syntax;
+    file += std::string("\x20\x00\x0D\x00", 4) + (char)study.size() + std::string(3, '\0') + study;
+    FILE* fp = fopen(A_fname, "wb");
+    fwrite(file.data(), 1, file.size(), fp);
+    fclose(fp);
+}
+static InstanceNode** AppendStudyFile(InstanceNode** A_link, const char* A_fname)
+{
+    *A_link = (InstanceNode*)calloc(1, sizeof(InstanceNode));
+    (*A_link)->msgID = -1;
+    strcpy((*A_link)->fname, A_fname);
+    return &(*A_link)->Next;
+}
+static void FreeStudy(InstanceNode* A_study)
+{
+    while (A_study)
+    {
+        InstanceNode* next = A_study->Next;
+        free(A_study);
+        A_study = next;
+    }
+}
+TEST_CASE("when files of two studies are held then each study is taken whole, in the order the studies first appear")
+{
+    InstanceNode*  list = NULL;
+    InstanceNode** link = &list;
+
+    WriteStudyFile("StudyA1.img", "1.2.3.1");
+    WriteStudyFile("StudyB1.img", "1.2.3.2");
+    WriteStudyFile("StudyA2.img", "1.2.3.1");
+
+    SECTION("when any study may be taken then the first to appear comes first with its later files")
+    {
+        link = AppendStudyFile(link, "StudyA1.img");
+        link = AppendStudyFile(link, "StudyB1.img");
+        AppendStudyFile(link, "StudyA2.img");
+        HoldStudies(-1, list);
+
+        InstanceNode* first = TakeQuietStudy(0);
+        REQUIRE(GetNumNodes(first) == 2);
+        REQUIRE(strcmp(first->fname, "StudyA1.img") == 0);
+        REQUIRE(strcmp(first->Next->fname, "StudyA2.img") == 0);
+        InstanceNode* second = TakeQuietStudy(0);
+        REQUIRE(GetNumNodes(second) == 1);
+        REQUIRE(strcmp(second->studyUID, "1.2.3.2") == 0);
+        REQUIRE(TakeQuietStudy(0) == NULL);
+        FreeStudy(first);
+        FreeStudy(second);
+    }
+    SECTION("when a study had a file added within the quiet period then the studies quiet before it are taken")
+    {
+        link = AppendStudyFile(link, "StudyA1.img");
+        AppendStudyFile(link, "StudyB1.img");
+        HoldStudies(-1, list);
+        REQUIRE(TakeQuietStudy(1) == NULL);
+        REQUIRE(NextStudyDueMs(1) > 0);
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        InstanceNode* late = NULL;
+        AppendStudyFile(&late, "StudyA2.img");
+        HoldStudies(-1, late);
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+
+        InstanceNode* quiet = TakeQuietStudy(1);
+        REQUIRE(GetNumNodes(quiet) == 1);
+        REQUIRE(strcmp(quiet->fname, "StudyB1.img") == 0);
+        REQUIRE(TakeQuietStudy(1) == NULL);
+        InstanceNode* rest = TakeQuietStudy(0);
+        REQUIRE(GetNumNodes(rest) == 2);
+        REQUIRE(StudiesHeld() == false);
+        FreeStudy(quiet);
+        FreeStudy(rest);
+    }
+    remove("StudyA1.img");
+    remove("StudyB1.img");
+    remove("StudyA2.img");
+}
+TEST_CASE("when the files come with the UIDs of their DICOMDIR records then they are held by study without being read")
+{
+    InstanceNode*  list = NULL;
+    InstanceNode** link = AppendStudyFile(&list, "NoSuchDirectory/IM1");
+
+    AppendStudyFile(link, "NoSuchDirectory/IM2");
+    strcpy(list->studyUID, "1.2.3.1");
+    strcpy(list->Next->studyUID, "1.2.3.2");
+    strcpy(list->SOPClassUID, "1.2.840.10008.5.1.4.1.1.2");
+    strcpy(list->Next->SOPClassUID, "1.2.840.10008.5.1.4.1.1.2");
+    HoldStudies(-1, list);
+
+    InstanceNode* first = TakeQuietStudy(0);
+    InstanceNode* second = TakeQuietStudy(0);
+    REQUIRE(GetNumNodes(first) == 1);
+    REQUIRE(strcmp(first->studyUID, "1.2.3.1") == 0);
+    REQUIRE(GetNumNodes(second) == 1);
+    REQUIRE(strcmp(second->studyUID, "1.2.3.2") == 0);
+    FreeStudy(first);
+    FreeStudy(second);
+}
+TEST_CASE("when no study services were proposed then the configured service list is used")
+{
+    char configured[] = "Storage_SCU_Service_List";
+
+    EndStudyServices();
+    REQUIRE(StudyServiceList(configured) == configured);
+}
+//************Unit Tests ParallelSend.cpp*********************
+static InstanceNode* NewSizedNode(InstanceNode** A_list, size_t A_fileBytes)
+{
+    InstanceNode* node = (InstanceNode*)calloc(1, sizeof(InstanceNode));
+    node->msgID = -1;
+    node->fileBytes = A_fileBytes;
+    node->Next = *A_list;
+    *A_list = node;
+    return node;
+}
+TEST_CASE("when files are shared out between associations then they are balanced by size and idle associations take over the smallest files")
+{
+    InstanceNode* list = NULL;
+    InstanceNode* small = NewSizedNode(&list, 10);
+    NewSizedNode(&list, 20);
+    InstanceNode* medium = NewSizedNode(&list, 500);
+    InstanceNode* large = NewSizedNode(&list, 1000);
+
+    ParallelPlan(list, 2);
+    REQUIRE(ParallelTake(0) == large);
+    REQUIRE(ParallelTake(0) == small);
+    REQUIRE(ParallelTake(1) == medium);
+
+    list = NULL;
+    REQUIRE(ParallelFinish(&list) == 1);
+    REQUIRE(GetNumNodes(list) == 1);
+    REQUIRE(list->fileBytes == 20);
+    FreeList(&list);
+    free(small);
+    free(medium);
+    free(large);
+}
+TEST_CASE("when an association sends a file then ParallelReadAhead() hints the next files left to it")
+{
+    InstanceNode* list = NULL;
+    InstanceNode* small = NewSizedNode(&list, 10);
+    InstanceNode* next = NewSizedNode(&list, 20);
+    InstanceNode* medium = NewSizedNode(&list, 500);
+    InstanceNode* large = NewSizedNode(&list, 1000);
+
+    ReadAheadInit(2, -1);
+    ParallelPlan(list, 2);
+    ParallelReadAhead(1);
+    REQUIRE(large->readAheadBytes == 0);
+    REQUIRE(medium->readAheadBytes > 0);
+    REQUIRE(next->readAheadBytes > 0);
+    REQUIRE(small->readAheadBytes == 0);
+    ReadAheadInit(-1, -1);
+
+    list = NULL;
+    ParallelFinish(&list);
+    FreeList(&list);
+}
+//************Unit Tests ScpPool.cpp*********************
+TEST_CASE("when an SCP pool is not host:port pairs then it is refused")
+{
+    REQUIRE(PoolParse("node1") == false);
+    REQUIRE(PoolParse("node1:104,:104") == false);
+    REQUIRE(PoolParse("node1:0") == false);
+    REQUIRE(PoolConfigured() == false);
+}
+TEST_CASE("when associations are opened to an SCP pool then they go to the least loaded SCP that is up")
+{
+    char host[STR_LENGTH];
+    int  port = 0;
+
+    REQUIRE(PoolParse("node1:104,node2:105") == true);
+    REQUIRE(PoolConfigured() == true);
+
+    SECTION("when both SCPs are idle then the associations are spread over them")
+    {
+        REQUIRE(PoolAcquire() == 0);
+        REQUIRE(PoolAcquire() == 1);
+        PoolEndpointAddress(1, host, &port);
+        REQUIRE(strcmp(host, "node2") == 0);
+        REQUIRE(port == 105);
+    }
+    SECTION("when both SCPs have as many associations then the one with fewer bytes in flight is used")
+    {
+        REQUIRE(PoolAcquire() == 0);
+        REQUIRE(PoolAcquire() == 1);
+        PoolAddInFlight(0, 1000);
+        REQUIRE(PoolAcquire() == 1);
+        PoolAddInFlight(0, -1000);
+    }
+    SECTION("when an SCP has more associations then the other one is used whatever is in flight")
+    {
+        REQUIRE(PoolAcquire() == 0);
+        PoolAddInFlight(1, 1000);
+        REQUIRE(PoolAcquire() == 1);
+        PoolAddInFlight(1, -1000);
+    }
+    SECTION("when an association fails then its SCP is not used again")
+    {
+        PoolRelease(PoolAcquire(), true);
+        REQUIRE(PoolAcquire() == 1);
+        REQUIRE(PoolAcquire() == 1);
+        PoolRelease(1, true);
+        REQUIRE(PoolAcquire() == -1);
+    }
+    PoolParse("");
+    REQUIRE(PoolConfigured() == false);
+}
+TEST_CASE("when an association fails then the files not acknowledged are marked to be sent on a new association")
+{
+    InstanceNode* list = NULL;
+    InstanceNode* acknowledged = NewSizedNode(&list, 10);
+    InstanceNode* sent = NewSizedNode(&list, 10);
+    InstanceNode* unsent = NewSizedNode(&list, 10);
+
+    acknowledged->imageSent = SAMP_TRUE;
+    acknowledged->responseReceived = SAMP_TRUE;
+    sent->imageSent = SAMP_TRUE;
+
+    REQUIRE(RequeueUnacknowledged(list) == 1);
+    REQUIRE(sent->action == STORE_ACTION_RETRY_NEW_ASSOCIATION);
+    REQUIRE(sent->imageSent == SAMP_FALSE);
+    REQUIRE(acknowledged->action == STORE_ACTION_CONTINUE);
+    REQUIRE(unsent->action == STORE_ACTION_CONTINUE);
+    REQUIRE(GetNumOutstandingRequests(list) == 0);
+    FreeList(&list);
+}
+//************Unit Tests ConnectRace.cpp*********************
+TEST_CASE("when the remote host cannot be reached then RaceConnect() gives no socket")
+{
+    REQUIRE(RaceConnect("no.such.host.invalid", 104) == NO_SOCKET);
+    REQUIRE(RaceConnect("127.0.0.1", 1) == NO_SOCKET);
+}
+//************Unit Tests NegotiationCache.cpp*********************
+TEST_CASE("when the remote AE is not in the negotiation cache then the configured service list is proposed")
+{
+    char configured[] = "Storage_SCU_Service_List";
+
+    NegotiationCacheLoad("no_such_negotiation_cache.txt");
+    REQUIRE(NegotiatedServiceList("MERGE_STORE_SCP", configured) == configured);
+    NegotiationCacheSave();
+}
+TEST_CASE("when the negotiation kept is older than NEGOTIATION_CACHE_HOURS then the configured service list is proposed")
+{
+    char  configured[] = "Storage_SCU_Service_List";
+    FILE* fp = fopen("ExpiredNegotiations.txt", "w");
+
+    fprintf(fp, "MERGE_STORE_SCP\t%s\t%lld\t16384\t1\t1\tSTANDARD_CT=1\n", configured, (long long)time(NULL) - (NEGOTIATION_CACHE_HOURS + 1) * 3600LL);
+    fclose(fp);
+    NegotiationCacheLoad("ExpiredNegotiations.txt");
+    REQUIRE(NegotiatedServiceList("MERGE_STORE_SCP", configured) == configured);
+    NegotiationCacheSave();
+    remove("ExpiredNegotiations.txt");
+}
+TEST_CASE("when the negotiation kept is fresh then an association does not record it again")
+{
+    char      configured[] = "Storage_SCU_Service_List";
+    char      kept[256];
+    char      read[256] = "";
+    AssocInfo info;
+    FILE*     fp = fopen("FreshNegotiations.txt", "w");
+
+    memset(&info, 0, sizeof(info));
+    sprintf(kept, "MERGE_STORE_SCP\t%s\t%lld\t16384\t1\t1\tSTANDARD_CT=1\n", configured, (long long)time(NULL) - 3600LL);
+    fputs(kept, fp);
+    fclose(fp);
+    NegotiationCacheLoad("FreshNegotiations.txt");
+    NegotiatedServiceList("MERGE_STORE_SCP", configured);
+    NegotiationCacheRecord("MERGE_STORE_SCP", configured, 9001, &info);
+    NegotiationCacheSave();
+
+    fp = fopen("FreshNegotiations.txt", "r");
+    REQUIRE(fgets(read, sizeof(read), fp) != NULL);
+    fclose(fp);
+    REQUIRE(strcmp(read, kept) == 0);
+    remove("FreshNegotiations.txt");
+}
+//************Unit Tests Transcode.cpp*********************
+TEST_CASE("when syntaxes are accepted for a service then the smallest lossless one is chosen")
+{
+    TranscodeAccepted(9001, "STANDARD_CT", EXPLICIT_LITTLE_ENDIAN);
+    TranscodeAccepted(9001, "STANDARD_CT", DEFLATED_EXPLICIT_LITTLE_ENDIAN);
+
+    SECTION("when the file is uncompressed then the smallest syntax accepted is used")
+    {
+        REQUIRE(TranscodeChoose(9001, "STANDARD_CT", IMPLICIT_LITTLE_ENDIAN, true) == DEFLATED_EXPLICIT_LITTLE_ENDIAN);
+        TranscodeAccepted(9001, "STANDARD_CT", JPEG_LS_LOSSLESS);
+        REQUIRE(TranscodeChoose(9001, "STANDARD_CT", IMPLICIT_LITTLE_ENDIAN, true) == JPEG_LS_LOSSLESS);
+    }
+    SECTION("when the object has no pixel data then it is only deflated")
+    {
+        TranscodeAccepted(9001, "STANDARD_CT", JPEG_LS_LOSSLESS);
+        REQUIRE(TranscodeChoose(9001, "STANDARD_CT", EXPLICIT_LITTLE_ENDIAN, false) == DEFLATED_EXPLICIT_LITTLE_ENDIAN);
+    }
+    SECTION("when the file is compressed already then its own syntax is used")
+    {
+        REQUIRE(TranscodeChoose(9001, "STANDARD_CT", JPEG_BASELINE, true) == JPEG_BASELINE);
+    }
+    SECTION("when nothing is known of the service then the file's own syntax is used")
+    {
+        REQUIRE(TranscodeChoose(9001, "STANDARD_MR", EXPLICIT_LITTLE_ENDIAN, true) == EXPLICIT_LITTLE_ENDIAN);
+        REQUIRE(TranscodeChoose(9002, "STANDARD_CT", EXPLICIT_LITTLE_ENDIAN, true) == EXPLICIT_LITTLE_ENDIAN);
+    }
+    TranscodeInit(false, false);
+}
+TEST_CASE("when only RLE is used then it is chosen until the sample shows a poor ratio")
+{
+    TranscodeInit(false, true);
+    TranscodeAccepted(9003, "STANDARD_US", JPEG_LS_LOSSLESS);
+    TranscodeAccepted(9003, "STANDARD_US", RLE);
+    TranscodeAccepted(9003, "STANDARD_US", DEFLATED_EXPLICIT_LITTLE_ENDIAN);
+
+    SECTION("when RLE is accepted then it is chosen over JPEG-LS")
+    {
+        REQUIRE(TranscodeChoose(9003, "STANDARD_US", EXPLICIT_LITTLE_ENDIAN, true) == RLE);
+    }
+    SECTION("when the object has no pixel data then it is sent as it is")
+    {
+        REQUIRE(TranscodeChoose(9003, "STANDARD_US", EXPLICIT_LITTLE_ENDIAN, false) == EXPLICIT_LITTLE_ENDIAN);
+    }
+    SECTION("when the sample compresses well then RLE stays on")
+    {
+        for (int i = 0; i < RLE_SAMPLE_FILES; i++)
+            TranscodeRleSample(1000, 400);
+        REQUIRE(TranscodeChoose(9003, "STANDARD_US", EXPLICIT_LITTLE_ENDIAN, true) == RLE);
+    }
+    SECTION("when the sample barely compresses then RLE is turned off")
+    {
+        for (int i = 0; i < RLE_SAMPLE_FILES; i++)
+            TranscodeRleSample(1000, 950);
+        REQUIRE(TranscodeChoose(9003, "STANDARD_US", EXPLICIT_LITTLE_ENDIAN, true) == EXPLICIT_LITTLE_ENDIAN);
+    }
+    TranscodeInit(false, false);
+}
+//************Unit Tests Validation.cpp*********************
+TEST_CASE("when validation is off then no instance is quarantined")
+{
+    InstanceNode node;
+
+    memset(&node, 0, sizeof(node));
+    node.msgID = -1;
+    node.quarantined = SAMP_TRUE;
+    ValidateInit(0);
+
+    REQUIRE(ValidateEnabled() == false);
+    ValidateNode(&node);
+    REQUIRE(node.quarantined == SAMP_FALSE);
+}
+TEST_CASE("when -z 25 is given then 25 of every 100 candidates are validated, evenly spread")
+{
+    int sampled = 0;
+    int lastSampled = -1;
+    int largestGap = 0;
+
+    ValidateInit(25);
+    for (int i = 0; i < 100; i++)
+    {
+        if (!ValidateSampled())
+            continue;
+        sampled++;
+        largestGap = std::max(largestGap, i - lastSampled);
+        lastSampled = i;
+    }
+    REQUIRE(sampled == 25);
+    REQUIRE(largestGap == 4);
+    ValidateInit(0);
+}
+TEST_CASE("when a message does not validate then only errors in its dataset quarantine it")
+{
+    InstanceNode node;
+    VAL_ERR      error;
+
+    memset(&node, 0, sizeof(node));
+    memset(&error, 0, sizeof(error));
+    node.msgID = -1;
+    strcpy(node.fname, "Invalid.img");
+    error.Status = MC_INVALID_VALUE_FOR_VR;
+
+    SECTION("when the error is in the command group then the instance is sent")
+    {
+        error.Tag = 0x00001000UL;
+        ValidateQuarantine(&node, &error);
+        REQUIRE(node.quarantined == SAMP_FALSE);
+    }
+    SECTION("when the error is in the dataset then the instance is quarantined")
+    {
+        error.Tag = 0x00100010UL;
+        ValidateQuarantine(&node, &error);
+        REQUIRE(node.quarantined == SAMP_TRUE);
+        REQUIRE(strcmp(node.statusMeaning, "Quarantined: invalid dataset") == 0);
+    }
+}
+TEST_CASE("when an instance is quarantined then it is held back and not sent")
+{
+    char          fname[256];
+    mainclass     testobj(fname);
+    InstanceNode* list = NULL;
+    InstanceNode* next = NewSizedNode(&list, 1000);
+    InstanceNode* quarantined = NewSizedNode(&list, 1000);
+
+    quarantined->quarantined = SAMP_TRUE;
+    quarantined->imageSent = SAMP_TRUE;
+    testobj.instanceList = list;
+    testobj.node = quarantined;
+
+    testobj.HoldBackQuarantined();
+    REQUIRE(quarantined->imageSent == SAMP_FALSE);
+    REQUIRE(testobj.imagesSent == 0);
+    REQUIRE(testobj.node == next);
+    free(quarantined);
+    free(next);
+}
+TEST_CASE("when -z is given with -j or -e then validation is turned off")
+{
+    char fname[256];
+    mainclass testobj(fname);
+    const char  arg0[] = "SCU";
+    const char  arg1[] = "MERGE_STORE_SCP";
+    const char  arg2[] = "-z";
+    const char  arg3[] = "25";
+    const char  arg4[] = "-j";
+    const char  arg5[] = "2";
+    const char* argv[] = { &arg0[0], &arg1[0], &arg2[0], &arg3[0], &arg4[0], &arg5[0], NULL };
+    int   argc = (int)(sizeof(argv) / sizeof(argv[0])) - 1;
+    TestCmdLine(argc, argv, &testobj.options);
+
+    REQUIRE(testobj.options.Associations == 2);
+    REQUIRE(testobj.options.ValidatePercent == 0);
+}
+//************Unit Tests DeflateTuning.cpp*********************
+TEST_CASE("when deflated files are sent then the level is moved after each window")
+{
+    const size_t window = (size_t)DEFLATE_TUNE_MB * 1024 * 1024;
+    DeflateTuneInit(true);
+    int first = DeflateTuneLevel("TUNE_AE");
+
+    SECTION("when less than a window is sent then the level stays")
+    {
+        DeflateTuneRecord("TUNE_AE", window / 2, 1.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == first);
+    }
+    SECTION("when a window is sent then the level moves one step up")
+    {
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == std::min(first + 1, 9));
+    }
+    SECTION("when the next window is sent slower then the level turns back")
+    {
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        DeflateTuneRecord("TUNE_AE", window, 2.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == std::min(first + 1, 9) - 1);
+    }
+    SECTION("when another remote AE is sent to then its level is its own")
+    {
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        REQUIRE(DeflateTuneLevel("OTHER_AE") == first);
+    }
+    SECTION("when the fastest level is passed on both sides then it is held, then probed again")
+    {
+        REQUIRE(first > 1);
+        REQUIRE(first < 9);
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        DeflateTuneRecord("TUNE_AE", window, 2.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == first);
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == first - 1);
+        DeflateTuneRecord("TUNE_AE", window, 2.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") == first);
+        for (int i = 0; i < DEFLATE_TUNE_HOLD_WINDOWS; i++)
+        {
+            DeflateTuneRecord("TUNE_AE", window, 0.5 + (i % 2));
+            REQUIRE(DeflateTuneLevel("TUNE_AE") == first);
+        }
+        DeflateTuneRecord("TUNE_AE", window, 1.0);
+        REQUIRE(DeflateTuneLevel("TUNE_AE") != first);
+    }
+    DeflateTuneInit(false);
+}
+//************Unit Tests HeaderScan.cpp*********************
+TEST_CASE("when a Part 10 file is scanned then its UIDs and pixel data are found without the toolkit")
+{
+    Part10Header header;
+
+    REQUIRE(ScanPart10Header("../SampleImg/0.img", &header) == true);
+    REQUIRE(strcmp(header.transferSyntaxUID, "1.2.840.10008.1.2") == 0);
+    REQUIRE(strcmp(header.sopClassUID, "1.2.840.10008.5.1.4.1.1.7") == 0);
+    REQUIRE(strcmp(header.studyUID, "2.16.840.1.113669.11.1.0.20201015.1745170001") == 0);
+    REQUIRE(header.datasetScanned == true);
+
+    SECTION("when the pixel data is found then it runs to the end of the file")
+    {
+        FILE* fp = fopen("../SampleImg/0.img", "rb");
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fclose(fp);
+        REQUIRE(header.pixelDataOffset + (long long)header.pixelDataLength == size);
+    }
+}
+static void WriteScanTestFile(const char* A_filename, const std::string& A_bytes)
+{
+    FILE* fp = fopen(A_filename, "wb");
+    fwrite(A_bytes.data(), 1, A_bytes.size(), fp);
+    fclose(fp);
+}
+static std::string ScanTestTag(unsigned A_group, unsigned A_element)
+{
+    const char tag[] = { (char)(A_group & 0xFF), (char)(A_group >> 8), (char)(A_element & 0xFF), (char)(A_element >> 8) };
+    return std::string(tag, 4);
+}
+static std::string ScanTestLength32(unsigned long A_length)
+{
+    const char length[] = { (char)(A_length & 0xFF), (char)((A_length >> 8) & 0xFF), (char)((A_length >> 16) & 0xFF), (char)((A_length >> 24) & 0xFF) };
+    return std::string(length, 4);
+}
+static std::string ScanTestUI(unsigned A_group, unsigned A_element, const std::string& A_value)
+{
+    std::string value = A_value.size() % 2 ? A_value + '\0' : A_value;
+    const char  length[] = { (char)(value.size() & 0xFF), (char)(value.size() >> 8) };
+    return ScanTestTag(A_group, A_element) + "UI" + std::string(length, 2) + value;
+}
+static std::string ScanTestLong(unsigned A_group, unsigned A_element, const char* A_vr, unsigned long A_length)
+{
+    return ScanTestTag(A_group, A_element) + A_vr + std::string(2, '\0') + ScanTestLength32(A_length);
+}
+static std::string ScanTestItem(unsigned A_element, unsigned long A_length)
+{
+    return ScanTestTag(0xFFFE, A_element) + ScanTestLength32(A_length);
+}
+TEST_CASE("when an explicit VR file with a sequence is scanned then the sequence is stepped over to the pixel data")
+{
+    Part10Header header;
+    std::string  file = std::string(128, '\0') + "DICM" + ScanTestUI(0x0002, 0x0010, "1.2.840.10008.1.2.1");
+
+    file += ScanTestUI(0x0008, 0x0016, "1.2.840.10008.5.1.4.1.1.7");
+    file += ScanTestLong(0x0008, 0x1111, "SQ", SCAN_UNDEFINED_LENGTH);
+    file += ScanTestItem(0xE000, SCAN_UNDEFINED_LENGTH) + ScanTestUI(0x0020, 0x000D, "9.9.9") + ScanTestItem(0xE00D, 0);
+    file += ScanTestItem(0xE0DD, 0);
+    file += ScanTestUI(0x0020, 0x000D, "1.2.3.4.5");
+    file += ScanTestLong(0x7FE0, 0x0010, "OW", 4);
+    long long pixelDataOffset = (long long)file.size();
+    file += std::string(4, '\x7F');
+
+    SECTION("when the file is whole then the UIDs outside the sequence and the pixel data are found")
+    {
+        WriteScanTestFile("ExplicitScan.img", file);
+        REQUIRE(ScanPart10Header("ExplicitScan.img", &header) == true);
+        REQUIRE(strcmp(header.sopClassUID, "1.2.840.10008.5.1.4.1.1.7") == 0);
+        REQUIRE(strcmp(header.studyUID, "1.2.3.4.5") == 0);
+        REQUIRE(header.pixelDataOffset == pixelDataOffset);
+        REQUIRE(header.pixelDataLength == 4);
+        REQUIRE(header.datasetScanned == true);
+    }
+    SECTION("when the pixel data is cut short then the dataset is not taken as scanned")
+    {
+        WriteScanTestFile("ExplicitScan.img", file.substr(0, file.size() - 2));
+        REQUIRE(ScanPart10Header("ExplicitScan.img", &header) == true);
+        REQUIRE(header.datasetScanned == false);
+    }
+    SECTION("when the sequence has no delimiter then the dataset is not taken as scanned")
+    {
+        WriteScanTestFile("ExplicitScan.img", file.substr(0, file.find("1.2.3.4.5") - 16));
+        REQUIRE(ScanPart10Header("ExplicitScan.img", &header) == true);
+        REQUIRE(header.datasetScanned == false);
+    }
+    remove("ExplicitScan.img");
+}
+TEST_CASE("when a file is cut short then its dataset is not taken as scanned")
+{
+    Part10Header header;
+    std::string  part(5000, '\0');
+    FILE*        fp = fopen("../SampleImg/0.img", "rb");
+
+    REQUIRE(fread(&part[0], 1, part.size(), fp) == part.size());
+    fclose(fp);
+    WriteScanTestFile("Truncated.img", part);
+
+    REQUIRE(ScanPart10Header("Truncated.img", &header) == true);
+    REQUIRE(strcmp(header.sopClassUID, "1.2.840.10008.5.1.4.1.1.7") == 0);
+    REQUIRE(header.pixelDataOffset == SCAN_NO_PIXEL_DATA);
+    REQUIRE(header.datasetScanned == false);
+    remove("Truncated.img");
+}
+TEST_CASE("when a file is not in the Part 10 format then the scan fails")
+{
+    Part10Header header;
+
+    SECTION("when the file does not exist then the scan fails")
+    {
+        REQUIRE(ScanPart10Header("NameWhichDoesNotExist.img", &header) == false);
+    }
+    SECTION("when the file has no DICM signature then the scan fails")
+    {
+        char  zeros[256] = { 0 };
+        FILE* fp = fopen("NotPart10.img", "wb");
+        fwrite(zeros, 1, sizeof(zeros), fp);
+        fclose(fp);
+        REQUIRE(ScanPart10Header("NotPart10.img", &header) == false);
+        remove("NotPart10.img");
+    }
+}
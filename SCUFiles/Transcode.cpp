@@ -0,0 +1,634 @@
+#include "Definitions.h"
+#include <set>
+#include <string>
+
+/****************************************************************************
+ *
+ *  Transcoding
+ *
+ *  With -u a file stored uncompressed is sent in the smallest lossless
+ *  transfer syntax the remote AE accepted for its service: JPEG-LS
+ *  lossless, then RLE, then deflate.  The syntaxes accepted are read from
+ *  each association as it is opened; when several presentation contexts
+ *  of a service were accepted, the toolkit sends the message over the one
+ *  in its transfer syntax.  Objects without pixel data are only deflated.
+ *  Files that are compressed already, or whose pixel data is streamed
+ *  from the file (-x), are sent as they are.
+ *
+ *  JPEG-LS and RLE are encoded with MC_Duplicate_Message and the toolkit's
+ *  compressors.  Worker threads read and encode the upcoming files of the
+ *  list while earlier ones are sent, at most TRANSCODE_AHEAD files in
+ *  front of the sender, so the compression is off the send path.  A file
+ *  the workers have not reached is read and encoded by the sender.  Files
+ *  the directory crawl (-d) adds to the end of the list are taken up by
+ *  the workers once the sender has added them.  If
+ *  the compressor refuses a file it is sent as it is.  Deflate is applied
+ *  by the toolkit as the message is written to the network.
+ *
+ *  The workers also validate the messages they read when -z is given,
+ *  see Validation.cpp, and run for that alone without -u.
+ *
+ *  The workers reserve the memory of the files in list order, and only
+ *  when it is free, so the sender never waits on memory held by files it
+ *  has not reached.  There are TRANSCODE_THREADS workers; with -y, where
+ *  the RLE encoding of each frame is the cost, there is a worker per
+ *  core, and at least TRANSCODE_THREADS.
+ *
+ *  With -y only RLE is used, for remote AEs that accept it and not
+ *  JPEG-LS.  The toolkit calls the compressor for each frame, so the
+ *  frames of a multi-frame image are encoded one at a time.  The sizes
+ *  before and after RLE are added up over the first RLE_SAMPLE_FILES
+ *  files encoded; if they came down to no less than RLE_MAX_PERCENT, RLE
+ *  is not worth its time on these images and is turned off for the rest
+ *  of the run.
+ *
+ ****************************************************************************/
+
+typedef MC_STATUS (NOEXP_FUNC* CompressionCallback)(int, void**, unsigned long, void*, unsigned long*, void**, int, int, int);
+
+static thread_local unsigned long RleBytesIn = 0;    /* bytes given to the RLE compressor */
+static thread_local unsigned long RleBytesOut = 0;   /* bytes it returned */
+
+/*
+ * MC_RLE_Compressor, counting the bytes of the file being encoded by the
+ * thread
+ */
+static MC_STATUS NOEXP_FUNC SampledRleCompressor(int A_msgID, void** A_context, unsigned long A_inputLength, void* A_inputBuffer,
+                                                 unsigned long* A_outputLength, void** A_outputBuffer, int A_isFirst, int A_isLast, int A_release)
+{
+    MC_STATUS mcStatus = MC_RLE_Compressor(A_msgID, A_context, A_inputLength, A_inputBuffer, A_outputLength, A_outputBuffer, A_isFirst, A_isLast, A_release);
+
+    if (mcStatus == MC_NORMAL_COMPLETION && !A_release)
+    {
+        RleBytesIn += A_inputLength;
+        RleBytesOut += *A_outputLength;
+    }
+    return mcStatus;
+}
+
+/*
+ * A transfer syntax an uncompressed file may be sent in
+ */
+typedef struct transcode_target
+{
+    TRANSFER_SYNTAX     syntax;         /* Transfer syntax sent in */
+    CompressionCallback compressor;     /* NULL when the toolkit encodes it while sending */
+    CompressionCallback decompressor;   /* To read the encoded pixel data back */
+} TranscodeTarget;
+
+/*
+ * Smallest first
+ */
+static const TranscodeTarget TranscodeTargets[] =
+{
+    { JPEG_LS_LOSSLESS, MC_Standard_Compressor, MC_Standard_Decompressor },
+    { RLE, SampledRleCompressor, MC_RLE_Decompressor },
+    { DEFLATED_EXPLICIT_LITTLE_ENDIAN, NULL, NULL },
+};
+
+static const TRANSFER_SYNTAX UncompressedSyntaxes[] =
+{
+    IMPLICIT_LITTLE_ENDIAN, EXPLICIT_LITTLE_ENDIAN, EXPLICIT_BIG_ENDIAN, IMPLICIT_BIG_ENDIAN
+};
+
+typedef std::map<std::string, std::vector<TRANSFER_SYNTAX> > AcceptedSyntaxes;
+
+static bool                            TranscodeEnabled = false;
+static bool                            TranscodeRleOnly = false;
+static std::map<int, AcceptedSyntaxes> AcceptedByAssociation;
+static std::mutex                      AcceptedLock;
+
+static std::mutex                                TranscodeLock;
+static std::condition_variable                   TranscodeWindowOpen;
+static std::condition_variable                   TranscodeNodeDone;
+static InstanceNode*                             TranscodeCursor = NULL;
+static InstanceNode*                             TranscodeLast = NULL;    /* last file taken, see TranscodeListGrown */
+static bool                                      TranscodeRunning = false;
+static unsigned long                             TranscodeTaken = 0;      /* files taken from the list */
+static unsigned long                             TranscodeConsumed = 0;   /* files asked for by the sender */
+static std::set<InstanceNode*>                   TranscodeBusy;           /* files a worker is reading */
+static std::map<InstanceNode*, SAMP_BOOLEAN>     TranscodeReady;          /* files read, with the result */
+static unsigned long                             TranscodeAhead = TRANSCODE_AHEAD;
+static std::vector<std::thread*>                 TranscodeThreads;
+static STORAGE_OPTIONS*                          TranscodeOptions = NULL;
+static int                                       TranscodeAppID = -1;
+static int                                       TranscodeAssociationID = -1;
+
+static std::mutex                                RleSampleLock;
+static int                                       RleSampleFiles = 0;
+static unsigned long long                        RleSampleOriginal = 0;
+static unsigned long long                        RleSampleEncoded = 0;
+static std::atomic<bool>                         RleDisabled(false);
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeInit
+ *
+ *  Parameters  :   A_enabled  - Send uncompressed files in the smallest
+ *                               syntax accepted (-u)
+ *                  A_rleOnly  - Only send them in RLE (-y)
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void TranscodeInit(bool A_enabled, bool A_rleOnly)
+{
+    TranscodeEnabled = A_enabled || A_rleOnly;
+    TranscodeRleOnly = A_rleOnly;
+    {
+        std::lock_guard<std::mutex> lock(AcceptedLock);
+        AcceptedByAssociation.clear();
+    }
+
+    std::lock_guard<std::mutex> lock(RleSampleLock);
+    RleSampleFiles = 0;
+    RleSampleOriginal = RleSampleEncoded = 0;
+    RleDisabled = false;
+}
+
+/*
+ * Called holding RleSampleLock
+ */
+static void EndRleSample()
+{
+    unsigned long long percent = RleSampleEncoded * 100 / std::max(RleSampleOriginal, 1ULL);
+
+    RleDisabled = percent >= RLE_MAX_PERCENT;
+    LogMessage(RleDisabled ? LOG_LEVEL_INFO : LOG_LEVEL_DEBUG, "RLE brought the first %d files down to %d%%%s\n", RleSampleFiles, (int)percent, RleDisabled ? ", RLE is turned off" : "");
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeRleSample
+ *
+ *  Parameters  :   A_original - Size of the pixel data of a file
+ *                  A_encoded  - Its size once RLE encoded
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Add a file encoded to the sample, turning RLE off once
+ *                  RLE_SAMPLE_FILES are in if the ratio is poor.
+ *
+ ****************************************************************************/
+void TranscodeRleSample(unsigned long A_original, unsigned long A_encoded)
+{
+    std::lock_guard<std::mutex> lock(RleSampleLock);
+
+    if (RleSampleFiles >= RLE_SAMPLE_FILES)
+        return;
+    RleSampleOriginal += A_original;
+    RleSampleEncoded += A_encoded;
+    if (++RleSampleFiles == RLE_SAMPLE_FILES)
+        EndRleSample();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeAccepted
+ *
+ *  Parameters  :   A_associationID - Association negotiated
+ *                  A_service       - Service accepted
+ *                  A_syntax        - Transfer syntax accepted for it
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Note a presentation context accepted.  Called by
+ *                  TranscodeLearn for each one.
+ *
+ ****************************************************************************/
+void TranscodeAccepted(int A_associationID, const char* A_service, TRANSFER_SYNTAX A_syntax)
+{
+    std::lock_guard<std::mutex> lock(AcceptedLock);
+    AcceptedByAssociation[A_associationID][A_service].push_back(A_syntax);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeLearn
+ *
+ *  Parameters  :   A_associationID - Association just opened
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Read the transfer syntaxes accepted for each service.
+ *                  Does nothing without -u.
+ *
+ ****************************************************************************/
+void TranscodeLearn(int A_associationID)
+{
+    ServiceInfo service;
+
+    if (!TranscodeEnabled)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(AcceptedLock);
+        AcceptedByAssociation.erase(A_associationID);
+    }
+    for (MC_STATUS mcStatus = MC_Get_First_Acceptable_Service(A_associationID, &service); mcStatus == MC_NORMAL_COMPLETION; mcStatus = MC_Get_Next_Acceptable_Service(A_associationID, &service))
+        TranscodeAccepted(A_associationID, service.ServiceName, service.SyntaxType);
+}
+
+static bool IsUncompressed(TRANSFER_SYNTAX A_syntax)
+{
+    const TRANSFER_SYNTAX* end = UncompressedSyntaxes + sizeof(UncompressedSyntaxes) / sizeof(UncompressedSyntaxes[0]);
+
+    return std::find(UncompressedSyntaxes, end, A_syntax) != end;
+}
+
+/*
+ * Called holding AcceptedLock
+ */
+static const std::vector<TRANSFER_SYNTAX>* AcceptedFor(int A_associationID, const char* A_service)
+{
+    std::map<int, AcceptedSyntaxes>::iterator association = AcceptedByAssociation.find(A_associationID);
+
+    if (association == AcceptedByAssociation.end())
+        return NULL;
+    AcceptedSyntaxes::iterator syntaxes = association->second.find(A_service);
+    return syntaxes == association->second.end() ? NULL : &syntaxes->second;
+}
+
+static bool TargetEnabled(const TranscodeTarget& A_target)
+{
+    if (A_target.syntax != RLE)
+        return !TranscodeRleOnly;
+    return !RleDisabled;
+}
+
+/*
+ * An object without pixel data, e.g. a structured report, has nothing for
+ * a pixel compressor to encode and is only deflated
+ */
+static bool TargetUsable(const TranscodeTarget& A_target, bool A_pixelData)
+{
+    return (A_pixelData || !A_target.compressor) && TargetEnabled(A_target);
+}
+
+static bool TargetFits(const TranscodeTarget& A_target, const std::vector<TRANSFER_SYNTAX>& A_accepted, bool A_pixelData)
+{
+    return TargetUsable(A_target, A_pixelData) && std::find(A_accepted.begin(), A_accepted.end(), A_target.syntax) != A_accepted.end();
+}
+
+static const TranscodeTarget* FirstAccepted(const std::vector<TRANSFER_SYNTAX>& A_accepted, bool A_pixelData)
+{
+    for (size_t i = 0; i < sizeof(TranscodeTargets) / sizeof(TranscodeTargets[0]); i++)
+    {
+        if (TargetFits(TranscodeTargets[i], A_accepted, A_pixelData))
+            return &TranscodeTargets[i];
+    }
+    return NULL;
+}
+
+static const TranscodeTarget* BestTarget(int A_associationID, const char* A_service, bool A_pixelData)
+{
+    std::lock_guard<std::mutex>         lock(AcceptedLock);
+    const std::vector<TRANSFER_SYNTAX>* accepted = AcceptedFor(A_associationID, A_service);
+
+    return accepted ? FirstAccepted(*accepted, A_pixelData) : NULL;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeChoose
+ *
+ *  Parameters  :   A_associationID - Association the file is sent over
+ *                  A_service       - Service of the file
+ *                  A_source        - Transfer syntax of the file
+ *                  A_pixelData     - The file has pixel data
+ *
+ *  Returns     :   The transfer syntax to send the file in
+ *
+ *  Description :   The smallest lossless syntax accepted for the service
+ *                  when the file is uncompressed, its own otherwise.
+ *
+ ****************************************************************************/
+TRANSFER_SYNTAX TranscodeChoose(int A_associationID, const char* A_service, TRANSFER_SYNTAX A_source, bool A_pixelData)
+{
+    const TranscodeTarget* target = IsUncompressed(A_source) ? BestTarget(A_associationID, A_service, A_pixelData) : NULL;
+
+    return target ? target->syntax : A_source;
+}
+
+static bool NodeTranscodable(InstanceNode* A_node)
+{
+    return !A_node->streamPixelData && IsUncompressed(A_node->transferSyntax)
+        && MC_Get_MergeCOM_Service(A_node->SOPClassUID, A_node->serviceName, sizeof(A_node->serviceName)) == MC_NORMAL_COMPLETION;
+}
+
+static bool HasPixelData(int A_msgID)
+{
+    int count = 0;
+
+    return MC_Get_Value_Count(A_msgID, MC_ATT_PIXEL_DATA, &count) == MC_NORMAL_COMPLETION && count > 0;
+}
+
+static void NoteTranscoded(InstanceNode* A_node, TRANSFER_SYNTAX A_syntax)
+{
+    LogMessage(LOG_LEVEL_DEBUG, "[%s] sent in %s instead of %s\n", A_node->fname, GetSyntaxDescription(A_syntax), GetSyntaxDescription(A_node->transferSyntax));
+    A_node->transferSyntax = A_syntax;
+    A_node->transcoded = SAMP_TRUE;
+}
+
+static void SampleRatio(const TranscodeTarget& A_target)
+{
+    if (A_target.syntax == RLE && RleBytesIn > 0)
+        TranscodeRleSample(RleBytesIn, RleBytesOut);
+}
+
+/*
+ * The original message is kept when the compressor refuses the file,
+ * e.g. RLE of more than 16 bits
+ */
+static void EncodeInSyntax(InstanceNode* A_node, const TranscodeTarget& A_target)
+{
+    int       encodedID = -1;
+    RleBytesIn = RleBytesOut = 0;
+    MC_STATUS mcStatus = MC_Duplicate_Message(A_node->msgID, &encodedID, A_target.syntax, A_target.compressor, A_target.decompressor);
+
+    if (mcStatus != MC_NORMAL_COMPLETION)
+    {
+        LogMessage(LOG_LEVEL_DEBUG, "[%s] cannot be encoded in %s: %s\n", A_node->fname, GetSyntaxDescription(A_target.syntax), MC_Error_Message(mcStatus));
+        return;
+    }
+    FreeNodeMessage(A_node);
+    A_node->msgID = encodedID;
+    MC_Register_Compression_Callbacks(encodedID, A_target.compressor, A_target.decompressor);
+    NoteTranscoded(A_node, A_target.syntax);
+    SampleRatio(A_target);
+}
+
+static void SetSyntax(InstanceNode* A_node, TRANSFER_SYNTAX A_syntax)
+{
+    if (MC_Set_Message_Transfer_Syntax(A_node->msgID, A_syntax) == MC_NORMAL_COMPLETION)
+        NoteTranscoded(A_node, A_syntax);
+}
+
+static void TranscodeNode(int A_associationID, InstanceNode* A_node)
+{
+    const TranscodeTarget* target = NodeTranscodable(A_node) ? BestTarget(A_associationID, A_node->serviceName, HasPixelData(A_node->msgID)) : NULL;
+
+    A_node->transcoded = SAMP_FALSE;
+    if (!target)
+        return;
+    if (target->compressor)
+        EncodeInSyntax(A_node, *target);
+    else
+        SetSyntax(A_node, target->syntax);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeOnSend
+ *
+ *  Parameters  :   A_associationID - Association the file is sent over
+ *                  A_node          - Node whose file the sender has read
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Put the node's message in the syntax it is sent in,
+ *                  for files the workers did not read.  Does nothing
+ *                  without -u.
+ *
+ ****************************************************************************/
+void TranscodeOnSend(int A_associationID, InstanceNode* A_node)
+{
+    if (TranscodeEnabled)
+        TranscodeNode(A_associationID, A_node);
+}
+
+static bool TranscodeWindowHasRoom()
+{
+    return TranscodeCursor && TranscodeTaken < TranscodeConsumed + TranscodeAhead;
+}
+
+/*
+ * Reserves the memory of the next file as a side effect, holding
+ * TranscodeLock, so the files are reserved in list order
+ */
+static bool TranscodeMayContinue()
+{
+    return !TranscodeRunning || (TranscodeWindowHasRoom() && TryReserveNodeMemory(TranscodeCursor));
+}
+
+// Called holding TranscodeLock
+static void MoveCursorPast(InstanceNode* A_node)
+{
+    TranscodeLast = A_node;
+    TranscodeCursor = A_node->Next;
+    TranscodeTaken++;
+}
+
+static InstanceNode* TakeTranscodeNode()
+{
+    std::unique_lock<std::mutex> lock(TranscodeLock);
+
+    TranscodeWindowOpen.wait(lock, TranscodeMayContinue);
+    if (!TranscodeRunning)
+        return NULL;
+    InstanceNode* node = TranscodeCursor;
+    MoveCursorPast(node);
+    TranscodeBusy.insert(node);
+    return node;
+}
+
+static void StoreTranscodeResult(InstanceNode* A_node, SAMP_BOOLEAN A_read)
+{
+    std::lock_guard<std::mutex> lock(TranscodeLock);
+    TranscodeBusy.erase(A_node);
+    TranscodeReady[A_node] = A_read;
+    TranscodeNodeDone.notify_all();
+}
+
+static void PrepareNode(InstanceNode* A_node)
+{
+    if (TranscodeEnabled)
+        TranscodeNode(TranscodeAssociationID, A_node);
+    ValidateNode(A_node);
+}
+
+/*
+ * A file that cannot be read is left to the sender to report, as are the
+ * memory it reserved and the message it may have
+ */
+static void TranscodeWorker()
+{
+    InstanceNode* node;
+
+    while ((node = TakeTranscodeNode()) != NULL)
+    {
+        SAMP_BOOLEAN read = ReadImage(TranscodeOptions, TranscodeAppID, node);
+        if (read)
+            PrepareNode(node);
+        StoreTranscodeResult(node, read);
+    }
+}
+
+static bool PoolWanted()
+{
+    return TranscodeEnabled || ValidateEnabled();
+}
+
+/*
+ * JPEG-LS is encoded by the toolkit in one call per file, RLE in one per
+ * frame on the worker, so only -y keeps every core busy
+ */
+static unsigned TranscodeThreadCount()
+{
+    if (!TranscodeRleOnly)
+        return TRANSCODE_THREADS;
+    return std::max((unsigned)TRANSCODE_THREADS, std::thread::hardware_concurrency());
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeStart
+ *
+ *  Parameters  :   A_options       - Options of the sender
+ *                  A_appID         - Application ID registered
+ *                  A_associationID - Association the files are sent over
+ *                  A_list          - Head of the instance list
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Start the workers, a worker per core with -y,
+ *                  beginning with the first file, each allowed a file
+ *                  ahead of the sender.  Does
+ *                  nothing without -u, -y or -z.  The sender must take
+ *                  every file of the list in order with TranscodeTake, so
+ *                  the pool is not used when files may be skipped or taken
+ *                  back, as they are by the fail over of an SCP pool.
+ *
+ ****************************************************************************/
+void TranscodeStart(STORAGE_OPTIONS* A_options, int A_appID, int A_associationID, InstanceNode* A_list)
+{
+    unsigned threads = TranscodeThreadCount();
+
+    if (!PoolWanted())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(TranscodeLock);
+        TranscodeOptions = A_options;
+        TranscodeAppID = A_appID;
+        TranscodeAssociationID = A_associationID;
+        TranscodeCursor = A_list;
+        TranscodeLast = NULL;
+        TranscodeRunning = true;
+        TranscodeTaken = TranscodeConsumed = 0;
+        TranscodeAhead = std::max((unsigned long)TRANSCODE_AHEAD, (unsigned long)threads);
+    }
+    for (unsigned i = 0; i < threads; i++)
+        TranscodeThreads.push_back(new std::thread(TranscodeWorker));
+}
+
+static bool TakeReady(InstanceNode* A_node, SAMP_BOOLEAN* A_read)
+{
+    std::map<InstanceNode*, SAMP_BOOLEAN>::iterator ready = TranscodeReady.find(A_node);
+
+    if (ready == TranscodeReady.end())
+        return false;
+    *A_read = ready->second;
+    TranscodeReady.erase(ready);
+    return true;
+}
+
+/*
+ * A file the workers have not reached is read by the sender
+ */
+static void PassCursor(InstanceNode* A_node)
+{
+    if (TranscodeCursor != A_node)
+        return;
+    MoveCursorPast(A_node);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeTake
+ *
+ *  Parameters  :   A_node     - The node about to be sent
+ *                  A_read     - Set to the result of ReadImage() when the
+ *                               workers read the file
+ *
+ *  Returns     :   true if the workers read the file, its message is in
+ *                  the syntax it is sent in
+ *                  false if the sender must read it
+ *
+ *  Description :   Waits for a worker still reading the file.
+ *
+ ****************************************************************************/
+bool TranscodeTake(InstanceNode* A_node, SAMP_BOOLEAN* A_read)
+{
+    std::unique_lock<std::mutex> lock(TranscodeLock);
+
+    TranscodeNodeDone.wait(lock, [A_node] { return TranscodeBusy.count(A_node) == 0; });
+    TranscodeConsumed++;
+    PassCursor(A_node);
+    TranscodeWindowOpen.notify_all();
+    return TakeReady(A_node, A_read);
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeListGrown
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Let the workers go on with the files added to the end
+ *                  of the list after they reached it, as the directory
+ *                  crawl (-d) does while the list is sent.  Called by the
+ *                  sender once the files are added.
+ *
+ ****************************************************************************/
+void TranscodeListGrown(void)
+{
+    std::lock_guard<std::mutex> lock(TranscodeLock);
+
+    if (TranscodeCursor || !TranscodeLast)
+        return;
+    TranscodeCursor = TranscodeLast->Next;
+    TranscodeWindowOpen.notify_all();
+}
+
+static void FreeUnsent()
+{
+    for (std::map<InstanceNode*, SAMP_BOOLEAN>::iterator ready = TranscodeReady.begin(); ready != TranscodeReady.end(); ++ready)
+    {
+        if (ready->second)
+            FreeNodeMessage(ready->first);
+        ReleaseNodeMemory(ready->first);
+    }
+    TranscodeReady.clear();
+}
+
+/****************************************************************************
+ *
+ *  Function    :   TranscodeStop
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Stop the workers once their current file is done, and
+ *                  free the messages of the files read and never sent.
+ *                  Must be called before the instance list is freed.
+ *
+ ****************************************************************************/
+void TranscodeStop(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(TranscodeLock);
+        TranscodeRunning = false;
+    }
+    TranscodeWindowOpen.notify_all();
+    for (size_t i = 0; i < TranscodeThreads.size(); i++)
+    {
+        TranscodeThreads[i]->join();
+        delete TranscodeThreads[i];
+    }
+    TranscodeThreads.clear();
+    std::lock_guard<std::mutex> lock(TranscodeLock);
+    TranscodeCursor = TranscodeLast = NULL;
+    FreeUnsent();
+}
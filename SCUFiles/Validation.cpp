@@ -0,0 +1,137 @@
+#include "Definitions.h"
+
+/****************************************************************************
+ *
+ *  Validation
+ *
+ *  With -z the messages read ahead by the workers of Transcode.cpp are
+ *  checked with MC_Validate_Message before they reach the sender, so an
+ *  instance the SCP would refuse as an invalid dataset is held back
+ *  instead of costing a round trip.  Errors in the dataset quarantine the
+ *  instance: it is not sent, and each error is logged with its tag.
+ *  Errors in the command group are left out, as the toolkit fills it in
+ *  when the message is sent.
+ *
+ *  The percent given with -z of the instances are validated, spread
+ *  evenly over the list.  Validation never runs on the send path: a file
+ *  the sender reads itself, because the workers have not reached it, is
+ *  sent unvalidated.  The workers do not run with -j or -e, so -z is
+ *  turned off with those, see ValidationManagement().  Objects whose pixel
+ *  data is streamed (-x) are not validated, as their message holds no
+ *  pixel data until it is sent.
+ *
+ ****************************************************************************/
+
+static int                        SamplePercent = 0;         /* 0 when validation is off */
+static std::atomic<unsigned long> ValidateCandidates(0);   /* instances that could be validated so far */
+
+/****************************************************************************
+ *
+ *  Function    :   ValidateInit
+ *
+ *  Parameters  :   A_percent  - Percent of the instances to validate (-z),
+ *                               0 for none
+ *
+ *  Returns     :   nothing
+ *
+ ****************************************************************************/
+void ValidateInit(int A_percent)
+{
+    SamplePercent = std::min(std::max(A_percent, 0), 100);
+    ValidateCandidates = 0;
+}
+
+bool ValidateEnabled(void)
+{
+    return SamplePercent > 0;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ValidateSampled
+ *
+ *  Parameters  :   none
+ *
+ *  Returns     :   true if the next candidate is to be validated
+ *
+ *  Description :   Count a candidate, picking the percent of -z of every
+ *                  hundred, evenly spread.
+ *
+ ****************************************************************************/
+bool ValidateSampled(void)
+{
+    unsigned long candidate = ValidateCandidates++;
+
+    return (candidate + 1) * SamplePercent / 100 != candidate * SamplePercent / 100;
+}
+
+static bool ShouldValidate(const InstanceNode* A_node)
+{
+    return ValidateEnabled() && !A_node->streamPixelData && ValidateSampled();
+}
+
+static int NoteError(const InstanceNode* A_node, const VAL_ERR* A_error)
+{
+    if ((A_error->Tag >> 16) == 0x0000)
+        return 0;
+    LogMessage(LOG_LEVEL_WARNING, "[%s] (%04lX,%04lX) %s\n", A_node->fname, A_error->Tag >> 16, A_error->Tag & 0xFFFF, MC_Error_Message(A_error->Status));
+    return 1;
+}
+
+static int NoteErrors(const InstanceNode* A_node, VAL_ERR* A_error)
+{
+    int       errors = 0;
+    MC_STATUS mcStatus = MC_NORMAL_COMPLETION;
+
+    for (; mcStatus == MC_NORMAL_COMPLETION && A_error; mcStatus = MC_Get_Next_Validate_Error(A_node->msgID, &A_error))
+        errors += NoteError(A_node, A_error);
+    return errors;
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ValidateQuarantine
+ *
+ *  Parameters  :   A_node     - Node whose message did not validate
+ *                  A_error    - First error of MC_Validate_Message
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Log the errors of the message and set quarantined if
+ *                  any is in the dataset rather than the command group.
+ *
+ ****************************************************************************/
+void ValidateQuarantine(InstanceNode* A_node, VAL_ERR* A_error)
+{
+    int errors = NoteErrors(A_node, A_error);
+
+    if (errors == 0)
+        return;
+    LogMessage(LOG_LEVEL_ERROR, "[%s] quarantined, %d validation errors, not sent\n", A_node->fname, errors);
+    A_node->quarantined = SAMP_TRUE;
+    strcpy(A_node->statusMeaning, "Quarantined: invalid dataset");
+}
+
+/****************************************************************************
+ *
+ *  Function    :   ValidateNode
+ *
+ *  Parameters  :   A_node     - Node whose message was read by a worker
+ *
+ *  Returns     :   nothing
+ *
+ *  Description :   Validate the node's message if it is in the sample,
+ *                  setting quarantined when its dataset has errors.  Does
+ *                  nothing without -z.
+ *
+ ****************************************************************************/
+void ValidateNode(InstanceNode* A_node)
+{
+    VAL_ERR* error = NULL;
+
+    A_node->quarantined = SAMP_FALSE;
+    if (!ShouldValidate(A_node))
+        return;
+    if (MC_Validate_Message(A_node->msgID, &error, Validation_Level1) == MC_DOES_NOT_VALIDATE)
+        ValidateQuarantine(A_node, error);
+}